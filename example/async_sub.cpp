@@ -0,0 +1,39 @@
+#include <iostream>
+#include <unistd.h>
+#include "spdmq/spdmq.h"
+using namespace speed::mq;
+
+// 协程接收示例 (需要 C++20): 协程挂起时不占用线程, 消息到达后由事件线程恢复执行
+
+spdmq_task subscriber(spdmq& mq) {
+    // 等待连接上 pub 端
+    if (co_await mq.async_connect("ipc://speedmq") != SPDMQ_CODE_OK) {
+        std::cout << "connect failed" << std::endl;
+        co_return;
+    }
+
+    while (true) {
+        auto [code, msg] = co_await mq.async_recv();
+        if (code != SPDMQ_CODE_OK) {
+            std::cout << "recv failed, code:" << code << std::endl;
+            co_return;
+        }
+        std::cout << "data:" << (char*)msg.payload.data() << std::endl;
+    }
+}
+
+int main () {
+    spdmq_ctx_t ctx;
+    ctx.topics({"spdmq"})          // 设置订阅的 topic 信息
+       .mode(COMM_MODE::SPDMQ_SUB) // 设置 sub 模式
+       .heartbeat(10);             // 设置心跳为 10 ms
+    auto mq_ptr = NEW_SPDMQ(ctx);
+
+    // 协程运行到第一次挂起后返回, 之后在事件线程中继续
+    subscriber(*mq_ptr);
+    mq_ptr->spin(true);
+
+    while (true) {
+        pause();
+    }
+}
@@ -0,0 +1,116 @@
+#include <deque>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+#include "spdmq/spdmq.h"
+#include "spdmq_crc32c.hpp"
+using namespace speed::mq;
+
+// 帧校验和测试: 先测本机可用的每种 CRC32C 实现的吞吐, 再对比 pub/sub 通过 tcp 回环通信时关闭与开启校验和的收发耗时
+// CPU 开销以每 GB 数据耗费的 CPU 毫秒数给出, 1000 ms/GB 即 1 GB/s
+// 用法: ./bench_checksum [消息数量] [负载字节数]
+
+// spdmq 对象由后台线程使用, ctx 被 spdmq 对象引用, 测试结束前都不释放
+static std::deque<spdmq_ctx_t> g_ctx_list;
+static std::vector<std::shared_ptr<spdmq>> g_spdmq_list;
+
+// 保留计算结果, 避免被编译器优化掉
+static volatile uint32_t g_sink;
+
+static void bench_kernels() {
+    auto& crc32c = spdmq_crc32c::instance();
+    std::vector<uint8_t> data(1 << 20);
+    std::mt19937 random(1);
+    for (auto& byte : data) {
+        byte = random();
+    }
+
+    for (auto kernel : crc32c.kernels()) {
+        for (std::size_t size : {64, 256, 1024, 4096, 65536}) {
+            // 先与 portable 实现的结果比对, 再计时处理 256 MB, 起始位置错开
+            uint32_t mismatches = 0;
+            for (std::size_t offset = 0; offset < 64; ++offset) {
+                if (crc32c.value(kernel, data.data() + offset, size) != crc32c.value(CRC32C_KERNEL::PORTABLE, data.data() + offset, size)) {
+                    ++mismatches;
+                }
+            }
+
+            std::size_t count = (256 << 20) / size;
+            uint32_t sum = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < count; ++i) {
+                sum += crc32c.value(kernel, data.data() + (i * 72) % (data.size() - size), size);
+            }
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+            double bytes = static_cast<double>(count) * size;
+            std::cout << std::left << std::setw(14) << spdmq_crc32c::name(kernel) << std::right << std::setw(6) << size << " B: "
+                      << std::fixed << std::setprecision(2) << bytes / seconds.count() / 1e9 << " GB/s, "
+                      << seconds.count() * 1e3 / (bytes / 1e9) << " ms/GB"
+                      << (mismatches ? ", MISMATCH" : "") << std::endl;
+            g_sink = sum;
+        }
+    }
+    std::cout << "in use: " << spdmq_crc32c::name(crc32c.kernels().back()) << std::endl;
+}
+
+static void bench_frames(const char* name, bool checksum, uint16_t port, int32_t count, int32_t payload_size) {
+    auto url = "tcp://127.0.0.1:" + std::to_string(port);
+
+    auto& pub_ctx = g_ctx_list.emplace_back();
+    pub_ctx.mode(COMM_MODE::SPDMQ_PUB).checksum(checksum).send_hwm(0);
+    auto pub = NEW_SPDMQ(pub_ctx);
+    g_spdmq_list.push_back(pub);
+    pub->bind(url);
+    pub->spin(true);
+
+    auto& sub_ctx = g_ctx_list.emplace_back();
+    sub_ctx.topics({"bench"}).mode(COMM_MODE::SPDMQ_SUB).queue_size(count);
+    auto sub = NEW_SPDMQ(sub_ctx);
+    g_spdmq_list.push_back(sub);
+    sub->connect(url);
+    sub->spin(true);
+
+    // 等待订阅关系建立
+    usleep(500 * 1000);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::thread sender([&] {
+        for (int32_t i = 0; i < count; ++i) {
+            spdmq_msg_t msg;
+            msg.topic = "bench";
+            msg.payload.resize(payload_size);
+            pub->send(msg);
+        }
+    });
+
+    int32_t received = 0;
+    spdmq_msg_t msg;
+    while (received < count && sub->recv(msg, 2000) == SPDMQ_CODE_OK) {
+        ++received;
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+    sender.join();
+
+    auto stat = sub->checksum_stats();
+    std::cout << name << ": received " << received << "/" << count << " in " << std::fixed << std::setprecision(1) << seconds.count() * 1e3 << " ms, "
+              << received / seconds.count() / 1e3 << " k msg/s, verified " << stat.frames << " frames " << stat.bytes
+              << " bytes, mismatches " << stat.mismatches << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int32_t count = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int32_t payload_size = argc > 2 ? std::atoi(argv[2]) : 1024;
+
+    bench_kernels();
+    bench_frames("checksum off", false, 45681, count, payload_size);
+    bench_frames("checksum on ", true, 45682, count, payload_size);
+
+    // spdmq 对象由后台线程持有, 直接退出进程
+    std::cout.flush();
+    _exit(0);
+}
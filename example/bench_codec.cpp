@@ -0,0 +1,363 @@
+#include <tuple>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include "spdmq/spdmq.h"
+#include "codec.h"
+#include "spdmq_internal_def.h"
+using namespace speed::mq;
+
+// 编解码测试: 先检查每种可用压缩算法的往返结果, 以及内置 LZ 对截断和损坏输入的拒绝, 再检查 v2 帧的编码与畸形帧的拒绝,
+// 最后给出各压缩算法对典型负载的压缩率与吞吐
+// 有检查失败时打印 FAILED 并以 1 退出
+// 用法: ./bench_codec [负载字节数]
+
+static int32_t g_failures = 0;
+
+static void check(const std::string& name, bool passed) {
+    if (!passed) {
+        ++g_failures;
+        std::cout << "FAILED: " << name << std::endl;
+    }
+}
+
+static const char* codec_name(compression_t type) {
+    switch (type) {
+        case COMPRESSION::LZ:
+            return "lz";
+        case COMPRESSION::LZ4:
+            return "lz4";
+        case COMPRESSION::ZSTD:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+// 类似行情的文本, 字段名重复, 数值变化, 可以压缩
+static std::vector<uint8_t> text_payload(std::size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::string text;
+    while (text.size() < size) {
+        text += "{\"symbol\":\"SPD" + std::to_string(random() % 100) + "\",\"price\":" + std::to_string(random() % 100000) +
+                ",\"volume\":" + std::to_string(random() % 1000) + ",\"side\":\"" + (random() % 2 ? "buy" : "sell") + "\"}";
+    }
+    return std::vector<uint8_t>(text.begin(), text.begin() + size);
+}
+
+static std::vector<uint8_t> random_payload(std::size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = random();
+    }
+    return data;
+}
+
+// 压缩后解压必须还原, 不变小时 compress 返回 false, 负载按原样发送, 不检查
+static void check_round_trip(compression_t type, const std::vector<uint8_t>& payload, const std::vector<uint8_t>& dictionary, const std::string& name) {
+    auto codec = codec::of(type);
+    std::vector<uint8_t> packed;
+    if (!codec->compress(payload.data(), payload.size(), dictionary, 0, packed)) {
+        return;
+    }
+    check(name + " shrinks", packed.size() < payload.size());
+
+    // 按压缩结果的实际大小拷贝, 越界读取在 sanitizer 下可见
+    std::vector<uint8_t> input(packed.begin(), packed.end());
+    std::vector<uint8_t> unpacked;
+    check(name + " decompresses", codec->decompress(input.data(), input.size(), dictionary, payload.size(), unpacked) && unpacked == payload);
+}
+
+static void check_codecs() {
+    auto dictionary = text_payload(4096, 7);
+    for (auto type : {COMPRESSION::LZ, COMPRESSION::LZ4, COMPRESSION::ZSTD}) {
+        if (!codec::of(type)) {
+            std::cout << codec_name(type) << ": not built in, skipped" << std::endl;
+            continue;
+        }
+        for (std::size_t size : {1, 15, 16, 17, 64, 100, 512, 1000, 4096, 65535, 65536, 70000, 1 << 20}) {
+            auto name = std::string(codec_name(type)) + " " + std::to_string(size) + " B";
+            check_round_trip(type, text_payload(size, size), {}, name + " text");
+            check_round_trip(type, text_payload(size, size), dictionary, name + " text with dictionary");
+            check_round_trip(type, std::vector<uint8_t>(size, 'a'), {}, name + " repeated");
+            check_round_trip(type, std::vector<uint8_t>(size, 'a'), dictionary, name + " repeated with dictionary");
+
+            std::vector<uint8_t> packed;
+            auto random = random_payload(size, size);
+            check(name + " random does not shrink", !codec::of(type)->compress(random.data(), random.size(), {}, 0, packed));
+        }
+
+        // 同一字典连续压缩多个小负载, 字典的哈希表在负载之间复原
+        for (uint32_t seed = 0; seed < 100; ++seed) {
+            check_round_trip(type, text_payload(200 + seed, seed), dictionary, std::string(codec_name(type)) + " small with dictionary " + std::to_string(seed));
+        }
+    }
+}
+
+static bool lz_unpacks(const std::vector<uint8_t>& input, const std::vector<uint8_t>& dictionary, std::size_t raw_size) {
+    std::vector<uint8_t> exact(input.begin(), input.end());
+    std::vector<uint8_t> unpacked;
+    auto unpacked_ok = codec::of(COMPRESSION::LZ)->decompress(exact.data(), exact.size(), dictionary, raw_size, unpacked);
+    return unpacked_ok && unpacked.size() == raw_size;
+}
+
+static void check_lz_rejects() {
+    auto lz = codec::of(COMPRESSION::LZ);
+    auto dictionary = text_payload(4096, 7);
+    auto payload = text_payload(4096, 1);
+    std::vector<uint8_t> packed;
+    check("lz reject: compress", lz->compress(payload.data(), payload.size(), {}, 0, packed));
+
+    // 任何截断都不能还原出 raw_size 字节
+    for (std::size_t size = 0; size < packed.size(); ++size) {
+        if (lz_unpacks(std::vector<uint8_t>(packed.begin(), packed.begin() + size), {}, payload.size())) {
+            check("lz reject: truncated to " + std::to_string(size) + " B", false);
+            break;
+        }
+    }
+    check("lz reject: raw size too small", !lz_unpacks(packed, {}, payload.size() - 1));
+    check("lz reject: raw size too large", !lz_unpacks(packed, {}, payload.size() + 1));
+
+    // 依赖字典压缩的负载, 缺少字典时匹配指向输出之前
+    auto small = std::vector<uint8_t>(dictionary.begin() + 1000, dictionary.begin() + 1300);
+    check("lz reject: compress with dictionary", lz->compress(small.data(), small.size(), dictionary, 0, packed));
+    check("lz reject: dictionary missing", !lz_unpacks(packed, {}, small.size()));
+    check("lz reject: dictionary given", lz_unpacks(packed, dictionary, small.size()));
+
+    // 手工构造的坏序列: token 高 4 位为字面量长度, 低 4 位为匹配长度减 4, 之后是 2 字节小端偏移
+    check("lz reject: empty input", !lz_unpacks({}, {}, 1));
+    check("lz reject: literals past input", !lz_unpacks({0x50, 'a'}, {}, 5));
+    check("lz reject: literals past raw size", !lz_unpacks({0x20, 'a', 'b'}, {}, 1));
+    check("lz reject: literal length runs off", !lz_unpacks({0xf0, 0xff, 0xff}, {}, 300));
+    check("lz reject: offset cut short", !lz_unpacks({0x10, 'a', 0x01}, {}, 5));
+    check("lz reject: offset 0", !lz_unpacks({0x10, 'a', 0x00, 0x00}, {}, 5));
+    check("lz reject: offset before output", !lz_unpacks({0x10, 'a', 0x02, 0x00}, {}, 5));
+    check("lz reject: offset before dictionary", !lz_unpacks({0x10, 'a', 0x03, 0x00}, {'x'}, 5));
+    check("lz reject: match length runs off", !lz_unpacks({0x1f, 'a', 0x01, 0x00, 0xff}, {}, 300));
+    check("lz reject: match past raw size", !lz_unpacks({0x11, 'a', 0x01, 0x00}, {}, 5));
+    check("lz accept: overlapping match", lz_unpacks({0x11, 'a', 0x01, 0x00, 0x10, 'b'}, {}, 7));
+    check("lz accept: match into dictionary", lz_unpacks({0x10, 'a', 0x02, 0x00}, {'x', 'y'}, 5));
+
+    // 随机改写字节, 可能被拒绝, 也可能解出别的内容 (由校验和发现), 不能越界或崩溃
+    lz->compress(payload.data(), payload.size(), {}, 0, packed);
+    std::mt19937 random(3);
+    uint32_t rejected = 0;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        auto corrupt = packed;
+        for (uint32_t n = 1 + random() % 4; n; --n) {
+            corrupt[random() % corrupt.size()] = random();
+        }
+        rejected += !lz_unpacks(corrupt, {}, payload.size());
+    }
+    std::cout << "lz corrupt input: " << rejected << "/20000 rejected, no crash" << std::endl;
+}
+
+static std::vector<uint8_t> varints(std::initializer_list<uint64_t> values) {
+    std::vector<uint8_t> data(values.size() * 10);
+    auto ptr = data.data();
+    for (auto value : values) {
+        ptr = put_varint(ptr, value);
+    }
+    data.resize(ptr - data.data());
+    return data;
+}
+
+static bool decode(const std::vector<uint8_t>& body, std::vector<std::string>& topics, comm_msg_t& msg, frame_compression_t& compression) {
+    std::vector<uint8_t> exact(body.begin(), body.end());
+    return decode_comm_frame_v2(exact.data(), exact.size(), 0, topics, msg, compression);
+}
+
+static bool decode(const std::vector<uint8_t>& body) {
+    std::vector<std::string> topics = {"", "known"};
+    comm_msg_t msg;
+    frame_compression_t compression;
+    return decode(body, topics, msg, compression);
+}
+
+// 拼出帧体: flags, msg_type, 其余字段由调用方给出
+static std::vector<uint8_t> body_of(uint64_t flags, const std::vector<uint8_t>& rest) {
+    auto body = varints({flags});
+    body.push_back(static_cast<uint8_t>(MESSAGE_TYPE::DATA));
+    body.insert(body.end(), rest.begin(), rest.end());
+    return body;
+}
+
+static void check_varints() {
+    for (uint64_t value : {uint64_t(0), uint64_t(1), uint64_t(127), uint64_t(128), uint64_t(16383), uint64_t(16384), uint64_t(UINT32_MAX), UINT64_MAX}) {
+        auto data = varints({value});
+        const uint8_t* ptr = data.data();
+        uint64_t decoded;
+        check("varint " + std::to_string(value), get_varint(ptr, data.data() + data.size(), decoded) && decoded == value &&
+                                                  ptr == data.data() + data.size() && data.size() == varint_size(value));
+
+        // 截断后失败, 且不移动 ptr
+        for (std::size_t size = 0; size < data.size(); ++size) {
+            ptr = data.data();
+            if (get_varint(ptr, data.data() + size, decoded) || ptr != data.data()) {
+                check("varint " + std::to_string(value) + " truncated to " + std::to_string(size) + " B", false);
+            }
+        }
+    }
+
+    std::vector<uint8_t> overlong(11, 0x80);
+    overlong.back() = 0x01;
+    const uint8_t* ptr = overlong.data();
+    uint64_t decoded;
+    check("varint over 10 bytes", !get_varint(ptr, overlong.data() + overlong.size(), decoded) && ptr == overlong.data());
+}
+
+static void check_frames() {
+    auto payload = text_payload(300, 5);
+    comm_frame_view_t view;
+    view.msg_type = MESSAGE_TYPE::DATA;
+    view.topic = "market.tick";
+    view.payload = payload.data();
+    view.payload_size = payload.size();
+    view.send_time_stamp = 1700000000000000;
+    view.sequence = 42;
+    view.correlation_id = 7;
+    view.ttl = 5000000;
+    view.mono_time_stamp = 123456789;
+    view.compression = {COMPRESSION::LZ, 1000, 9};
+
+    // 编码, 校验, 解码后各字段一致: topic 以名字发送, 以 id 定义, 以已定义的 id 引用
+    std::vector<std::string> topics;
+    for (auto [topic_id, define, checksum] : std::initializer_list<std::tuple<uint32_t, bool, bool>>{{0, false, false}, {0, false, true}, {3, true, true}, {3, false, false}}) {
+        auto name = "frame topic id " + std::to_string(topic_id) + (define ? " defined" : "") + (checksum ? " checksum" : "");
+        std::vector<uint8_t> frame;
+        encode_comm_frame_v2(view, topic_id, define, 1699999999000000, checksum, frame);
+
+        const uint8_t* body = frame.data();
+        uint64_t length;
+        check(name + " length", get_varint(body, frame.data() + frame.size(), length) && body + length == frame.data() + frame.size());
+        std::size_t size = length;
+        check(name + " checksum", verify_comm_frame_v2(body, size) == (checksum ? FRAME_CHECKSUM::MATCH : FRAME_CHECKSUM::NONE));
+
+        comm_msg_t msg;
+        frame_compression_t compression;
+        check(name + " decodes", decode_comm_frame_v2(body, size, 1699999999000000, topics, msg, compression));
+        check(name + " fields", msg.msg_type == view.msg_type && msg.topic == view.topic && msg.payload == payload &&
+                                msg.send_time_stamp == view.send_time_stamp && msg.sequence == view.sequence &&
+                                msg.correlation_id == view.correlation_id && msg.ttl == view.ttl && msg.mono_time_stamp == view.mono_time_stamp);
+        check(name + " compression", compression.codec == COMPRESSION::LZ && compression.raw_size == 1000 && compression.dictionary_id == 9);
+
+        // 头部任何位置截断都失败, 截在负载中的帧由长度前缀挡住, 这里不检查
+        for (std::size_t cut = 0; cut < size - payload.size(); ++cut) {
+            std::vector<std::string> copy = topics;
+            if (decode_comm_frame_v2(body, cut, 1699999999000000, copy, msg, compression)) {
+                check(name + " truncated to " + std::to_string(cut) + " B", false);
+                break;
+            }
+        }
+
+        // 带校验和的帧改动任何一位都被发现
+        if (checksum) {
+            std::vector<uint8_t> corrupt(body, body + length);
+            corrupt[corrupt.size() / 2] ^= 0x10;
+            size = corrupt.size();
+            check(name + " corrupt", verify_comm_frame_v2(corrupt.data(), size) == FRAME_CHECKSUM::MISMATCH);
+        }
+    }
+
+    auto topic = varints({5});
+    topic.insert(topic.end(), {'t', 'o', 'p', 'i', 'c'});
+    auto topic_id = static_cast<uint64_t>(FRAME_FLAG::TOPIC_ID);
+    auto compressed = static_cast<uint64_t>(FRAME_FLAG::COMPRESSED);
+    check("frame accept: topic name", decode(body_of(0, topic)));
+    check("frame accept: known topic id", decode(body_of(topic_id, varints({1}))));
+    check("frame reject: empty body", !decode({}));
+    check("frame reject: flags truncated", !decode({0x80}));
+    check("frame reject: msg_type missing", !decode(varints({0})));
+    check("frame reject: unknown flag", !decode(body_of(FRAME_FLAGS_KNOWN + 1, topic)));
+    check("frame reject: topic length truncated", !decode(body_of(0, {0x80})));
+    check("frame reject: topic name past end", !decode(body_of(0, {6, 't', 'o', 'p', 'i', 'c'})));
+    check("frame reject: topic id truncated", !decode(body_of(topic_id, {0x81})));
+    check("frame reject: topic id 0", !decode(body_of(topic_id, varints({0}))));
+    check("frame reject: topic id over max", !decode(body_of(topic_id, varints({FRAME_TOPIC_ID_MAX + 1}))));
+    check("frame reject: topic id never defined", !decode(body_of(topic_id, varints({2}))));
+    check("frame reject: topic id defined empty", !decode(body_of(topic_id | static_cast<uint64_t>(FRAME_FLAG::TOPIC_NAME), varints({2, 0}))));
+    check("frame reject: timestamp truncated", !decode(body_of(static_cast<uint64_t>(FRAME_FLAG::TIMESTAMP), [&] {
+        auto rest = topic;
+        rest.push_back(0xff);
+        return rest;
+    }())));
+    for (auto flag : {FRAME_FLAG::SEQUENCE, FRAME_FLAG::CORRELATION_ID, FRAME_FLAG::TTL, FRAME_FLAG::MONO_STAMP}) {
+        check("frame reject: field " + std::to_string(static_cast<uint32_t>(flag)) + " missing", !decode(body_of(static_cast<uint64_t>(flag), topic)));
+    }
+
+    auto with = [&topic](std::initializer_list<uint64_t> values) {
+        auto rest = topic;
+        auto fields = varints(values);
+        rest.insert(rest.end(), fields.begin(), fields.end());
+        return rest;
+    };
+    check("frame accept: compressed", decode(body_of(compressed, with({1, 100, 0}))));
+    check("frame reject: compressed truncated", !decode(body_of(compressed, with({1, 100}))));
+    check("frame reject: compressed codec 0", !decode(body_of(compressed, with({0, 100, 0}))));
+    check("frame reject: compressed codec over 255", !decode(body_of(compressed, with({256, 100, 0}))));
+    check("frame reject: raw size over max", !decode(body_of(compressed, with({1, FRAME_RAW_SIZE_MAX + 1, 0}))));
+    check("frame reject: dictionary id over 32 bits", !decode(body_of(compressed, with({1, 100, uint64_t(UINT32_MAX) + 1}))));
+
+    // 声明校验和但帧体放不下
+    std::size_t size = 2;
+    std::vector<uint8_t> short_body = {static_cast<uint8_t>(FRAME_FLAG::CHECKSUM), 0};
+    check("frame reject: checksum cut short", verify_comm_frame_v2(short_body.data(), size) == FRAME_CHECKSUM::MISMATCH);
+}
+
+static void bench_codecs(std::size_t payload_size) {
+    auto dictionary = text_payload(4096, 7);
+    auto payload = text_payload(payload_size, 11);
+    for (auto type : {COMPRESSION::LZ, COMPRESSION::LZ4, COMPRESSION::ZSTD}) {
+        auto codec = codec::of(type);
+        if (!codec) {
+            continue;
+        }
+        for (auto with_dictionary : {false, true}) {
+            const auto& dict = with_dictionary ? dictionary : std::vector<uint8_t>();
+            std::vector<uint8_t> packed;
+            std::vector<uint8_t> unpacked;
+            if (!codec->compress(payload.data(), payload.size(), dict, 0, packed)) {
+                std::cout << std::left << std::setw(5) << codec_name(type) << (with_dictionary ? " dict" : "     ") << std::right << std::setw(8) << payload_size
+                          << " B: does not shrink" << std::endl;
+                continue;
+            }
+            std::size_t count = std::max<std::size_t>((64 << 20) / payload_size, 1);
+
+            auto begin = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < count; ++i) {
+                codec->compress(payload.data(), payload.size(), dict, 0, packed);
+            }
+            std::chrono::duration<double> compress_seconds = std::chrono::steady_clock::now() - begin;
+
+            begin = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < count; ++i) {
+                codec->decompress(packed.data(), packed.size(), dict, payload.size(), unpacked);
+            }
+            std::chrono::duration<double> decompress_seconds = std::chrono::steady_clock::now() - begin;
+
+            double bytes = static_cast<double>(count) * payload_size;
+            std::cout << std::left << std::setw(5) << codec_name(type) << (with_dictionary ? " dict" : "     ") << std::right << std::setw(8) << payload_size
+                      << " B: ratio " << std::fixed << std::setprecision(2) << static_cast<double>(payload_size) / packed.size()
+                      << ", compress " << bytes / compress_seconds.count() / 1e9 << " GB/s, decompress "
+                      << bytes / decompress_seconds.count() / 1e9 << " GB/s" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t payload_size = argc > 1 ? std::atoi(argv[1]) : 1024;
+
+    check_codecs();
+    check_lz_rejects();
+    check_varints();
+    check_frames();
+    std::cout << (g_failures ? "checks FAILED: " + std::to_string(g_failures) : std::string("checks passed")) << std::endl;
+
+    bench_codecs(payload_size);
+    return g_failures ? 1 : 0;
+}
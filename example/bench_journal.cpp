@@ -0,0 +1,69 @@
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include "spdmq/spdmq.h"
+using namespace speed::mq;
+
+// 日志写入测试: 对比 pub 关闭与开启 journal 时 send 的吞吐, 没有订阅者, 测的是写入内存映射文件的开销
+// 同时给出单次 send 耗时的 p99.9 与最大值, 切换 segment 时不应出现明显的停顿
+// 用法: ./bench_journal [日志目录] [消息数量] [负载字节数] [segment 字节数]
+
+// spdmq 对象由后台线程使用, ctx 被 spdmq 对象引用, 测试结束前都不释放
+static std::deque<spdmq_ctx_t> g_ctx_list;
+static std::vector<std::shared_ptr<spdmq>> g_spdmq_list;
+
+static void bench_send(const char* name, const std::string& path, uint16_t port, int32_t count, int32_t payload_size, uint64_t segment_size) {
+    auto& pub_ctx = g_ctx_list.emplace_back();
+    pub_ctx.mode(COMM_MODE::SPDMQ_PUB);
+    if (!path.empty()) {
+        spdmq_journal_opt_t opt;
+        opt.path = path;
+        opt.segment_size = segment_size;
+        opt.max_segments = 4;
+        pub_ctx.journal(opt);
+    }
+    auto pub = NEW_SPDMQ(pub_ctx);
+    g_spdmq_list.push_back(pub);
+    pub->bind("tcp://127.0.0.1:" + std::to_string(port));
+    pub->spin(true);
+
+    // send 会取走 payload, 每条消息在计时前重新准备, 总耗时按各次 send 之和计算
+    std::vector<int64_t> nsecs(count);
+    for (int32_t i = 0; i < count; ++i) {
+        spdmq_msg_t msg;
+        msg.topic = "bench";
+        msg.payload.resize(payload_size);
+        auto begin = std::chrono::steady_clock::now();
+        pub->send(msg);
+        nsecs[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    double seconds = 0;
+    for (auto n : nsecs) {
+        seconds += n / 1e9;
+    }
+    std::sort(nsecs.begin(), nsecs.end());
+    double bytes = static_cast<double>(count) * payload_size;
+    std::cout << name << ": " << count << " x " << payload_size << " B in " << std::fixed << std::setprecision(1) << seconds * 1e3 << " ms, "
+              << count / seconds / 1e3 << " k msg/s, " << std::setprecision(2) << bytes / seconds / 1e9 << " GB/s, send p99.9 "
+              << nsecs[count * 999 / 1000] / 1e3 << " us, max " << nsecs.back() / 1e3 << " us" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "/tmp/bench_journal";
+    int32_t count = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    int32_t payload_size = argc > 3 ? std::atoi(argv[3]) : 4096;
+    uint64_t segment_size = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 64 << 20;
+
+    bench_send("journal off", "", 45691, count, payload_size, segment_size);
+    bench_send("journal on ", path, 45692, count, payload_size, segment_size);
+
+    // spdmq 对象由后台线程持有, 直接退出进程
+    std::cout.flush();
+    _exit(0);
+}
@@ -0,0 +1,94 @@
+#include <deque>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include "spdmq/spdmq.h"
+using namespace speed::mq;
+
+// 小消息延迟测试: 同一进程内 pub/sub 通过 tcp 回环通信, 对比不同 socket 调优配置
+// 发送端附带单调时钟时间戳, 延迟以纳秒计, 并与接收端的延迟直方图对照
+// 用法: ./bench_latency [消息数量] [发送间隔(微秒)] [负载字节数]
+
+// spdmq 对象由后台线程使用, ctx 被 spdmq 对象引用, 测试结束前都不释放
+static std::deque<spdmq_ctx_t> g_ctx_list;
+static std::vector<std::shared_ptr<spdmq>> g_spdmq_list;
+
+static void bench(const char* name, socket_profile_t profile, uint16_t port, int32_t count, int32_t interval_us, int32_t payload_size) {
+    auto url = "tcp://127.0.0.1:" + std::to_string(port);
+
+    auto& pub_ctx = g_ctx_list.emplace_back();
+    pub_ctx.mode(COMM_MODE::SPDMQ_PUB).socket_profile(profile).monotonic_stamp(true);
+    auto pub = NEW_SPDMQ(pub_ctx);
+    g_spdmq_list.push_back(pub);
+    pub->bind(url);
+    pub->spin(true);
+
+    auto& sub_ctx = g_ctx_list.emplace_back();
+    sub_ctx.topics({"bench"}).mode(COMM_MODE::SPDMQ_SUB).socket_profile(profile).queue_size(count).latency_histogram(true);
+    auto sub = NEW_SPDMQ(sub_ctx);
+    g_spdmq_list.push_back(sub);
+    sub->connect(url);
+    sub->spin(true);
+
+    // 等待订阅关系建立
+    usleep(500 * 1000);
+
+    std::thread sender([&] {
+        for (int32_t i = 0; i < count; ++i) {
+            spdmq_msg_t msg;
+            msg.topic = "bench";
+            msg.payload.resize(payload_size);
+            pub->send(msg);
+            usleep(interval_us);
+        }
+    });
+
+    std::vector<int64_t> costs;
+    costs.reserve(count);
+    while (costs.size() < static_cast<std::size_t>(count)) {
+        spdmq_msg_t msg;
+        if (sub->recv(msg, 2000) != SPDMQ_CODE_OK) {
+            break;
+        }
+        costs.push_back(msg.time_cost_ns);
+    }
+    sender.join();
+
+    if (costs.empty()) {
+        std::cout << name << ": no message received" << std::endl;
+        return;
+    }
+
+    std::sort(costs.begin(), costs.end());
+    int64_t sum = 0;
+    for (auto cost : costs) {
+        sum += cost;
+    }
+    std::cout << name << ": received " << costs.size() << "/" << count
+              << ", avg " << sum / static_cast<int64_t>(costs.size()) << " ns"
+              << ", p50 " << costs[costs.size() / 2] << " ns"
+              << ", p99 " << costs[costs.size() * 99 / 100] << " ns"
+              << ", max " << costs.back() << " ns" << std::endl;
+
+    // 接收端直方图, 分桶上界, 误差 6.25% 以内
+    auto latency = sub->topic_stats()["bench"].latency;
+    std::cout << "  histogram: p50 " << latency.p50 << " ns, p99 " << latency.p99
+              << " ns, p999 " << latency.p999 << " ns" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int32_t count = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int32_t interval_us = argc > 2 ? std::atoi(argv[2]) : 1000;
+    int32_t payload_size = argc > 3 ? std::atoi(argv[3]) : 32;
+
+    bench("default    ", SOCKET_PROFILE::DEFAULT, 45671, count, interval_us, payload_size);
+    bench("low_latency", SOCKET_PROFILE::LOW_LATENCY, 45672, count, interval_us, payload_size);
+
+    // spdmq 对象由后台线程持有, 直接退出进程
+    std::cout.flush();
+    _exit(0);
+}
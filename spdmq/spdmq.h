@@ -24,6 +24,10 @@
 
 namespace speed::mq {
 
+class spdmq_recv_awaiter;
+class spdmq_send_awaiter;
+class spdmq_connect_awaiter;
+
 class spdmq {
 public:
     /**
@@ -42,11 +46,18 @@ public:
      *
      * @param url [input]: Service address, format as follows:
      *              tcp://ip:port
-     *              ipc://[a-zA-Z0-9@\._]+
+     *              tcp://[ipv6]:port (such as tcp://[::1]:5555, tcp://[fe80::1%eth0]:5555)
+     *              ipc://[a-zA-Z0-9@\._]+ (socket file under /tmp/)
+     *              ipc:///absolute/path
+     *              ipc://@name (linux abstract namespace, no socket file)
+     *              ipc+seq://... (same addresses as ipc://, SOCK_SEQPACKET, one frame per packet)
+     *              inproc://name (threads of this process, messages are moved without serialization)
      * 
      * @return SPDMQ_OK - bind success
      * 
      * @note for details on "spdmq_code_t", please refer to the "spdmq_def. h" header file
+     *       bind and connect may be called several times, all endpoints share one event loop,
+     *       subscription table and receive queue
      *
      */
     spdmq_code_t bind(const std::string& url);
@@ -56,11 +67,18 @@ public:
      *
      * @param url [input]: Service address, format as follows:
      *              tcp://ip:port
-     *              ipc://[a-zA-Z0-9@\._]+
+     *              tcp://[ipv6]:port (such as tcp://[::1]:5555, tcp://[fe80::1%eth0]:5555)
+     *              ipc://[a-zA-Z0-9@\._]+ (socket file under /tmp/)
+     *              ipc:///absolute/path
+     *              ipc://@name (linux abstract namespace, no socket file)
+     *              ipc+seq://... (same addresses as ipc://, SOCK_SEQPACKET, one frame per packet)
+     *              inproc://name (threads of this process, messages are moved without serialization)
      * 
      * @return SPDMQ_OK - connect success
      * 
      * @note for details on "spdmq_code_t", please refer to the "spdmq_def. h" header file
+     *       bind and connect may be called several times, all endpoints share one event loop,
+     *       subscription table and receive queue
      *
      */
     spdmq_code_t connect(const std::string& url);
@@ -73,6 +91,18 @@ public:
      * @return SPDMQ_OK - send success
      * 
      * @note for details on "spdmq_code_t", please refer to the "spdmq_def. h" header file
+     *       send never blocks on a slow peer, frames the socket can not take yet wait in the outbound queue
+     *       of the session, beyond spdmq_ctx::send_hwm messages the peer misses them (SPDMQ_CODE_SEND_FAILED_HWM)
+     *       in SPDMQ_PUSH mode each message goes to one PULL peer chosen by spdmq_ctx::push_strategy,
+     *       peers at the high-water mark are skipped
+     *       in SPDMQ_PUB mode a subscriber with spdmq_ctx::credit_window is only sent what it has credit for,
+     *       the others go on and SPDMQ_CODE_SEND_FAILED_NO_CREDIT is returned, for the topics it conflates
+     *       the latest message is held back until its credit returns
+     *       with spdmq_ctx::journal the messages of its topics are also appended to memory-mapped files, a subscriber
+     *       asking for a replay is sent them from there before it joins the live messages
+     *       a message with spdmq_msg_t::ttl, or spdmq_ctx::topic_ttl of its topic, is dropped wherever it waits past
+     *       its time to live: before fan-out (SPDMQ_CODE_SEND_FAILED_EXPIRED), in the outbound queues and in the
+     *       receive queue of the peer
      *
      */
     spdmq_code_t send(spdmq_msg_t& msg);
@@ -87,16 +117,255 @@ public:
      * @return SPDMQ_OK - recv success
      * 
      * @note for details on "spdmq_code_t", please refer to the "spdmq_def. h" header file
+     *       every topic has its own receive queue (spdmq_ctx::topic_queue), recv takes the topics in turn
      *
      */
     spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out = 0);
 
+    /**
+     * @brief receive data of one topic (SPDMQ_SUB and SPDMQ_PULL mode)
+     * 
+     * @param msg [output]: recv msg
+     * 
+     * @param topic [input]: topic to receive, messages of other topics stay queued
+     * 
+     * @param time_out [input]: equal to 0 never timeout, greater than 0 indicates timeout time (unit millisecond)
+     *
+     * @return SPDMQ_OK - recv success
+     *
+     */
+    spdmq_code_t recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out = 0);
+
+    /**
+     * @brief send a payload written in place, the typed send below are built on it
+     * 
+     * @param msg [input]: send msg, its payload is ignored
+     * 
+     * @param payload [input]: size and writer of the payload
+     * 
+     * @return the same as send(msg)
+     * 
+     * @note in SPDMQ_PUB mode the payload is written straight into the frame shared by the subscribers, unless
+     *       the message is also kept (replay_depth, journal, last value cache, credit); the other modes write it to msg.payload
+     *
+     */
+    spdmq_code_t send(spdmq_msg_t& msg, const spdmq_payload_t& payload);
+
+    /**
+     * @brief send a value encoded by spdmq_codec<T>
+     * 
+     * @param msg [input]: send msg, topic, ttl and session_id are taken from it, its payload is ignored
+     * 
+     * @param value [input]: payload value
+     * 
+     * @return the same as send(msg)
+     * 
+     * @note a trivially copyable T goes as its bytes, so sender and receiver must agree on its layout
+     *
+     */
+    template<typename T>
+    spdmq_code_t send(spdmq_msg_t& msg, const T& value) {
+        spdmq_payload_t payload;
+        payload.size = spdmq_codec<T>::size(value);
+        payload.write = [](const void* value, uint8_t* dst) { spdmq_codec<T>::encode(*static_cast<const T*>(value), dst); };
+        payload.value = &value;
+        return send(msg, payload);
+    }
+
+    template<typename T>
+    spdmq_code_t send(const std::string& topic, const T& value) {
+        spdmq_msg_t msg;
+        msg.topic = topic;
+        return send(msg, value);
+    }
+
+    /**
+     * @brief receive a value encoded by spdmq_codec<T>
+     * 
+     * @param value [output]: payload value
+     * 
+     * @param time_out [input]: the same as recv(msg, time_out)
+     *
+     * @return SPDMQ_CODE_DATA_PARSE_ERROR - the payload is not a T, otherwise the same as recv(msg, time_out)
+     * 
+     * @note to read a trivially copyable T without copying it out of msg.payload, recv the msg and use spdmq_msg_t::view<T>
+     *
+     */
+    template<typename T>
+    spdmq_code_t recv(T& value, time_msec_t time_out = 0) {
+        spdmq_msg_t msg;
+        auto code = recv(msg, time_out);
+        if (code == SPDMQ_CODE_OK && !msg.get(value)) {
+            return SPDMQ_CODE_DATA_PARSE_ERROR;
+        }
+        return code;
+    }
+
+    template<typename T>
+    spdmq_code_t recv(T& value, const std::string& topic, time_msec_t time_out = 0) {
+        spdmq_msg_t msg;
+        auto code = recv(msg, topic, time_out);
+        if (code == SPDMQ_CODE_OK && !msg.get(value)) {
+            return SPDMQ_CODE_DATA_PARSE_ERROR;
+        }
+        return code;
+    }
+
+    /**
+     * @brief statistics of the receive queue of every topic seen so far
+     * 
+     * @return topic -> queued, received, dropped and expired message counts, and the latency with spdmq_ctx::latency_histogram
+     * 
+     * @note in SPDMQ_SUB mode missed counts the messages that never arrived, told by gaps in spdmq_msg_t::sequence,
+     *       a publisher with spdmq_ctx::replay_depth or spdmq_ctx::journal resends what a reconnected subscriber has missed,
+     *       spdmq_ctx::replay_from and spdmq_ctx::replay_since ask a publisher met for the first time for older messages
+     *
+     */
+    std::map<std::string, spdmq_topic_stat_t> topic_stats();
+
+    /**
+     * @brief statistics of the checksums of the frames received
+     * 
+     * @return frames and bytes verified, and the frames dropped because their checksum did not match
+     * 
+     * @note a sender with spdmq_ctx::checksum appends a CRC32C to the v2 frames it sends over stream sockets,
+     *       a dropped message gives its credit back and shows as missed in SPDMQ_SUB mode
+     *
+     */
+    spdmq_checksum_stat_t checksum_stats();
+
+    /**
+     * @brief statistics of the threads calling on_recv, see spdmq_ctx::dispatch_threads
+     * 
+     * @return one per thread, the messages waiting for it and those it has called back with,
+     *         one with nothing queued when on_recv is called on the event thread
+     * 
+     * @note messages of one spdmq_ctx::dispatch_key always go to the same thread, a key that keeps one busy shows here
+     *
+     */
+    std::vector<spdmq_dispatch_stat_t> dispatch_stats();
+
+    /**
+     * @brief send a request and complete it asynchronously (SPDMQ_REQ mode)
+     * 
+     * @param msg [input/output]: request msg, session_id and correlation_id are set to those of the sent request
+     * 
+     * @param on_reply [input]: called once with the reply and SPDMQ_CODE_OK, or with SPDMQ_CODE_RECV_TIMEOUT
+     *                          or SPDMQ_CODE_CONNECT_TO_BROKEN, on the event thread, so it must not block
+     * 
+     * @param time_out [input]: equal to 0 never timeout, greater than 0 indicates timeout time (unit millisecond)
+     *
+     * @return SPDMQ_OK - request sent, on_reply will be called; otherwise on_reply is never called
+     * 
+     * @note requests are spread round robin over the connected peers, any number of them may be in flight
+     *       and replies are matched by correlation_id whatever their order. a reply that arrives after
+     *       its timeout is delivered through recv or on_recv like the replies of send.
+     *       in SPDMQ_REP mode, recv returns the request and send answers it, keep its session_id and correlation_id
+     *
+     */
+    spdmq_code_t request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out = 0);
+
+    /**
+     * @brief send a request and wait for its reply (SPDMQ_REQ mode)
+     * 
+     * @param msg [input/output]: request msg
+     * 
+     * @param reply [output]: reply msg
+     * 
+     * @param time_out [input]: equal to 0 never timeout, greater than 0 indicates timeout time (unit millisecond)
+     *
+     * @return SPDMQ_OK - reply received
+     * 
+     * @note other requests may be in flight at the same time, do not call it from on_online or on_offline (event thread)
+     *
+     */
+    spdmq_code_t request(spdmq_msg_t& msg, spdmq_msg_t& reply, time_msec_t time_out = 0);
+
+    /**
+     * @brief receive without blocking a thread, co_await it in a C++20 coroutine (see spdmq_async.h)
+     * 
+     * @return awaitable of std::pair<spdmq_code_t, spdmq_msg_t>, the code and the message as recv returns them
+     * 
+     * @note the coroutine is resumed on the event thread, or by spdmq_ctx::executor, so it must not block there.
+     *       waiting coroutines are handed the messages in the order they started waiting, before recv is
+     *
+     */
+    spdmq_recv_awaiter async_recv();
+
+    spdmq_recv_awaiter async_recv(const std::string& topic);
+
+    /**
+     * @brief send once no outbound queue is at spdmq_ctx::send_hwm, co_await it in a C++20 coroutine
+     * 
+     * @param msg [input]: send msg, it must live until the send completes
+     * 
+     * @return awaitable of the spdmq_code_t of send
+     * 
+     * @note inproc peers are not waited for
+     *
+     */
+    spdmq_send_awaiter async_send(spdmq_msg_t& msg);
+
+    /**
+     * @brief connect and wait until a session comes online, co_await it in a C++20 coroutine
+     * 
+     * @return awaitable of SPDMQ_CODE_OK, or the error of connect
+     *
+     */
+    spdmq_connect_awaiter async_connect(const std::string& url);
+
+    /**
+     * @brief the primitives of the awaitables, for other coroutine libraries or callbacks
+     * 
+     * @param waiter [input/output]: resume and context to call once done, it must live until then
+     * 
+     * @return true - the waiter is parked, waiter.resume will be called with waiter.code (and waiter.msg) set;
+     *         false - done at once, waiter.code (and waiter.msg) are set, waiter.resume is not called
+     * 
+     * @note wait_recv receives a message of waiter.topic, or of any topic if it is empty,
+     *       wait_writable waits until no outbound queue is at spdmq_ctx::send_hwm,
+     *       wait_connect connects to url and waits until that connection comes online,
+     *       waiter.code is SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET if the connect is given up (reconnect_interval 0)
+     *
+     */
+    bool wait_recv(spdmq_waiter_t& waiter);
+
+    bool wait_writable(spdmq_waiter_t& waiter);
+
+    bool wait_connect(spdmq_waiter_t& waiter, const std::string& url);
+
     void spin(bool background = false);
 
+    /**
+     * @brief one bounded step of the event loop on the calling thread, with spdmq_ctx::external_loop instead of spin
+     * 
+     * @param max_events [input]: ready descriptors taken from native_handle at most
+     * @param budget [input]: events handled at most, such as a read and the on_recv calls of the messages it brings,
+     *                        0 - all that are pending
+     * 
+     * @return events handled, native_handle stays readable while more are pending
+     * 
+     * @note reads, writes, connections, heartbeats, reconnections and on_recv all run here, the application calls it
+     *       from one thread, recv must not block it, use a negative time_out, on_recv or async_recv
+     *
+     */
+    int32_t process(uint32_t max_events = 64, uint32_t budget = 0);
+
+    /**
+     * @brief descriptor to add to the event loop of the application, with spdmq_ctx::external_loop
+     * 
+     * @return epoll fd, readable when process has work to do, including timers and messages of other threads
+     *
+     */
+    int32_t native_handle();
+
 public:
     /**
      * @brief receive message callback function object
      * 
+     * @note set the callbacks before the first bind or connect, they are called on the threads of
+     *       spdmq_ctx::dispatch_threads, or on the event thread when it is 0
+     * 
      */
     std::function<void(spdmq_msg_t&)> on_recv;
 
@@ -118,3 +387,5 @@ protected:
 };
 
 } /* namespace speed::mq */
+
+#include "spdmq_async.h"
@@ -0,0 +1,161 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <exception>
+#include "spdmq.h"
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+/**
+ * @brief Awaitables of spdmq::async_recv, async_send and async_connect.
+ *        The library is C++17, they only take a coroutine handle when a C++20 coroutine co_awaits them.
+ *        A suspended coroutine is parked in a spdmq_waiter_t, no thread blocks on it, and it is resumed
+ *        by the event thread, or by spdmq_ctx::executor, once its message, write space or session is there.
+ *
+ */
+
+namespace speed::mq {
+
+template<typename Handle>
+void spdmq_resume(void* context) {
+    Handle::from_address(context).resume();
+}
+
+class spdmq_recv_awaiter {
+private:
+    spdmq& mq_;
+    spdmq_waiter_t waiter_;
+
+public:
+    spdmq_recv_awaiter(spdmq& mq, const std::string& topic) : mq_(mq) {
+        waiter_.topic = topic;
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // false - the message was there, the coroutine goes on without suspending
+    template<typename Handle>
+    bool await_suspend(Handle handle) {
+        waiter_.resume = &spdmq_resume<Handle>;
+        waiter_.context = handle.address();
+        return mq_.wait_recv(waiter_);
+    }
+
+    std::pair<spdmq_code_t, spdmq_msg_t> await_resume() {
+        return {waiter_.code, std::move(waiter_.msg)};
+    }
+};
+
+class spdmq_send_awaiter {
+private:
+    spdmq& mq_;
+    spdmq_msg_t& msg_;
+    spdmq_waiter_t waiter_;
+
+public:
+    spdmq_send_awaiter(spdmq& mq, spdmq_msg_t& msg) : mq_(mq), msg_(msg) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    template<typename Handle>
+    bool await_suspend(Handle handle) {
+        waiter_.resume = &spdmq_resume<Handle>;
+        waiter_.context = handle.address();
+        return mq_.wait_writable(waiter_);
+    }
+
+    spdmq_code_t await_resume() {
+        return waiter_.code == SPDMQ_CODE_OK ? mq_.send(msg_) : waiter_.code;
+    }
+};
+
+class spdmq_connect_awaiter {
+private:
+    spdmq& mq_;
+    std::string url_;
+    spdmq_waiter_t waiter_;
+
+public:
+    spdmq_connect_awaiter(spdmq& mq, const std::string& url) : mq_(mq), url_(url) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    template<typename Handle>
+    bool await_suspend(Handle handle) {
+        waiter_.resume = &spdmq_resume<Handle>;
+        waiter_.context = handle.address();
+        return mq_.wait_connect(waiter_, url_);
+    }
+
+    spdmq_code_t await_resume() {
+        return waiter_.code;
+    }
+};
+
+inline spdmq_recv_awaiter spdmq::async_recv() {
+    return spdmq_recv_awaiter(*this, std::string());
+}
+
+inline spdmq_recv_awaiter spdmq::async_recv(const std::string& topic) {
+    return spdmq_recv_awaiter(*this, topic);
+}
+
+inline spdmq_send_awaiter spdmq::async_send(spdmq_msg_t& msg) {
+    return spdmq_send_awaiter(*this, msg);
+}
+
+inline spdmq_connect_awaiter spdmq::async_connect(const std::string& url) {
+    return spdmq_connect_awaiter(*this, url);
+}
+
+#if defined(__cpp_impl_coroutine)
+// Coroutine that runs at once up to its first suspension and frees itself when it returns
+struct spdmq_task {
+    struct promise_type {
+        spdmq_task get_return_object() noexcept {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+};
+#endif
+
+} /* namespace speed::mq */
@@ -0,0 +1,272 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+namespace speed::mq {
+
+/**
+ * @brief payload encoding of T for spdmq::send<T>, spdmq::recv<T> and spdmq_msg_t::get<T>
+ * 
+ * @note built in are trivially copyable types (their bytes), std::string, std::vector and aggregates of those
+ *       (field by field, without padding). Specialise it for other types:
+ *           static std::size_t size(const T& value);                               // bytes encode writes
+ *           static void encode(const T& value, uint8_t* dst);
+ *           static bool decode(const uint8_t* src, std::size_t size, T& value);    // false - src is not a T
+ *
+ */
+template<typename T, typename Enable = void>
+struct spdmq_codec {
+    static_assert(sizeof(T) == 0, "no spdmq_codec for this type, specialise spdmq_codec<T>");
+};
+
+namespace codec_detail {
+
+constexpr std::size_t MAX_FIELDS = 16;
+
+// Converts to whatever a field is, only named in unevaluated operands
+struct any_field {
+    template<typename U>
+    operator U() const;
+};
+
+template<typename T, typename Indexes, typename = void>
+struct initializable : std::false_type {};
+
+template<typename T, std::size_t... I>
+struct initializable<T, std::index_sequence<I...>, std::void_t<decltype(T{(void(I), any_field{})...})>> : std::true_type {};
+
+// Fields of an aggregate, the most initializers it takes. Fields that are C arrays or base classes are not told apart.
+template<typename T, std::size_t N = 0>
+constexpr std::size_t field_count() {
+    if constexpr (N < MAX_FIELDS && initializable<T, std::make_index_sequence<N + 1>>::value) {
+        return field_count<T, N + 1>();
+    }
+    else {
+        return N;
+    }
+}
+
+template<typename T, typename F>
+void for_each_field(T& value, F&& f) {
+    constexpr auto count = field_count<std::remove_const_t<T>>();
+    static_assert(count > 0 && count < MAX_FIELDS, "spdmq_codec reflects aggregates of 1 to 15 fields");
+    auto visit = [&f](auto&... fields) { (f(fields), ...); };
+    if constexpr (count == 1) { auto& [f0] = value; visit(f0); }
+    else if constexpr (count == 2) { auto& [f0, f1] = value; visit(f0, f1); }
+    else if constexpr (count == 3) { auto& [f0, f1, f2] = value; visit(f0, f1, f2); }
+    else if constexpr (count == 4) { auto& [f0, f1, f2, f3] = value; visit(f0, f1, f2, f3); }
+    else if constexpr (count == 5) { auto& [f0, f1, f2, f3, f4] = value; visit(f0, f1, f2, f3, f4); }
+    else if constexpr (count == 6) { auto& [f0, f1, f2, f3, f4, f5] = value; visit(f0, f1, f2, f3, f4, f5); }
+    else if constexpr (count == 7) { auto& [f0, f1, f2, f3, f4, f5, f6] = value; visit(f0, f1, f2, f3, f4, f5, f6); }
+    else if constexpr (count == 8) { auto& [f0, f1, f2, f3, f4, f5, f6, f7] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7); }
+    else if constexpr (count == 9) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8); }
+    else if constexpr (count == 10) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9); }
+    else if constexpr (count == 11) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10); }
+    else if constexpr (count == 12) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11); }
+    else if constexpr (count == 13) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12); }
+    else if constexpr (count == 14) { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13); }
+    else { auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = value; visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14); }
+}
+
+template<typename T>
+constexpr bool is_reflected_v = std::is_aggregate_v<T> && !std::is_trivially_copyable_v<T>;
+
+// A field inside an aggregate: trivially copyable ones are their bytes, aggregates their fields,
+// the others the uint32_t size of their spdmq_codec encoding followed by it
+template<typename T, typename Enable = void>
+struct field {
+    static std::size_t size(const T& value) {
+        return sizeof(uint32_t) + spdmq_codec<T>::size(value);
+    }
+
+    static void encode(const T& value, uint8_t*& dst) {
+        uint32_t size = spdmq_codec<T>::size(value);
+        std::memcpy(dst, &size, sizeof(size));
+        spdmq_codec<T>::encode(value, dst + sizeof(size));
+        dst += sizeof(size) + size;
+    }
+
+    static bool decode(const uint8_t*& src, const uint8_t* end, T& value) {
+        uint32_t size;
+        if (static_cast<std::size_t>(end - src) < sizeof(size)) {
+            return false;
+        }
+        std::memcpy(&size, src, sizeof(size));
+        if (static_cast<std::size_t>(end - src) - sizeof(size) < size || !spdmq_codec<T>::decode(src + sizeof(size), size, value)) {
+            return false;
+        }
+        src += sizeof(size) + size;
+        return true;
+    }
+};
+
+template<typename T>
+struct field<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static std::size_t size(const T&) {
+        return sizeof(T);
+    }
+
+    static void encode(const T& value, uint8_t*& dst) {
+        std::memcpy(dst, &value, sizeof(T));
+        dst += sizeof(T);
+    }
+
+    static bool decode(const uint8_t*& src, const uint8_t* end, T& value) {
+        if (static_cast<std::size_t>(end - src) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, src, sizeof(T));
+        src += sizeof(T);
+        return true;
+    }
+};
+
+template<typename T>
+struct field<T, std::enable_if_t<is_reflected_v<T>>> {
+    static std::size_t size(const T& value) {
+        std::size_t size = 0;
+        for_each_field(value, [&size](const auto& member) { size += field<std::decay_t<decltype(member)>>::size(member); });
+        return size;
+    }
+
+    static void encode(const T& value, uint8_t*& dst) {
+        for_each_field(value, [&dst](const auto& member) { field<std::decay_t<decltype(member)>>::encode(member, dst); });
+    }
+
+    static bool decode(const uint8_t*& src, const uint8_t* end, T& value) {
+        bool decoded = true;
+        for_each_field(value, [&](auto& member) { decoded = decoded && field<std::decay_t<decltype(member)>>::decode(src, end, member); });
+        return decoded;
+    }
+};
+
+} /* namespace codec_detail */
+
+// Its bytes as they are in memory, spdmq_msg_t::view<T> reads them where they are in msg.payload
+template<typename T>
+struct spdmq_codec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static constexpr std::size_t size(const T&) {
+        return sizeof(T);
+    }
+
+    static void encode(const T& value, uint8_t* dst) {
+        std::memcpy(dst, &value, sizeof(T));
+    }
+
+    static bool decode(const uint8_t* src, std::size_t size, T& value) {
+        if (size != sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, src, sizeof(T));
+        return true;
+    }
+};
+
+template<>
+struct spdmq_codec<std::string> {
+    static std::size_t size(const std::string& value) {
+        return value.size();
+    }
+
+    static void encode(const std::string& value, uint8_t* dst) {
+        std::memcpy(dst, value.data(), value.size());
+    }
+
+    static bool decode(const uint8_t* src, std::size_t size, std::string& value) {
+        value.assign(reinterpret_cast<const char*>(src), size);
+        return true;
+    }
+};
+
+// The elements back to back
+template<typename U, typename A>
+struct spdmq_codec<std::vector<U, A>> {
+    static std::size_t size(const std::vector<U, A>& value) {
+        if constexpr (std::is_trivially_copyable_v<U>) {
+            return value.size() * sizeof(U);
+        }
+        else {
+            std::size_t size = 0;
+            for (auto& element : value) {
+                size += codec_detail::field<U>::size(element);
+            }
+            return size;
+        }
+    }
+
+    static void encode(const std::vector<U, A>& value, uint8_t* dst) {
+        if constexpr (std::is_trivially_copyable_v<U>) {
+            if (!value.empty()) {
+                std::memcpy(dst, value.data(), value.size() * sizeof(U));
+            }
+        }
+        else {
+            for (auto& element : value) {
+                codec_detail::field<U>::encode(element, dst);
+            }
+        }
+    }
+
+    static bool decode(const uint8_t* src, std::size_t size, std::vector<U, A>& value) {
+        if constexpr (std::is_trivially_copyable_v<U>) {
+            if (size % sizeof(U)) {
+                return false;
+            }
+            value.resize(size / sizeof(U));
+            if (size) {
+                std::memcpy(value.data(), src, size);
+            }
+            return true;
+        }
+        else {
+            value.clear();
+            for (auto end = src + size; src < end;) {
+                if (!codec_detail::field<U>::decode(src, end, value.emplace_back())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+};
+
+// Aggregates that are not trivially copyable, such as a struct with a std::string, field by field in declaration order
+template<typename T>
+struct spdmq_codec<T, std::enable_if_t<codec_detail::is_reflected_v<T>>> {
+    static std::size_t size(const T& value) {
+        return codec_detail::field<T>::size(value);
+    }
+
+    static void encode(const T& value, uint8_t* dst) {
+        codec_detail::field<T>::encode(value, dst);
+    }
+
+    static bool decode(const uint8_t* src, std::size_t size, T& value) {
+        return codec_detail::field<T>::decode(src, src + size, value) && size == codec_detail::field<T>::size(value);
+    }
+};
+
+} /* namespace speed::mq */
@@ -23,7 +23,10 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <functional>
+#include "spdmq_codec.h"
 
 namespace speed::mq {
 
@@ -42,8 +45,8 @@ enum class SPDMQ_CODE : int32_t{
     SPDMQ_CODE_NO_DATA =  1,  // 无数据, 客户或者服务未收到数据, 或者发送的数据为空
 #define SPDMQ_CODE_NO_DATA (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_NO_DATA))
 
-//     SPDMQ_CODE_DATA_PARSE_ERROR =  2,  // 接收数据解析失败
-// #define SPDMQ_CODE_DATA_PARSE_ERROR (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_DATA_PARSE_ERROR))
+    SPDMQ_CODE_DATA_PARSE_ERROR =  2,  // 接收数据解析失败
+#define SPDMQ_CODE_DATA_PARSE_ERROR (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_DATA_PARSE_ERROR))
 
 //     SPDMQ_CODE_DATA_SEND_FAILED =  3,  // 数据发送失败
 // #define SPDMQ_CODE_DATA_SEND_FAILED (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_DATA_SEND_FAILED))
@@ -54,8 +57,8 @@ enum class SPDMQ_CODE : int32_t{
 //     SPDMQ_CODE_NOT_BIND_CONNECT =  6,  // 未执行bind或者connect
 // #define SPDMQ_CODE_NOT_BIND_CONNECT (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_NOT_BIND_CONNECT))
 
-//     SPDMQ_CODE_RECV_TIMEOUT =  7,  // 接收数据响应超时
-// #define SPDMQ_CODE_RECV_TIMEOUT (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_RECV_TIMEOUT))
+    SPDMQ_CODE_RECV_TIMEOUT =  7,  // 接收数据响应超时
+#define SPDMQ_CODE_RECV_TIMEOUT (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_RECV_TIMEOUT))
 
 //     SPDMQ_CODE_CB_SET_FAILED =  8,  // 回调函数设置失败, 需要在bind和connect之前设置
 // #define SPDMQ_CODE_CB_SET_FAILED (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_CB_SET_FAILED))
@@ -69,18 +72,27 @@ enum class SPDMQ_CODE : int32_t{
 //     SPDMQ_CODE_FORBID_REPEAT_BIND_OR_CONNECT =  11, // 禁止重复bind或connect
 // #define SPDMQ_CODE_FORBID_REPEAT_BIND_OR_CONNECT (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_FORBID_REPEAT_BIND_OR_CONNECT))
 
-//     SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET =  12, // 发送失败, 未连接到目标
-// #define SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET))
+    SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET =  12, // 发送失败, 未连接到目标
+#define SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET))
 
     SPDMQ_CODE_CONNECT_TO_BROKEN =  13, // 连接中断
 #define SPDMQ_CODE_CONNECT_TO_BROKEN (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_CONNECT_TO_BROKEN))
 
-//     SPDMQ_CODE_NO_REQUEST =  14, // 没有请求数据
-// #define SPDMQ_CODE_NO_REQUEST (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_NO_REQUEST))
+    SPDMQ_CODE_NO_REQUEST =  14, // 没有请求数据
+#define SPDMQ_CODE_NO_REQUEST (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_NO_REQUEST))
 
     SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA =  15, // The received callback has intercepted the data
 #define SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA))
 
+    SPDMQ_CODE_SEND_FAILED_HWM =  16, // The outbound queue of the target is at its high-water mark, the message is dropped
+#define SPDMQ_CODE_SEND_FAILED_HWM (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_SEND_FAILED_HWM))
+
+    SPDMQ_CODE_SEND_FAILED_NO_CREDIT =  17, // A subscriber has no credit left, the message is not sent to it
+#define SPDMQ_CODE_SEND_FAILED_NO_CREDIT (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_SEND_FAILED_NO_CREDIT))
+
+    SPDMQ_CODE_SEND_FAILED_EXPIRED =  18, // The time to live of the message has run out, it is not sent
+#define SPDMQ_CODE_SEND_FAILED_EXPIRED (static_cast<spdmq_code_t>(SPDMQ_CODE::SPDMQ_CODE_SEND_FAILED_EXPIRED))
+
 };
 
 class spdmq;
@@ -93,6 +105,11 @@ typedef enum class COMM_MODE : uint8_t {
     SPDMQ_UNKNOW = 0, // unknow mode
     SPDMQ_PUB = 1,    // publish mode
     SPDMQ_SUB = 2,    // subscribe mode
+    SPDMQ_REQ = 3,    // request mode, many requests in flight per connection
+    SPDMQ_REP = 4,    // reply mode
+    SPDMQ_PUSH = 5,   // pipeline mode, each message goes to exactly one PULL peer
+    SPDMQ_PULL = 6,   // pipeline mode, worker side
+    SPDMQ_PROXY = 7,  // forwarder, connect to publishers and bind for subscribers, data frames are relayed as they are
 } comm_mode_t;
 
 typedef enum class COMM_METHOD : uint8_t {
@@ -106,14 +123,16 @@ typedef enum class COMM_METHOD : uint8_t {
 typedef enum class COMM_DOMAIN : uint8_t {
     UNKNOW = 0,
     IPV4 = 1,
-    IPV6 = 2, // TODO
+    IPV6 = 2,
     IPC = 3,
+    INPROC = 4, // threads of one process, no socket
 } comm_domain_t;
 
 typedef enum class COMM_PROTOCOL_TYPE : uint8_t {
     UNKNOW = 0,
     TCP = 1,
     UDP = 2,  // TODO
+    SEQPACKET = 3, // unix domain only, message boundaries are kept by the kernel
 } comm_protocol_type_t;
 
 typedef enum class EVENT_MODE : uint8_t {
@@ -122,7 +141,118 @@ typedef enum class EVENT_MODE : uint8_t {
     EVENT_POLL_ET = 1, // epoll edge trigger
 } event_mode_t;
 
+typedef enum class SOCKET_PROFILE : uint8_t {
+    DEFAULT = 0,     // system defaults
+    LOW_LATENCY = 1, // TCP_NODELAY and TCP_QUICKACK, small messages are sent at once
+    THROUGHPUT = 2,  // large socket buffers, Nagle kept to coalesce small writes
+    CUSTOM = 3,      // options set by spdmq_ctx::socket_opt
+} socket_profile_t;
+
+typedef enum class PUSH_STRATEGY : uint8_t {
+    ROUND_ROBIN = 0,       // PULL peers take turns
+    LEAST_OUTSTANDING = 1, // the PULL peer with the fewest messages sent but not yet consumed
+    WEIGHTED = 2,          // smooth weighted round robin by the weight announced by each PULL peer
+} push_strategy_t;
+
+typedef enum class DROP_POLICY : uint8_t {
+    DROP_OLDEST = 0, // a full topic queue evicts its oldest message to take the new one
+    DROP_NEWEST = 1, // a full topic queue rejects the new message
+} drop_policy_t;
+
+typedef enum class DISPATCH_KEY : uint8_t {
+    SESSION = 0, // messages of one peer are called back in order, see spdmq_ctx::dispatch_threads
+    TOPIC = 1,   // messages of one topic are called back in order
+} dispatch_key_t;
+
+typedef struct spdmq_topic_queue {
+    uint32_t capacity = 1024;                             // messages of the topic kept before dropping
+    drop_policy_t drop_policy = DROP_POLICY::DROP_OLDEST; // what to drop when the queue of the topic is full
+    uint32_t weight = 1;                                  // messages taken in a row by recv before moving to the next topic
+} spdmq_topic_queue_t;
+
+typedef struct spdmq_credit_window {
+    uint32_t messages = 0; // messages a publisher may send ahead of consumption, 0 - not limited by count
+    uint32_t bytes = 0;    // payload bytes a publisher may send ahead of consumption, 0 - not limited by size
+} spdmq_credit_window_t;
+
+typedef struct spdmq_journal_opt {
+    std::string path;                  // directory of the journal, empty - no journal
+    std::set<std::string> topics;      // topics written to the journal, empty - every topic
+    uint64_t segment_size = 64 << 20;  // bytes preallocated per segment file
+    uint32_t max_segments = 0;         // segments kept per topic, the oldest are deleted beyond it, 0 - keep all
+} spdmq_journal_opt_t;
+
+typedef enum class COMPRESSION : uint8_t {
+    NONE = 0,
+    LZ = 1,   // built-in LZ77 codec, always available
+    LZ4 = 2,  // liblz4, when found at configure time
+    ZSTD = 3, // libzstd, when found at configure time
+} compression_t;
+
+typedef struct spdmq_compression_opt {
+    compression_t codec = COMPRESSION::NONE; // payloads are sent as they are to peers that can not decompress it
+    uint32_t threshold = 512;                // payloads smaller than this many bytes are sent as they are
+    int32_t level = 0;                       // LZ4 acceleration or zstd level, 0 - the default of the codec
+    std::vector<uint8_t> dictionary;         // content typical of the topic, receivers set the same one, it pays off for small payloads
+} spdmq_compression_opt_t;
+
+typedef struct spdmq_codec_stat {
+    uint64_t messages = 0;     // payloads that went through the codec
+    uint64_t raw_bytes = 0;    // their size before compression, raw_bytes / packed_bytes is the ratio
+    uint64_t packed_bytes = 0; // their size on the wire
+    int64_t nsecs = 0;         // time spent in the codec
+    uint64_t errors = 0;       // payloads that could not be decompressed and were dropped
+} spdmq_codec_stat_t;
+
+typedef struct spdmq_latency {
+    uint64_t count = 0; // messages measured
+    int64_t min = 0;    // nanoseconds, the percentiles are bucket bounds within 6.25%
+    int64_t p50 = 0;
+    int64_t p99 = 0;
+    int64_t p999 = 0;
+    int64_t max = 0;
+} spdmq_latency_t;
+
+typedef struct spdmq_topic_stat {
+    uint64_t queued = 0;   // messages waiting to be received
+    uint64_t received = 0; // messages taken into the queue since the start
+    uint64_t dropped = 0;  // messages lost to the drop policy since the start
+    uint64_t missed = 0;   // messages lost before arriving, told by gaps in the sequence of SUB mode
+    uint64_t expired = 0;  // messages whose time to live ran out while queued here, to receive or to send
+    spdmq_latency_t latency; // send to recv of the received messages, measured with spdmq_ctx::latency_histogram
+    spdmq_codec_stat_t compress;   // payloads of the topic compressed once per send, see spdmq_ctx::compression
+    spdmq_codec_stat_t decompress; // payloads of the topic received compressed
+} spdmq_topic_stat_t;
+
+typedef struct spdmq_checksum_stat {
+    uint64_t frames = 0;     // frames received with a checksum, see spdmq_ctx::checksum
+    uint64_t bytes = 0;      // bytes the checksums covered
+    uint64_t mismatches = 0; // frames whose checksum did not match, dropped
+} spdmq_checksum_stat_t;
+
+typedef struct spdmq_dispatch_stat {
+    uint64_t queued = 0;     // messages waiting for the thread to call on_recv with them
+    uint64_t dispatched = 0; // messages it called on_recv with since the start
+} spdmq_dispatch_stat_t;
+
+typedef struct spdmq_socket_opt {
+    bool tcp_nodelay = false;        // disable Nagle algorithm (TCP_NODELAY)
+    bool tcp_quickack = false;       // disable delayed ACK (TCP_QUICKACK), set again after each read
+    bool keepalive = false;          // enable TCP keepalive (SO_KEEPALIVE)
+    uint32_t keepalive_idle = 0;     // idle seconds before the first probe, 0 - system default
+    uint32_t keepalive_interval = 0; // seconds between probes, 0 - system default
+    uint32_t keepalive_count = 0;    // probes before the connection is dropped, 0 - system default
+    uint32_t send_buffer = 0;        // SO_SNDBUF bytes, 0 - system default
+    uint32_t recv_buffer = 0;        // SO_RCVBUF bytes, 0 - system default
+    bool reuseport = false;          // several listeners share one address, the kernel spreads connections (SO_REUSEPORT)
+} spdmq_socket_opt_t;
+
+// Runs resume(context) for a suspended awaiter of spdmq::async_recv, async_send or async_connect, see spdmq_ctx::executor
+using spdmq_executor_t = std::function<void(void (*resume)(void* context), void* context)>;
+
 typedef class spdmq_ctx {
+    friend class spdmq_runtime;
+
 private:
     comm_mode_t _mode;                        // communication mode
     comm_method_t _method;                    // communication method
@@ -132,8 +262,32 @@ private:
     uint32_t _evt_num;                        // the number of single listening events in the server model, default to 100 events
     uint32_t _heartbeat;                      // client mode heartbeat interval, default to 100 milliseconds
     uint32_t _reconnect_interval;             // reconnect interval
-    uint32_t _queue_size;                     // the number of messages in the message queue, default to 1024 messages
+    uint32_t _queue_size;                     // the number of messages kept per topic in the receive queue, default to 1024 messages
+    bool _dual_stack;                         // ipv6 listener also accepts ipv4 connections (IPV6_V6ONLY = 0), default to false
+    socket_profile_t _socket_profile;         // socket tuning profile, default to SOCKET_PROFILE::DEFAULT
+    spdmq_socket_opt_t _socket_opt;           // socket options of the profile
+    uint32_t _send_hwm;                       // messages queued per session before sending to it fails, 0 - unlimited, default to 1000 messages
+    push_strategy_t _push_strategy;           // distribution strategy of PUSH mode, default to PUSH_STRATEGY::ROUND_ROBIN
+    uint32_t _weight;                         // weight of a PULL peer in PUSH_STRATEGY::WEIGHTED, default to 1
     std::set<std::string> _topics;            // topics of PUB/SUB mode
+    std::set<std::string> _conflate_topics;   // topics of SUB mode of which a backed up publisher only keeps the latest message
+    bool _last_value_cache;                   // PUB mode sends the latest message of a topic to each new subscriber, default to false
+    std::map<std::string, spdmq_topic_queue_t> _topic_queues; // receive queue of a topic, other topics take queue_size and DROP_POLICY::DROP_OLDEST
+    spdmq_credit_window_t _credit_window;     // SUB mode flow control, the publisher sends no more than the window ahead of recv, default to off
+    uint32_t _replay_depth;                   // messages kept per topic by PUB mode to resend to a reconnected subscriber, default to 0
+    std::map<std::string, int64_t> _topic_ttls; // time to live in microseconds of the messages sent on a topic without their own, default to none
+    spdmq_journal_opt_t _journal;             // PUB mode appends the messages of the topics to memory-mapped files to replay them from, default to off
+    uint64_t _replay_from;                    // SUB mode asks a publisher met for the first time for the messages from this sequence on, default to 0 - new ones only
+    int64_t _replay_since;                    // SUB mode asks a publisher met for the first time for the messages sent since this UTC time in microseconds, default to 0 - off
+    bool _monotonic_stamp;                    // messages sent also carry a monotonic stamp, inproc peers and peers on the same host measure time_cost with it, default to false
+    bool _latency_histogram;                  // recv keeps a latency histogram per topic, see topic_stats, default to false
+    uint8_t _frame_version;                   // highest frame format offered to stream peers at connect, 1 - the fixed v1 format only, PROXY mode always keeps 1, default to 2
+    std::map<std::string, spdmq_compression_opt_t, std::less<>> _compressions; // payload compression of a topic, "" - of every topic without its own, default to none
+    bool _checksum;                           // v2 frames sent carry a CRC32C, receivers drop the frames that do not match it, default to false
+    spdmq_executor_t _executor;               // resumes the awaiters, default to none - they are resumed on the event thread
+    uint32_t _dispatch_threads;               // threads calling on_recv, 0 - on the event thread as messages arrive, default to 1
+    dispatch_key_t _dispatch_key;             // messages of one key go to the same dispatch thread in order, default to DISPATCH_KEY::SESSION
+    bool _external_loop;                      // no threads of its own, the application calls spdmq::process when spdmq::native_handle is readable, default to false
     std::map<std::string, std::any>  _config; // configure map
 
 public:
@@ -147,7 +301,31 @@ public:
     spdmq_ctx& heartbeat(uint32_t heartbeat);
     spdmq_ctx& reconnect_interval(uint32_t reconnect_interval);
     spdmq_ctx& queue_size(uint32_t queue_size);
+    spdmq_ctx& dual_stack(bool dual_stack);
+    spdmq_ctx& socket_profile(socket_profile_t socket_profile);
+    spdmq_ctx& socket_opt(const spdmq_socket_opt_t& socket_opt);
+    spdmq_ctx& send_hwm(uint32_t send_hwm);
+    spdmq_ctx& push_strategy(push_strategy_t push_strategy);
+    spdmq_ctx& weight(uint32_t weight);
     spdmq_ctx& topics(std::set<std::string> topics);
+    spdmq_ctx& conflate_topics(std::set<std::string> conflate_topics);
+    spdmq_ctx& last_value_cache(bool last_value_cache);
+    spdmq_ctx& topic_queue(const std::string& topic, const spdmq_topic_queue_t& topic_queue);
+    spdmq_ctx& credit_window(const spdmq_credit_window_t& credit_window);
+    spdmq_ctx& replay_depth(uint32_t replay_depth);
+    spdmq_ctx& topic_ttl(const std::string& topic, int64_t ttl);
+    spdmq_ctx& journal(const spdmq_journal_opt_t& journal);
+    spdmq_ctx& replay_from(uint64_t replay_from);
+    spdmq_ctx& replay_since(int64_t replay_since);
+    spdmq_ctx& monotonic_stamp(bool monotonic_stamp);
+    spdmq_ctx& latency_histogram(bool latency_histogram);
+    spdmq_ctx& frame_version(uint8_t frame_version);
+    spdmq_ctx& compression(const std::string& topic, const spdmq_compression_opt_t& compression);
+    spdmq_ctx& checksum(bool checksum);
+    spdmq_ctx& executor(spdmq_executor_t executor);
+    spdmq_ctx& dispatch_threads(uint32_t dispatch_threads);
+    spdmq_ctx& dispatch_key(dispatch_key_t dispatch_key);
+    spdmq_ctx& external_loop(bool external_loop);
     template<typename T>
     spdmq_ctx& config(const std::string& param, const T& val) {
         _config[param] = val;
@@ -164,7 +342,31 @@ public:
     uint32_t heartbeat();
     uint32_t reconnect_interval();
     uint32_t queue_size();
-    std::set<std::string> topics();
+    bool dual_stack();
+    socket_profile_t socket_profile();
+    const spdmq_socket_opt_t& socket_opt();
+    uint32_t send_hwm();
+    push_strategy_t push_strategy();
+    uint32_t weight();
+    const std::set<std::string>& topics();
+    const std::set<std::string>& conflate_topics();
+    bool last_value_cache();
+    spdmq_topic_queue_t topic_queue(const std::string& topic);
+    const spdmq_credit_window_t& credit_window();
+    uint32_t replay_depth();
+    int64_t topic_ttl(const std::string& topic);
+    const spdmq_journal_opt_t& journal();
+    uint64_t replay_from();
+    int64_t replay_since();
+    bool monotonic_stamp();
+    bool latency_histogram();
+    uint8_t frame_version();
+    const spdmq_compression_opt_t& compression(std::string_view topic);
+    bool checksum();
+    const spdmq_executor_t& executor();
+    uint32_t dispatch_threads();
+    dispatch_key_t dispatch_key();
+    bool external_loop();
     template<typename T>
     T config(const std::string& param) {
         return std::any_cast<T>(_config[param]);
@@ -185,7 +387,30 @@ public:
         _heartbeat = 1000;
         _reconnect_interval = 500;
         _queue_size = 1024;
+        _dual_stack = false;
+        _socket_profile = SOCKET_PROFILE::DEFAULT;
+        _send_hwm = 1000;
+        _push_strategy = PUSH_STRATEGY::ROUND_ROBIN;
+        _weight = 1;
         _topics.clear();
+        _conflate_topics.clear();
+        _last_value_cache = false;
+        _topic_queues.clear();
+        _credit_window = {};
+        _replay_depth = 0;
+        _topic_ttls.clear();
+        _journal = {};
+        _replay_from = 0;
+        _replay_since = 0;
+        _monotonic_stamp = false;
+        _latency_histogram = false;
+        _frame_version = 2;
+        _compressions.clear();
+        _checksum = false;
+        _executor = nullptr;
+        _dispatch_threads = 1;
+        _dispatch_key = DISPATCH_KEY::SESSION;
+        _external_loop = false;
     }
 
 } spdmq_ctx_t;
@@ -195,6 +420,13 @@ enum class DBUS_MESSAGE_TYPE : uint8_t {
     DBUS_TOPIC = 2,     // topic message
 };
 
+// payload written straight into the frame by spdmq::send, see spdmq_codec
+typedef struct spdmq_payload {
+    std::size_t size = 0;                                      // bytes write produces
+    void (*write)(const void* value, uint8_t* dst) = nullptr;  // writes value to dst
+    const void* value = nullptr;
+} spdmq_payload_t;
+
 typedef struct spdmq_msg {
     spdmq_msg() {}
 
@@ -217,6 +449,10 @@ typedef struct spdmq_msg {
     std::string topic = {};            // topic of DBUS_PUB/DBUS_SUB  mode
     std::vector<uint8_t> payload = {}; // communication payload
     int64_t time_cost = {};            // message sending and receiving time, unit microseconds
+    int64_t time_cost_ns = {};         // the same in nanoseconds, on the monotonic clock when the sender set spdmq_ctx::monotonic_stamp and runs on this host
+    uint64_t correlation_id = {};      // request id of REQ/REP mode, a reply carries the id of its request
+    uint64_t sequence = {};            // per topic number given by the publisher, consecutive unless messages were lost
+    int64_t ttl = {};                  // time to live from sending, unit microseconds, 0 - never expires
 
     std::string to_string() {
         std::stringstream ss;
@@ -225,9 +461,38 @@ typedef struct spdmq_msg {
            << "\npayload_size: " << payload.size()
            << "\npayload: " << payload.data()
            << "\ntime_cost: " << time_cost
+           << "\ncorrelation_id: " << correlation_id
            << std::endl;
         return ss.str();
     }
+
+    // the payload of this message read as a T without decoding it into another one, nullptr unless T is trivially
+    // copyable, the payload holds exactly one T and is aligned for it. It points into msg.payload, which the
+    // library has already copied out of the receive buffer, and lives as long as the message.
+    template<typename T>
+    const T* view() const {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (payload.size() == sizeof(T) && reinterpret_cast<std::uintptr_t>(payload.data()) % alignof(T) == 0) {
+                return reinterpret_cast<const T*>(payload.data());
+            }
+        }
+        return nullptr;
+    }
+
+    // decodes the payload with spdmq_codec<T>, false if it is not a T
+    template<typename T>
+    bool get(T& value) const {
+        return spdmq_codec<T>::decode(payload.data(), payload.size(), value);
+    }
 } spdmq_msg_t;
 
+// Suspended caller of spdmq::wait_recv, wait_writable or wait_connect, resume(context) is called once it is done
+typedef struct spdmq_waiter {
+    void (*resume)(void* context) = nullptr;
+    void* context = nullptr;
+    spdmq_code_t code = SPDMQ_CODE_OK; // result, set before resume
+    spdmq_msg_t msg = {};              // message received by wait_recv
+    std::string topic = {};            // wait_recv takes a message of this topic only, "" - of any topic
+} spdmq_waiter_t;
+
 } /* namespace opendbus */
\ No newline at end of file
@@ -0,0 +1,212 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <ctime>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace speed::mq {
+
+// Process wide clock. Reads the TSC when it is invariant and the kernel keeps time with it, otherwise CLOCK_MONOTONIC_RAW.
+// Monotonic time is in nanoseconds of CLOCK_MONOTONIC_RAW: the TSC is steered back to it once a second, never stepped back,
+// so stamps of processes on one host compare to within the error of one calibration over a second. Hosts do not compare.
+// Wall time is derived from it and resynchronised with CLOCK_REALTIME once a second, it follows NTP without a syscall per read
+class spdmq_clock {
+private:
+    static constexpr uint32_t SHIFT = 32;
+    static constexpr int64_t SYNC_INTERVAL = 1000000000; // nanoseconds between two resynchronisations
+
+    bool tsc_ = false;
+    uint64_t calibration_ticks_ = 0;          // first sample, the rate is measured from it over an ever longer span
+    int64_t calibration_nsecs_ = 0;
+    std::atomic<uint32_t> anchor_seq_ = {0};  // odd while the anchor below changes
+    std::atomic<uint64_t> tsc_base_ = {0};
+    std::atomic<int64_t> mono_base_ = {0};
+    std::atomic<uint64_t> mult_ = {0};        // nanoseconds per tick << SHIFT
+    std::atomic<int64_t> wall_offset_ = {0};  // CLOCK_REALTIME - monotonic, nanoseconds
+    std::atomic<int64_t> next_sync_ = {0};    // monotonic time of the next resynchronisation
+    std::atomic_flag sync_lock_ = ATOMIC_FLAG_INIT;
+
+public:
+    static spdmq_clock& instance() {
+        static spdmq_clock clock;
+        return clock;
+    }
+
+    bool tsc() const {
+        return tsc_;
+    }
+
+    int64_t mono_nsecs() {
+        auto mono = read_mono();
+        if (mono >= next_sync_.load(std::memory_order_relaxed)) {
+            sync(mono);
+        }
+        return mono;
+    }
+
+    // Wall time of a monotonic time read before, in nanoseconds since the epoch
+    int64_t wall_nsecs(int64_t mono) {
+        if (mono >= next_sync_.load(std::memory_order_relaxed)) {
+            sync(mono);
+        }
+        return mono + wall_offset_.load(std::memory_order_relaxed);
+    }
+
+    int64_t wall_usecs() {
+        return wall_nsecs(mono_nsecs()) / 1000;
+    }
+
+private:
+    spdmq_clock() {
+        tsc_ = invariant_tsc();
+#if defined(__x86_64__) || defined(__i386__)
+        if (tsc_) {
+            // Ticks against CLOCK_MONOTONIC_RAW over 10 milliseconds, the clock starts from the second sample
+            uint64_t ticks = 0;
+            int64_t nsecs = 0;
+            sample(calibration_ticks_, calibration_nsecs_);
+            do {
+                sample(ticks, nsecs);
+            } while (nsecs - calibration_nsecs_ < 10000000);
+            mult_.store((static_cast<unsigned __int128>(nsecs - calibration_nsecs_) << SHIFT) / (ticks - calibration_ticks_));
+            tsc_base_.store(ticks);
+            mono_base_.store(nsecs);
+        }
+#endif
+        auto mono = read_mono();
+        wall_offset_.store(read(CLOCK_REALTIME) - mono);
+        next_sync_.store(mono + SYNC_INTERVAL);
+    }
+
+    int64_t read_mono() const {
+#if defined(__x86_64__) || defined(__i386__)
+        if (tsc_) {
+            return tsc_nsecs(__rdtsc());
+        }
+#endif
+        return read(CLOCK_MONOTONIC_RAW);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Monotonic time of a tick, the anchor is read again when it changed meanwhile
+    int64_t tsc_nsecs(uint64_t tick) const {
+        uint32_t seq;
+        uint64_t tsc_base, mult;
+        int64_t mono_base;
+        do {
+            seq = anchor_seq_.load(std::memory_order_acquire);
+            tsc_base = tsc_base_.load(std::memory_order_relaxed);
+            mono_base = mono_base_.load(std::memory_order_relaxed);
+            mult = mult_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != anchor_seq_.load(std::memory_order_relaxed));
+
+        // A tick read on another core just before the anchor was taken comes out a little earlier, not 2^64 ticks later
+        auto ticks = static_cast<int64_t>(tick - tsc_base);
+        return mono_base + static_cast<int64_t>((static_cast<__int128>(ticks) * mult) >> SHIFT);
+    }
+
+    // A tick and CLOCK_MONOTONIC_RAW read together, each read bracketed by two ticks,
+    // the narrowest of a few brackets is kept, which also leaves out the first slow read
+    static void sample(uint64_t& ticks, int64_t& nsecs) {
+        uint64_t best = UINT64_MAX;
+        for (int32_t i = 0; i < 8; ++i) {
+            auto before = __rdtsc();
+            auto read_nsecs = read(CLOCK_MONOTONIC_RAW);
+            auto width = __rdtsc() - before;
+            if (width < best) {
+                best = width;
+                ticks = before + width / 2;
+                nsecs = read_nsecs;
+            }
+        }
+    }
+
+    // The rate is measured again over the whole span since the calibration, and set so that the clock,
+    // going on from where it is, meets CLOCK_MONOTONIC_RAW one interval later. It is kept within half and
+    // one and a half of that rate, the clock never goes back and a large error is made up over several intervals
+    void steer() {
+        uint64_t ticks = 0;
+        int64_t nsecs = 0;
+        sample(ticks, nsecs);
+        auto mono = tsc_nsecs(ticks);
+        auto rate = (static_cast<unsigned __int128>(nsecs - calibration_nsecs_) << SHIFT) / (ticks - calibration_ticks_);
+        auto interval_ticks = (static_cast<unsigned __int128>(SYNC_INTERVAL) << SHIFT) / rate;
+        auto target = nsecs + SYNC_INTERVAL - mono;
+        auto mult = target <= 0 ? rate / 2 : (static_cast<unsigned __int128>(target) << SHIFT) / interval_ticks;
+        mult = std::min(std::max(mult, rate / 2), rate * 3 / 2);
+
+        anchor_seq_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        tsc_base_.store(ticks, std::memory_order_relaxed);
+        mono_base_.store(mono, std::memory_order_relaxed);
+        mult_.store(static_cast<uint64_t>(mult), std::memory_order_relaxed);
+        anchor_seq_.fetch_add(1, std::memory_order_release);
+    }
+#endif
+
+    // Called by whichever thread comes first past next_sync_, the others go on with the time they have
+    void sync(int64_t mono) {
+        if (sync_lock_.test_and_set(std::memory_order_acquire)) {
+            return;
+        }
+        if (mono >= next_sync_.load(std::memory_order_relaxed)) {
+#if defined(__x86_64__) || defined(__i386__)
+            if (tsc_) {
+                steer();
+            }
+#endif
+            auto now = read_mono();
+            wall_offset_.store(read(CLOCK_REALTIME) - now, std::memory_order_relaxed);
+            next_sync_.store(now + SYNC_INTERVAL, std::memory_order_relaxed);
+        }
+        sync_lock_.clear(std::memory_order_release);
+    }
+
+    static int64_t read(clockid_t clock_id) {
+        timespec ts;
+        clock_gettime(clock_id, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static bool invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        // CPUID.80000007H:EDX[8], the rate does not change with power states
+        uint32_t eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+            return false;
+        }
+        // The kernel has checked that it is in sync across cores
+        std::ifstream file("/sys/devices/system/clocksource/clocksource0/current_clocksource");
+        std::string clocksource;
+        return file >> clocksource && clocksource == "tsc";
+#else
+        return false;
+#endif
+    }
+};
+
+} /* namespace speed::mq */
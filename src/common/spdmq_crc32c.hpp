@@ -0,0 +1,246 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#endif
+
+namespace speed::mq {
+
+typedef enum class CRC32C_KERNEL : uint8_t {
+    PORTABLE = 0,     // slicing by 8 tables
+    SSE42 = 1,        // crc32 instruction, one stream
+    SSE42_PCLMUL = 2, // crc32 instruction over three streams at once, joined with carry-less multiplication
+    ARMV8 = 3,        // crc32c instructions of ARMv8
+} crc32c_kernel_t;
+
+// CRC-32C (Castagnoli) of the checksum of v2 frames. The kernel is picked once per process from what the CPU runs.
+class spdmq_crc32c {
+private:
+    static constexpr uint32_t POLY = 0x82f63b78;   // reflected
+    static constexpr std::size_t LONG_LANE = 2048;  // bytes per stream of the three stream kernel
+    static constexpr std::size_t SHORT_LANE = 128;
+
+    uint32_t table_[8][256];
+    uint32_t long_shifts_[2];  // x^(8n - 33) mod P for n of one and two long lanes, see join
+    uint32_t short_shifts_[2];
+    std::vector<crc32c_kernel_t> kernels_;
+
+public:
+    static spdmq_crc32c& instance() {
+        static spdmq_crc32c crc32c;
+        return crc32c;
+    }
+
+    // crc - of the bytes before data to carry on from, 0 to start
+    uint32_t value(const void* data, std::size_t size, uint32_t crc = 0) const {
+        return value(kernels_.back(), data, size, crc);
+    }
+
+    uint32_t value(crc32c_kernel_t kernel, const void* data, std::size_t size, uint32_t crc = 0) const {
+        auto bytes = static_cast<const uint8_t*>(data);
+        switch (kernel) {
+#if defined(__x86_64__)
+        case CRC32C_KERNEL::SSE42_PCLMUL:
+            return ~sse42_pclmul(~crc, bytes, size);
+        case CRC32C_KERNEL::SSE42:
+            return ~sse42(~crc, bytes, size);
+#elif defined(__aarch64__)
+        case CRC32C_KERNEL::ARMV8:
+            return ~armv8(~crc, bytes, size);
+#endif
+        default:
+            return ~portable(~crc, bytes, size);
+        }
+    }
+
+    // Every kernel this CPU runs, the one in use last
+    const std::vector<crc32c_kernel_t>& kernels() const {
+        return kernels_;
+    }
+
+    static const char* name(crc32c_kernel_t kernel) {
+        switch (kernel) {
+        case CRC32C_KERNEL::SSE42:
+            return "sse4.2";
+        case CRC32C_KERNEL::SSE42_PCLMUL:
+            return "sse4.2+pclmul";
+        case CRC32C_KERNEL::ARMV8:
+            return "armv8";
+        default:
+            return "portable";
+        }
+    }
+
+private:
+    spdmq_crc32c() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int32_t bit = 0; bit < 8; ++bit) {
+                crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+            }
+            table_[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int32_t k = 1; k < 8; ++k) {
+                table_[k][i] = (table_[k - 1][i] >> 8) ^ table_[0][table_[k - 1][i] & 0xff];
+            }
+        }
+        long_shifts_[0] = x_pow(8 * LONG_LANE - 33);
+        long_shifts_[1] = x_pow(16 * LONG_LANE - 33);
+        short_shifts_[0] = x_pow(8 * SHORT_LANE - 33);
+        short_shifts_[1] = x_pow(16 * SHORT_LANE - 33);
+
+        kernels_.push_back(CRC32C_KERNEL::PORTABLE);
+#if defined(__x86_64__)
+        // CPUID.01H:ECX[20] SSE4.2, ECX[1] PCLMULQDQ
+        uint32_t eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 20))) {
+            kernels_.push_back(CRC32C_KERNEL::SSE42);
+            if (ecx & (1u << 1)) {
+                kernels_.push_back(CRC32C_KERNEL::SSE42_PCLMUL);
+            }
+        }
+#elif defined(__aarch64__) && defined(HWCAP_CRC32)
+        if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+            kernels_.push_back(CRC32C_KERNEL::ARMV8);
+        }
+#endif
+    }
+
+    // a * b mod P, bit 31 stands for x^0 in the reflected order
+    static uint32_t mult_mod_p(uint32_t a, uint32_t b) {
+        uint32_t product = 0;
+        for (uint32_t m = 1u << 31; m; m >>= 1) {
+            if (a & m) {
+                product ^= b;
+            }
+            b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+        }
+        return product;
+    }
+
+    // x^n mod P
+    static uint32_t x_pow(uint64_t n) {
+        uint32_t power = 1u << 31;
+        for (uint32_t square = 1u << 30; n; n >>= 1) {
+            if (n & 1) {
+                power = mult_mod_p(square, power);
+            }
+            square = mult_mod_p(square, square);
+        }
+        return power;
+    }
+
+    uint32_t portable(uint32_t crc, const uint8_t* data, std::size_t size) const {
+        for (; size && (reinterpret_cast<uintptr_t>(data) & 7); --size) {
+            crc = (crc >> 8) ^ table_[0][(crc ^ *data++) & 0xff];
+        }
+        for (; size >= 8; size -= 8, data += 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            word ^= crc;
+            crc = table_[7][word & 0xff] ^ table_[6][(word >> 8) & 0xff] ^ table_[5][(word >> 16) & 0xff] ^
+                  table_[4][(word >> 24) & 0xff] ^ table_[3][(word >> 32) & 0xff] ^ table_[2][(word >> 40) & 0xff] ^
+                  table_[1][(word >> 48) & 0xff] ^ table_[0][word >> 56];
+        }
+        for (; size; --size) {
+            crc = (crc >> 8) ^ table_[0][(crc ^ *data++) & 0xff];
+        }
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2"))) static uint32_t sse42(uint32_t crc, const uint8_t* data, std::size_t size) {
+        for (; size && (reinterpret_cast<uintptr_t>(data) & 7); --size) {
+            crc = _mm_crc32_u8(crc, *data++);
+        }
+        uint64_t crc64 = crc;
+        for (; size >= 8; size -= 8, data += 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; size; --size) {
+            crc = _mm_crc32_u8(crc, *data++);
+        }
+        return crc;
+    }
+
+    __attribute__((target("sse4.2,pclmul"))) uint32_t sse42_pclmul(uint32_t crc, const uint8_t* data, std::size_t size) const {
+        if (size < 3 * SHORT_LANE + 8) {
+            return sse42(crc, data, size);
+        }
+        for (; size && (reinterpret_cast<uintptr_t>(data) & 7); --size) {
+            crc = _mm_crc32_u8(crc, *data++);
+        }
+        streams(crc, data, size, LONG_LANE, long_shifts_);
+        streams(crc, data, size, SHORT_LANE, short_shifts_);
+        return sse42(crc, data, size);
+    }
+
+    // crc32 takes three cycles and issues one per cycle, three independent streams of lane bytes keep it busy.
+    // The stream before another of n bytes is carried over it by a carry-less multiplication by x^(8n - 33),
+    // the crc32 of the 64 bit product then makes up the x^33 and reduces it.
+    __attribute__((target("sse4.2,pclmul"))) static void streams(uint32_t& crc, const uint8_t*& data, std::size_t& size, std::size_t lane,
+                                                                 const uint32_t* shifts) {
+        for (; size >= 3 * lane; size -= 3 * lane, data += 3 * lane) {
+            uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+            for (std::size_t i = 0; i < lane; i += 8) {
+                uint64_t word0, word1, word2;
+                std::memcpy(&word0, data + i, sizeof(word0));
+                std::memcpy(&word1, data + lane + i, sizeof(word1));
+                std::memcpy(&word2, data + 2 * lane + i, sizeof(word2));
+                crc0 = _mm_crc32_u64(crc0, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+            }
+            auto product = _mm_xor_si128(_mm_clmulepi64_si128(_mm_cvtsi64_si128(crc0), _mm_cvtsi32_si128(shifts[1]), 0),
+                                         _mm_clmulepi64_si128(_mm_cvtsi64_si128(crc1), _mm_cvtsi32_si128(shifts[0]), 0));
+            crc = static_cast<uint32_t>(_mm_crc32_u64(0, _mm_cvtsi128_si64(product)) ^ crc2);
+        }
+    }
+#elif defined(__aarch64__)
+    __attribute__((target("+crc"))) static uint32_t armv8(uint32_t crc, const uint8_t* data, std::size_t size) {
+        for (; size && (reinterpret_cast<uintptr_t>(data) & 7); --size) {
+            crc = __crc32cb(crc, *data++);
+        }
+        for (; size >= 8; size -= 8, data += 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            crc = __crc32cd(crc, word);
+        }
+        for (; size; --size) {
+            crc = __crc32cb(crc, *data++);
+        }
+        return crc;
+    }
+#endif
+};
+
+} /* namespace speed::mq */
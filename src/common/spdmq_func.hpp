@@ -16,29 +16,68 @@
 
 #pragma once
 
-#include <regex>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <cstdint>
+#include "spdmq_clock.hpp"
 
 namespace speed::mq {
 
-inline bool regex_match(const std::string& url, const std::string& re) {
-    std::regex regex(re);
-    if (std::regex_match(url, regex)) {
-        return true;
+// parse decimal digits in [0, max_value], leading zeros allowed
+inline bool parse_decimal(const std::string& str, uint32_t max_value, uint32_t& value) {
+    if (str.empty() || str.size() > 10) {
+        return false;
     }
-    return false;
+    uint64_t result = 0;
+    for (auto ch : str) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        result = result * 10 + (ch - '0');
+    }
+    if (result > max_value) {
+        return false;
+    }
+    value = static_cast<uint32_t>(result);
+    return true;
 }
 
-inline int64_t now_usecs_timestamp() {
-    // Get the current time point
-    auto now = std::chrono::system_clock::now();
+// dotted decimal ipv4 address, such as 127.0.0.1
+inline bool is_ipv4_address(const std::string& ip) {
+    std::size_t begin = 0, dots = 0;
+    while (true) {
+        auto end = ip.find('.', begin);
+        uint32_t octet = 0;
+        if (!parse_decimal(ip.substr(begin, end == std::string::npos ? std::string::npos : end - begin), 255, octet)) {
+            return false;
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        ++dots;
+        begin = end + 1;
+    }
+    return dots == 3;
+}
 
-    // Convert to microseconds since epoch (January 1, 1970)
-    auto duration = now.time_since_epoch();
-    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+// name of ipc address under /tmp/, the character set is [a-zA-Z0-9@._]
+inline bool is_ipc_name(const std::string& name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (auto ch : name) {
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+              ch == '@' || ch == '.' || ch == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    return microseconds;
+inline int64_t now_usecs_timestamp() {
+    // Microseconds since epoch (January 1, 1970), derived from the monotonic clock, see spdmq_clock
+    return spdmq_clock::instance().wall_usecs();
 }
 
 inline void sleep_s(uint64_t s) {
@@ -0,0 +1,95 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include "spdmq_def.h"
+
+namespace speed::mq {
+
+// Log-linear histogram of latencies in nanoseconds, 16 buckets per power of two (within 6.25%),
+// values from 0 to about 18 minutes
+class spdmq_histogram {
+private:
+    static constexpr uint32_t SUB_BITS = 4;
+    static constexpr uint32_t SUB_COUNT = 1 << SUB_BITS;
+    static constexpr uint32_t MAX_BITS = 40;
+
+    std::array<uint64_t, (MAX_BITS - SUB_BITS + 1) * SUB_COUNT> buckets_ = {};
+    uint64_t count_ = 0;
+    int64_t min_ = 0;
+    int64_t max_ = 0;
+
+public:
+    void record(int64_t nsecs) {
+        nsecs = std::max<int64_t>(nsecs, 0);
+        ++buckets_[index(nsecs)];
+        min_ = count_ ? std::min(min_, nsecs) : nsecs;
+        max_ = std::max(max_, nsecs);
+        ++count_;
+    }
+
+    spdmq_latency_t summary() const {
+        spdmq_latency_t latency;
+        latency.count = count_;
+        latency.min = min_;
+        latency.max = max_;
+        latency.p50 = percentile(0.5);
+        latency.p99 = percentile(0.99);
+        latency.p999 = percentile(0.999);
+        return latency;
+    }
+
+private:
+    static uint32_t index(int64_t value) {
+        auto v = static_cast<uint64_t>(std::min<int64_t>(value, (int64_t(1) << MAX_BITS) - 1));
+        if (v < SUB_COUNT) {
+            return v;
+        }
+        uint32_t exponent = 63 - __builtin_clzll(v);
+        return (exponent - SUB_BITS + 1) * SUB_COUNT + ((v >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    // Upper bound of the bucket, a percentile is never reported below the true one
+    static int64_t upper(uint32_t index) {
+        if (index < SUB_COUNT) {
+            return index;
+        }
+        uint32_t exponent = index / SUB_COUNT + SUB_BITS - 1;
+        uint64_t sub = index % SUB_COUNT;
+        return static_cast<int64_t>(((SUB_COUNT + sub + 1) << (exponent - SUB_BITS)) - 1);
+    }
+
+    int64_t percentile(double quantile) const {
+        if (!count_) {
+            return 0;
+        }
+        auto rank = std::max<uint64_t>(static_cast<uint64_t>(quantile * count_ + 0.5), 1);
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i];
+            if (seen >= rank) {
+                return std::min(upper(i), max_);
+            }
+        }
+        return max_;
+    }
+};
+
+} /* namespace speed::mq */
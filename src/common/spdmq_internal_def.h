@@ -17,11 +17,15 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <cstring>
+#include <algorithm>
 #include <stdexcept>
 #include <vector>
 #include "spdmq_func.hpp"
+#include "spdmq_crc32c.hpp"
 #include "spdmq_def.h"
 
 #define SPDMQ_UNUSED(x) (void)(x)
@@ -32,25 +36,150 @@ using fd_t = int32_t;
 
 using msg_t = std::string;
 
+typedef enum class SOCKET_MODE : uint8_t {
+    TCP = 0,
+    UDP = 1,
+    UDS = 2,
+    INPROC = 3, // no socket, messages are moved between threads of one process
+} socket_mode_t;
+
+// Sessions of inproc:// have negative ids, the ids of socket sessions are fds
+inline bool is_inproc_session(int32_t session_id) {
+    return session_id < -1;
+}
+
 typedef struct SPDMQ_URL_PARSE {
     bool parse_result;
     std::string ip;
     uint16_t port;
     std::string address;
+    std::string scope;                  // interface of ipv6 link-local address
+    bool abstract;                      // ipc address in the linux abstract namespace
+    comm_domain_t domain;               // communication domain of this endpoint
+    comm_protocol_type_t protocol_type; // communication protocol type of this endpoint
+    socket_mode_t socket_mode;          // socket implementation of this endpoint
 } spdmq_url_parse_t;
 
-typedef enum class SOCKET_MODE : uint8_t {
-    TCP = 0,
-    UDP = 1,
-    UDS = 2,
-} socket_mode_t;
-
 typedef enum class MESSAGE_TYPE : uint8_t {
     DATA = 1,      // data message
     TOPIC = 2,     // topic message
     HEARTBEAT = 3, // heartbeat message
+    REQUEST = 4,   // request message of REQ/REP mode
+    REPLY = 5,     // reply message of REQ/REP mode
+    READY = 6,     // PULL peer is ready, payload is its uint32_t weight
+    CREDIT = 7,    // consumer has taken messages off its queue, payload is the uint32_t count,
+                   // in PUB/SUB mode followed by the uint32_t payload bytes, the first one grants the window
 } message_type_t;
 
+// Optional fields appended after send_time_stamp, a frame without them simply ends there,
+// so older readers that stop at send_time_stamp keep working
+typedef enum class FRAME_EXTENSION : uint8_t {
+    CORRELATION_ID = 1 << 0, // uint64_t correlation_id follows
+    SEQUENCE = 1 << 1,       // uint64_t sequence follows, after correlation_id when both are present
+    TTL = 1 << 2,            // int64_t ttl follows, after the fields above
+    MONO_STAMP = 1 << 3,     // int64_t mono_time_stamp follows, after the fields above
+} frame_extension_t;
+
+// Frame formats of a stream session, every session starts with v1 and moves to v2 once both sides have said HELLO
+constexpr uint8_t FRAME_VERSION_1 = 1;
+constexpr uint8_t FRAME_VERSION_2 = 2;
+
+// Flags of a v2 frame, a varint following the varint length of the frame. The fields follow in this order:
+// msg_type byte, topic, then the varints of TIMESTAMP, SEQUENCE, CORRELATION_ID, TTL, MONO_STAMP and COMPRESSED that are present,
+// the payload takes the rest of the frame but the CHECKSUM trailer. There is no session id, the receiver knows the session.
+typedef enum class FRAME_FLAG : uint32_t {
+    TIMESTAMP = 1 << 0,      // zigzag varint of send_time_stamp less the epoch of the sender, see frame_control_t
+    SEQUENCE = 1 << 1,       // varint sequence
+    TOPIC_ID = 1 << 2,       // the topic is a varint id, without it a varint length and the name
+    TOPIC_NAME = 1 << 3,     // with TOPIC_ID, a varint length and the name follow the id, the id stands for it on this session from then on
+    CHECKSUM = 1 << 4,       // uint32_t CRC32C of the body before it ends the frame
+    COMPRESSED = 1 << 5,     // varints of the compression_t, the raw size and the dictionary_id, the payload is compressed
+    CORRELATION_ID = 1 << 6, // varint correlation_id
+    TTL = 1 << 7,            // varint ttl
+    MONO_STAMP = 1 << 8,     // varint mono_time_stamp
+} frame_flag_t;
+
+constexpr uint32_t FRAME_FLAGS_KNOWN = 0x1ff; // a peer rejects frames with flags it does not know
+
+// Payload of a HEARTBEAT that negotiates the frame format, a v1 peer takes it for a plain heartbeat.
+// The connecting side says HELLO, the accepting side answers with its own, after that each side sends SWITCH
+// and writes v2 from the next frame on. The receiver reads v2 after the SWITCH of the peer.
+typedef enum class FRAME_CONTROL : uint8_t {
+    HELLO = 1,  // version and epoch of the sender follow
+    SWITCH = 2, // the frames after this one are in the version of the HELLO
+} frame_control_type_t;
+
+constexpr uint16_t FRAME_CONTROL_MAGIC = 0x5153; // "SQ"
+constexpr uint32_t FRAME_FEATURE_CHECKSUM = 1u << 31; // the sender verifies FRAME_FLAG::CHECKSUM
+
+typedef struct frame_control {
+    frame_control_type_t type = {};
+    uint8_t version = {};
+    uint32_t features = {}; // bit 1 << compression_t of every codec the sender can decompress, and FRAME_FEATURE_CHECKSUM
+    int64_t epoch = {};     // UTC time in microseconds the TIMESTAMP of the sender counts from
+} frame_control_t;
+
+inline std::vector<uint8_t> frame_control_payload(const frame_control_t& control) {
+    std::vector<uint8_t> payload(sizeof(FRAME_CONTROL_MAGIC) + sizeof(control.type) + sizeof(control.version) + sizeof(control.features) + sizeof(control.epoch));
+    auto ptr = payload.data();
+    auto write = [&ptr](const void* data, std::size_t size) {
+        std::memcpy(ptr, data, size);
+        ptr += size;
+    };
+    write(&FRAME_CONTROL_MAGIC, sizeof(FRAME_CONTROL_MAGIC));
+    write(&control.type, sizeof(control.type));
+    write(&control.version, sizeof(control.version));
+    write(&control.features, sizeof(control.features));
+    write(&control.epoch, sizeof(control.epoch));
+    return payload;
+}
+
+// false - a plain heartbeat
+inline bool frame_control_of(const std::vector<uint8_t>& payload, frame_control_t& control) {
+    uint16_t magic;
+    if (payload.size() < sizeof(magic) + sizeof(control.type) + sizeof(control.version) + sizeof(control.features) + sizeof(control.epoch)) {
+        return false;
+    }
+    auto ptr = payload.data();
+    auto read = [&ptr](void* data, std::size_t size) {
+        std::memcpy(data, ptr, size);
+        ptr += size;
+    };
+    read(&magic, sizeof(magic));
+    read(&control.type, sizeof(control.type));
+    read(&control.version, sizeof(control.version));
+    read(&control.features, sizeof(control.features));
+    read(&control.epoch, sizeof(control.epoch));
+    return magic == FRAME_CONTROL_MAGIC;
+}
+
+// Optional flags byte in the payload of a TOPIC message, a subscription without it takes every message
+typedef enum class TOPIC_FLAG : uint8_t {
+    CONFLATE = 1 << 0, // a backed up subscriber only needs the latest message of the topic
+    REPLAY = 1 << 1,   // uint64_t sequence of the last message received follows, the publisher resends what came after it
+    REPLAY_SINCE = 1 << 2, // int64_t UTC time in microseconds follows, the publisher resends what was sent from then on
+} topic_flag_t;
+
+inline bool topic_conflated(const std::vector<uint8_t>& payload) {
+    return !payload.empty() && (payload[0] & static_cast<uint8_t>(TOPIC_FLAG::CONFLATE));
+}
+
+inline bool topic_replay(const std::vector<uint8_t>& payload, uint64_t& sequence) {
+    if (payload.size() < sizeof(uint8_t) + sizeof(sequence) || !(payload[0] & static_cast<uint8_t>(TOPIC_FLAG::REPLAY))) {
+        return false;
+    }
+    std::memcpy(&sequence, payload.data() + sizeof(uint8_t), sizeof(sequence));
+    return true;
+}
+
+inline bool topic_replay_since(const std::vector<uint8_t>& payload, int64_t& time_stamp) {
+    if (payload.size() < sizeof(uint8_t) + sizeof(time_stamp) || !(payload[0] & static_cast<uint8_t>(TOPIC_FLAG::REPLAY_SINCE))) {
+        return false;
+    }
+    std::memcpy(&time_stamp, payload.data() + sizeof(uint8_t), sizeof(time_stamp));
+    return true;
+}
+
 typedef struct comm_header {
     int32_t comm_msg_len; // session id
 } comm_header_t;
@@ -78,27 +207,54 @@ typedef struct comm_msg {
     std::string topic = {};            // topic of DBUS_PUB/DBUS_SUB  mode
     std::vector<uint8_t> payload = {}; // communication payload
     int64_t send_time_stamp = {};      // send UTC time, unit microseconds
+    uint64_t correlation_id = {};      // request id of REQ/REP mode, 0 - none
+    uint64_t sequence = {};            // per topic number of PUB mode data, counting from 1, 0 - none
+    int64_t ttl = {};                  // time to live from send_time_stamp, unit microseconds, 0 - never expires
+    int64_t mono_time_stamp = {};      // send time on the monotonic clock of the host, unit nanoseconds, 0 - none
+
+    int64_t deadline() const {
+        return ttl ? send_time_stamp + ttl : 0;
+    }
+
+    bool expired(int64_t now) const {
+        return ttl && now > send_time_stamp + ttl;
+    }
+
+    uint8_t extension() const {
+        uint8_t ext_flags = 0;
+        if (correlation_id) {
+            ext_flags |= static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID);
+        }
+        if (sequence) {
+            ext_flags |= static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE);
+        }
+        if (ttl) {
+            ext_flags |= static_cast<uint8_t>(FRAME_EXTENSION::TTL);
+        }
+        if (mono_time_stamp) {
+            ext_flags |= static_cast<uint8_t>(FRAME_EXTENSION::MONO_STAMP);
+        }
+        return ext_flags;
+    }
 
     std::size_t size() const {
+        auto ext_flags = extension();
         return sizeof(session_id) + sizeof(msg_type) +
                sizeof(int32_t) + topic.size() +
                sizeof(int32_t) + payload.size() +
-               sizeof(send_time_stamp);
+               sizeof(send_time_stamp) +
+               (ext_flags ? sizeof(ext_flags) : 0) +
+               (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID) ? sizeof(correlation_id) : 0) +
+               (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE) ? sizeof(sequence) : 0) +
+               (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::TTL) ? sizeof(ttl) : 0) +
+               (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::MONO_STAMP) ? sizeof(mono_time_stamp) : 0);
     };
 } comm_msg_t;
 
-// Serialization function for comm_msg_t
-inline void serialize_comm_msg_t(const comm_msg_t& msg, std::vector<uint8_t>& buffer) {
-    // Reserve the buffer capacity in advance (optional, for performance optimization)
-    buffer.clear();
-    buffer.reserve(msg.size());
-
-    // Helper lambda to write data into the buffer
-    auto write_to_buffer = [&buffer](const void* data, size_t size) {
-        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
-        buffer.insert(buffer.end(), bytes, bytes + size);
-    };
-
+// Serialization function for comm_msg_t, hands the fields in order to write_to_buffer(data, size),
+// the payload of payload_size bytes in place of msg.payload to write_payload()
+template<typename PayloadWriter, typename Writer>
+inline void serialize_comm_msg_with(const comm_msg_t& msg, std::size_t payload_size, PayloadWriter&& write_payload, Writer&& write_to_buffer) {
     // Serialize data directly into the buffer
     write_to_buffer(&msg.session_id, sizeof(msg.session_id));
     write_to_buffer(&msg.msg_type, sizeof(msg.msg_type));
@@ -107,18 +263,99 @@ inline void serialize_comm_msg_t(const comm_msg_t& msg, std::vector<uint8_t>& bu
     write_to_buffer(&topic_length, sizeof(topic_length));
     write_to_buffer(msg.topic.data(), msg.topic.size());
 
-    int32_t payload_length = msg.payload.size();
+    int32_t payload_length = payload_size;
     write_to_buffer(&payload_length, sizeof(payload_length));
-    write_to_buffer(msg.payload.data(), msg.payload.size());
+    write_payload();
 
     write_to_buffer(&msg.send_time_stamp, sizeof(msg.send_time_stamp));
+
+    auto ext_flags = msg.extension();
+    if (ext_flags) {
+        write_to_buffer(&ext_flags, sizeof(ext_flags));
+        if (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID)) {
+            write_to_buffer(&msg.correlation_id, sizeof(msg.correlation_id));
+        }
+        if (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE)) {
+            write_to_buffer(&msg.sequence, sizeof(msg.sequence));
+        }
+        if (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::TTL)) {
+            write_to_buffer(&msg.ttl, sizeof(msg.ttl));
+        }
+        if (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::MONO_STAMP)) {
+            write_to_buffer(&msg.mono_time_stamp, sizeof(msg.mono_time_stamp));
+        }
+    }
+}
+
+// Serialization function for comm_msg_t, hands the fields in order to write_to_buffer(data, size)
+template<typename Writer>
+inline void serialize_comm_msg_with(const comm_msg_t& msg, Writer&& write_to_buffer) {
+    serialize_comm_msg_with(msg, msg.payload.size(), [&] { write_to_buffer(msg.payload.data(), msg.payload.size()); }, write_to_buffer);
+}
+
+// Serialization function for comm_msg_t, appends to the buffer
+inline void serialize_comm_msg_append(const comm_msg_t& msg, std::vector<uint8_t>& buffer) {
+    serialize_comm_msg_with(msg, [&buffer](const void* data, size_t size) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    });
+}
+
+// Serialization function for comm_msg_t
+inline void serialize_comm_msg_t(const comm_msg_t& msg, std::vector<uint8_t>& buffer) {
+    // Reserve the buffer capacity in advance (optional, for performance optimization)
+    buffer.clear();
+    buffer.reserve(msg.size());
+    serialize_comm_msg_append(msg, buffer);
+}
+
+// Serialization function for a whole frame, comm_header_t followed by the serialized comm_msg_t
+inline void serialize_comm_frame(const comm_msg_t& msg, std::vector<uint8_t>& frame) {
+    comm_header_t header;
+    header.comm_msg_len = msg.size();
+    frame.clear();
+    frame.reserve(sizeof(header) + header.comm_msg_len);
+    frame.insert(frame.end(), reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+    serialize_comm_msg_append(msg, frame);
 }
 
+// Serialization function for a whole frame into memory of sizeof(comm_header_t) + msg.size() bytes
+inline void serialize_comm_frame(const comm_msg_t& msg, uint8_t* frame) {
+    comm_header_t header;
+    header.comm_msg_len = msg.size();
+    std::memcpy(frame, &header, sizeof(header));
+    frame += sizeof(header);
+    serialize_comm_msg_with(msg, [&frame](const void* data, size_t size) {
+        std::memcpy(frame, data, size);
+        frame += size;
+    });
+}
+
+// Serialization function for a whole frame whose payload is written by payload.write instead of taken from msg.payload
+inline void serialize_comm_frame(const comm_msg_t& msg, const spdmq_payload_t& payload, std::vector<uint8_t>& frame) {
+    comm_header_t header;
+    header.comm_msg_len = msg.size() - msg.payload.size() + payload.size;
+    frame.resize(sizeof(header) + header.comm_msg_len);
+    auto ptr = frame.data();
+    std::memcpy(ptr, &header, sizeof(header));
+    ptr += sizeof(header);
+    auto write_to_buffer = [&ptr](const void* data, size_t size) {
+        std::memcpy(ptr, data, size);
+        ptr += size;
+    };
+    serialize_comm_msg_with(msg, payload.size, [&] {
+        if (payload.size) {
+            payload.write(payload.value, ptr);
+            ptr += payload.size;
+        }
+    }, write_to_buffer);
+}
 
 // Deserialization function for comm_msg_t
-inline void deserialize_comm_msg_t(std::vector<uint8_t>& buffer, comm_msg_t& msg) {
+inline void deserialize_comm_msg_t(const uint8_t* data, std::size_t size, comm_msg_t& msg) {
 
-    const uint8_t* ptr = buffer.data();
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + size;
 
     // Helper lambda to read data from the buffer
     auto read_from_buffer = [&ptr](void* data, size_t size) {
@@ -141,21 +378,475 @@ inline void deserialize_comm_msg_t(std::vector<uint8_t>& buffer, comm_msg_t& msg
     read_from_buffer(&msg.payload[0], payload_length);
 
     read_from_buffer(&msg.send_time_stamp, sizeof(msg.send_time_stamp));
+
+    // Extension fields, absent in frames of older senders
+    if (ptr >= end) {
+        return;
+    }
+    uint8_t ext_flags;
+    read_from_buffer(&ext_flags, sizeof(ext_flags));
+    if ((ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID)) &&
+        end - ptr >= static_cast<std::ptrdiff_t>(sizeof(msg.correlation_id))) {
+        read_from_buffer(&msg.correlation_id, sizeof(msg.correlation_id));
+    }
+    if ((ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE)) &&
+        end - ptr >= static_cast<std::ptrdiff_t>(sizeof(msg.sequence))) {
+        read_from_buffer(&msg.sequence, sizeof(msg.sequence));
+    }
+    if ((ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::TTL)) &&
+        end - ptr >= static_cast<std::ptrdiff_t>(sizeof(msg.ttl))) {
+        read_from_buffer(&msg.ttl, sizeof(msg.ttl));
+    }
+    if ((ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::MONO_STAMP)) &&
+        end - ptr >= static_cast<std::ptrdiff_t>(sizeof(msg.mono_time_stamp))) {
+        read_from_buffer(&msg.mono_time_stamp, sizeof(msg.mono_time_stamp));
+    }
+}
+
+inline void deserialize_comm_msg_t(std::vector<uint8_t>& buffer, comm_msg_t& msg) {
+    deserialize_comm_msg_t(buffer.data(), buffer.size(), msg);
+}
+
+// Read the message type and topic of a whole frame (comm_header_t and body) without decoding the payload,
+// the topic refers to the frame
+inline bool peek_comm_frame(const std::vector<uint8_t>& frame, message_type_t& msg_type, std::string_view& topic) {
+    constexpr std::size_t topic_offset = sizeof(comm_header_t) + sizeof(comm_msg_t::session_id) + sizeof(comm_msg_t::msg_type);
+    int32_t topic_length;
+    if (frame.size() < topic_offset + sizeof(topic_length)) {
+        return false;
+    }
+    std::memcpy(&msg_type, frame.data() + topic_offset - sizeof(msg_type), sizeof(msg_type));
+    std::memcpy(&topic_length, frame.data() + topic_offset, sizeof(topic_length));
+    if (topic_length < 0 || frame.size() - topic_offset - sizeof(topic_length) < static_cast<std::size_t>(topic_length)) {
+        return false;
+    }
+    topic = std::string_view(reinterpret_cast<const char*>(frame.data()) + topic_offset + sizeof(topic_length), topic_length);
+    return true;
+}
+
+// Length of the payload of a whole frame, without decoding it
+inline std::size_t peek_comm_frame_payload_size(const uint8_t* frame, std::size_t size) {
+    constexpr std::size_t topic_offset = sizeof(comm_header_t) + sizeof(comm_msg_t::session_id) + sizeof(comm_msg_t::msg_type);
+    int32_t topic_length;
+    int32_t payload_length;
+    if (size < topic_offset + sizeof(topic_length)) {
+        return 0;
+    }
+    std::memcpy(&topic_length, frame + topic_offset, sizeof(topic_length));
+    if (topic_length < 0 || size < topic_offset + sizeof(topic_length) + topic_length + sizeof(payload_length)) {
+        return 0;
+    }
+    std::memcpy(&payload_length, frame + topic_offset + sizeof(topic_length) + topic_length, sizeof(payload_length));
+    return payload_length < 0 ? 0 : payload_length;
+}
+
+// Time a whole frame expires at, without decoding it, 0 - never
+inline int64_t peek_comm_frame_deadline(const uint8_t* frame, std::size_t size) {
+    std::size_t offset = sizeof(comm_header_t) + sizeof(comm_msg_t::session_id) + sizeof(comm_msg_t::msg_type);
+    for (int32_t i = 0; i < 2; ++i) {
+        int32_t length;
+        if (size < offset + sizeof(length)) {
+            return 0;
+        }
+        std::memcpy(&length, frame + offset, sizeof(length));
+        offset += sizeof(length) + (length < 0 ? 0 : length);
+    }
+
+    int64_t send_time_stamp;
+    uint8_t ext_flags;
+    if (size < offset + sizeof(send_time_stamp) + sizeof(ext_flags)) {
+        return 0;
+    }
+    std::memcpy(&send_time_stamp, frame + offset, sizeof(send_time_stamp));
+    offset += sizeof(send_time_stamp);
+    std::memcpy(&ext_flags, frame + offset, sizeof(ext_flags));
+    offset += sizeof(ext_flags);
+    if (!(ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::TTL))) {
+        return 0;
+    }
+    offset += (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID) ? sizeof(comm_msg_t::correlation_id) : 0) +
+              (ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE) ? sizeof(comm_msg_t::sequence) : 0);
+
+    int64_t ttl;
+    if (size < offset + sizeof(ttl)) {
+        return 0;
+    }
+    std::memcpy(&ttl, frame + offset, sizeof(ttl));
+    return ttl ? send_time_stamp + ttl : 0;
+}
+
+inline int64_t peek_comm_frame_deadline(const std::vector<uint8_t>& frame) {
+    return peek_comm_frame_deadline(frame.data(), frame.size());
+}
+
+// Where an extension field of a whole frame is, so that it can be rewritten in place, nullptr - the frame carries none
+inline uint8_t* comm_frame_extension(uint8_t* frame, std::size_t size, frame_extension_t field) {
+    std::size_t offset = sizeof(comm_header_t) + sizeof(comm_msg_t::session_id) + sizeof(comm_msg_t::msg_type);
+    for (int32_t i = 0; i < 2; ++i) {
+        int32_t length;
+        if (size < offset + sizeof(length)) {
+            return nullptr;
+        }
+        std::memcpy(&length, frame + offset, sizeof(length));
+        offset += sizeof(length) + (length < 0 ? 0 : length);
+    }
+
+    uint8_t ext_flags;
+    offset += sizeof(comm_msg_t::send_time_stamp);
+    if (size < offset + sizeof(ext_flags)) {
+        return nullptr;
+    }
+    std::memcpy(&ext_flags, frame + offset, sizeof(ext_flags));
+    offset += sizeof(ext_flags);
+    if (!(ext_flags & static_cast<uint8_t>(field))) {
+        return nullptr;
+    }
+    // Every extension field takes 8 bytes, those of the lower flags come first
+    for (uint8_t flag = 1; flag < static_cast<uint8_t>(field); flag <<= 1) {
+        offset += ext_flags & flag ? sizeof(uint64_t) : 0;
+    }
+    return size < offset + sizeof(uint64_t) ? nullptr : frame + offset;
+}
+
+inline uint8_t* comm_frame_sequence(uint8_t* frame, std::size_t size) {
+    return comm_frame_extension(frame, size, FRAME_EXTENSION::SEQUENCE);
+}
+
+// Little endian base 128, 7 bits per byte, the high bit is set on every byte but the last
+inline std::size_t varint_size(uint64_t value) {
+    std::size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
 }
 
-inline void spdmq_msg_to_comm_msg(spdmq_msg_t& spdmq_msg, comm_msg_t& comm_msg) {
+inline uint8_t* put_varint(uint8_t* ptr, uint64_t value) {
+    while (value >= 0x80) {
+        *ptr++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *ptr++ = static_cast<uint8_t>(value);
+    return ptr;
+}
+
+// false - the varint runs past end or over 10 bytes, ptr is left as it was
+inline bool get_varint(const uint8_t*& ptr, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    auto cur = ptr;
+    for (uint32_t shift = 0; cur < end && shift < 64; shift += 7) {
+        auto byte = *cur++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            ptr = cur;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Small magnitudes of either sign take few bytes
+inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Compressed payload of a v2 frame
+typedef struct frame_compression {
+    compression_t codec = COMPRESSION::NONE;
+    uint64_t raw_size = 0;      // payload bytes once decompressed
+    uint32_t dictionary_id = 0; // dictionary the payload was compressed with, 0 - none
+} frame_compression_t;
+
+// Upper bound of the size a compressed payload may claim
+constexpr uint64_t FRAME_RAW_SIZE_MAX = 256 << 20;
+
+// Fields of a whole v1 frame (comm_header_t and body), the topic and payload refer to the frame
+typedef struct comm_frame_view {
+    message_type_t msg_type = {};
+    std::string_view topic = {};
+    const uint8_t* payload = nullptr;
+    std::size_t payload_size = 0;
+    int64_t send_time_stamp = {};
+    uint64_t correlation_id = {};
+    uint64_t sequence = {};
+    int64_t ttl = {};
+    int64_t mono_time_stamp = {};
+    frame_compression_t compression = {}; // set when the payload has been compressed for v2
+} comm_frame_view_t;
+
+inline bool view_comm_frame(const uint8_t* frame, std::size_t size, comm_frame_view_t& view) {
+    const uint8_t* ptr = frame + sizeof(comm_header_t) + sizeof(comm_msg_t::session_id);
+    const uint8_t* end = frame + size;
+    auto read = [&ptr, end](void* data, std::size_t size) {
+        if (end - ptr < static_cast<std::ptrdiff_t>(size)) {
+            return false;
+        }
+        std::memcpy(data, ptr, size);
+        ptr += size;
+        return true;
+    };
+
+    int32_t topic_length;
+    if (size < sizeof(comm_header_t) + sizeof(comm_msg_t::session_id) || !read(&view.msg_type, sizeof(view.msg_type)) ||
+        !read(&topic_length, sizeof(topic_length)) || topic_length < 0 || end - ptr < topic_length) {
+        return false;
+    }
+    view.topic = std::string_view(reinterpret_cast<const char*>(ptr), topic_length);
+    ptr += topic_length;
+
+    int32_t payload_length;
+    if (!read(&payload_length, sizeof(payload_length)) || payload_length < 0 || end - ptr < payload_length) {
+        return false;
+    }
+    view.payload = ptr;
+    view.payload_size = payload_length;
+    ptr += payload_length;
+
+    uint8_t ext_flags = 0;
+    if (!read(&view.send_time_stamp, sizeof(view.send_time_stamp))) {
+        return false;
+    }
+    if (ptr < end) {
+        read(&ext_flags, sizeof(ext_flags));
+    }
+    return (!(ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::CORRELATION_ID)) || read(&view.correlation_id, sizeof(view.correlation_id))) &&
+           (!(ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::SEQUENCE)) || read(&view.sequence, sizeof(view.sequence))) &&
+           (!(ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::TTL)) || read(&view.ttl, sizeof(view.ttl))) &&
+           (!(ext_flags & static_cast<uint8_t>(FRAME_EXTENSION::MONO_STAMP)) || read(&view.mono_time_stamp, sizeof(view.mono_time_stamp)));
+}
+
+// Encode a whole v2 frame, varint length and body. topic_id 0 - the topic goes as a string,
+// define - the name goes along with the id. The timestamp counts from the epoch of the sender.
+// checksum - a CRC32C of the body ends the frame
+inline void encode_comm_frame_v2(const comm_frame_view_t& view, uint32_t topic_id, bool define, int64_t epoch, bool checksum, std::vector<uint8_t>& frame) {
+    uint32_t flags = 0;
+    std::size_t size = sizeof(view.msg_type) + view.payload_size;
+    if (checksum) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::CHECKSUM);
+        size += sizeof(uint32_t);
+    }
+    if (topic_id) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::TOPIC_ID);
+        size += varint_size(topic_id);
+    }
+    if (!topic_id || define) {
+        flags |= define ? static_cast<uint32_t>(FRAME_FLAG::TOPIC_NAME) : 0;
+        size += varint_size(view.topic.size()) + view.topic.size();
+    }
+    uint64_t time_stamp = zigzag_encode(view.send_time_stamp - epoch);
+    if (view.send_time_stamp) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::TIMESTAMP);
+        size += varint_size(time_stamp);
+    }
+    if (view.sequence) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::SEQUENCE);
+        size += varint_size(view.sequence);
+    }
+    if (view.correlation_id) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::CORRELATION_ID);
+        size += varint_size(view.correlation_id);
+    }
+    if (view.ttl) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::TTL);
+        size += varint_size(view.ttl);
+    }
+    if (view.mono_time_stamp) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::MONO_STAMP);
+        size += varint_size(view.mono_time_stamp);
+    }
+    if (view.compression.codec != COMPRESSION::NONE) {
+        flags |= static_cast<uint32_t>(FRAME_FLAG::COMPRESSED);
+        size += varint_size(static_cast<uint8_t>(view.compression.codec)) + varint_size(view.compression.raw_size) +
+                varint_size(view.compression.dictionary_id);
+    }
+    size += varint_size(flags);
+
+    frame.resize(varint_size(size) + size);
+    auto ptr = put_varint(frame.data(), size);
+    auto body = ptr;
+    ptr = put_varint(ptr, flags);
+    *ptr++ = static_cast<uint8_t>(view.msg_type);
+    if (topic_id) {
+        ptr = put_varint(ptr, topic_id);
+    }
+    if (!topic_id || define) {
+        ptr = put_varint(ptr, view.topic.size());
+        ptr = std::copy(view.topic.begin(), view.topic.end(), ptr);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::TIMESTAMP)) {
+        ptr = put_varint(ptr, time_stamp);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::SEQUENCE)) {
+        ptr = put_varint(ptr, view.sequence);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::CORRELATION_ID)) {
+        ptr = put_varint(ptr, view.correlation_id);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::TTL)) {
+        ptr = put_varint(ptr, view.ttl);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::MONO_STAMP)) {
+        ptr = put_varint(ptr, view.mono_time_stamp);
+    }
+    if (flags & static_cast<uint32_t>(FRAME_FLAG::COMPRESSED)) {
+        ptr = put_varint(ptr, static_cast<uint8_t>(view.compression.codec));
+        ptr = put_varint(ptr, view.compression.raw_size);
+        ptr = put_varint(ptr, view.compression.dictionary_id);
+    }
+    if (view.payload_size) {
+        ptr = static_cast<uint8_t*>(std::memcpy(ptr, view.payload, view.payload_size)) + view.payload_size;
+    }
+    if (checksum) {
+        auto crc = spdmq_crc32c::instance().value(body, ptr - body);
+        std::memcpy(ptr, &crc, sizeof(crc));
+    }
+}
+
+typedef enum class FRAME_CHECKSUM : uint8_t {
+    NONE = 0,     // the frame carries no checksum
+    MATCH = 1,    // the checksum has been taken off the end of the body
+    MISMATCH = 2, // the body is corrupt
+} frame_checksum_t;
+
+// Check the CHECKSUM trailer of the body of a v2 frame, size is left without it, decode_comm_frame_v2 takes the rest
+inline frame_checksum_t verify_comm_frame_v2(const uint8_t* body, std::size_t& size) {
+    const uint8_t* ptr = body;
+    uint64_t flags;
+    if (!get_varint(ptr, body + size, flags) || !(flags & static_cast<uint64_t>(FRAME_FLAG::CHECKSUM))) {
+        return FRAME_CHECKSUM::NONE;
+    }
+    uint32_t crc;
+    if (size < static_cast<std::size_t>(ptr - body) + sizeof(crc)) {
+        return FRAME_CHECKSUM::MISMATCH;
+    }
+    size -= sizeof(crc);
+    std::memcpy(&crc, body + size, sizeof(crc));
+    return spdmq_crc32c::instance().value(body, size) == crc ? FRAME_CHECKSUM::MATCH : FRAME_CHECKSUM::MISMATCH;
+}
+
+// Upper bound of the topic ids a session may define, ids are handed out densely by the sender
+constexpr uint64_t FRAME_TOPIC_ID_MAX = 1 << 24;
+
+// Decode the body of a v2 frame checked by verify_comm_frame_v2, topics holds the ids defined on the session so far, a compressed payload is left
+// as it is and described by compression. false - the frame is malformed, refers to an unknown topic id or carries a flag that is not known
+inline bool decode_comm_frame_v2(const uint8_t* body, std::size_t size, int64_t epoch, std::vector<std::string>& topics, comm_msg_t& msg,
+                                 frame_compression_t& compression) {
+    const uint8_t* ptr = body;
+    const uint8_t* end = body + size;
+    uint64_t flags;
+    if (!get_varint(ptr, end, flags) || (flags & ~static_cast<uint64_t>(FRAME_FLAGS_KNOWN)) || ptr >= end) {
+        return false;
+    }
+    msg.msg_type = static_cast<message_type_t>(*ptr++);
+
+    auto read_name = [&ptr, end](std::string& name) {
+        uint64_t length;
+        if (!get_varint(ptr, end, length) || static_cast<uint64_t>(end - ptr) < length) {
+            return false;
+        }
+        name.assign(reinterpret_cast<const char*>(ptr), length);
+        ptr += length;
+        return true;
+    };
+    if (flags & static_cast<uint64_t>(FRAME_FLAG::TOPIC_ID)) {
+        uint64_t topic_id;
+        if (!get_varint(ptr, end, topic_id) || topic_id == 0 || topic_id > FRAME_TOPIC_ID_MAX) {
+            return false;
+        }
+        if (flags & static_cast<uint64_t>(FRAME_FLAG::TOPIC_NAME)) {
+            if (topics.size() <= topic_id) {
+                topics.resize(topic_id + 1);
+            }
+            if (!read_name(topics[topic_id])) {
+                return false;
+            }
+        }
+        if (topics.size() <= topic_id || topics[topic_id].empty()) {
+            return false;
+        }
+        msg.topic = topics[topic_id];
+    }
+    else if (!read_name(msg.topic)) {
+        return false;
+    }
+
+    uint64_t value;
+    auto read_field = [&ptr, end, flags, &value](FRAME_FLAG flag) {
+        value = 0;
+        return !(flags & static_cast<uint64_t>(flag)) || get_varint(ptr, end, value);
+    };
+    if (!read_field(FRAME_FLAG::TIMESTAMP)) {
+        return false;
+    }
+    msg.send_time_stamp = flags & static_cast<uint64_t>(FRAME_FLAG::TIMESTAMP) ? zigzag_decode(value) + epoch : 0;
+    if (!read_field(FRAME_FLAG::SEQUENCE)) {
+        return false;
+    }
+    msg.sequence = value;
+    if (!read_field(FRAME_FLAG::CORRELATION_ID)) {
+        return false;
+    }
+    msg.correlation_id = value;
+    if (!read_field(FRAME_FLAG::TTL)) {
+        return false;
+    }
+    msg.ttl = value;
+    if (!read_field(FRAME_FLAG::MONO_STAMP)) {
+        return false;
+    }
+    msg.mono_time_stamp = value;
+
+    compression = {};
+    if (flags & static_cast<uint64_t>(FRAME_FLAG::COMPRESSED)) {
+        uint64_t codec, dictionary_id;
+        if (!get_varint(ptr, end, codec) || !get_varint(ptr, end, compression.raw_size) || !get_varint(ptr, end, dictionary_id) ||
+            codec == 0 || codec > UINT8_MAX || compression.raw_size > FRAME_RAW_SIZE_MAX || dictionary_id > UINT32_MAX) {
+            return false;
+        }
+        compression.codec = static_cast<compression_t>(codec);
+        compression.dictionary_id = dictionary_id;
+    }
+
+    msg.payload.assign(ptr, end);
+    return true;
+}
+
+inline void spdmq_msg_to_comm_msg(spdmq_msg_t& spdmq_msg, comm_msg_t& comm_msg, bool monotonic_stamp = false) {
+    // Both stamps come from one clock read
+    auto& clock = spdmq_clock::instance();
+    auto mono = clock.mono_nsecs();
     comm_msg.session_id = spdmq_msg.session_id ;
     comm_msg.msg_type = MESSAGE_TYPE::DATA;
     comm_msg.topic = std::move(spdmq_msg.topic);
     comm_msg.payload = std::move(spdmq_msg.payload);
-    comm_msg.send_time_stamp = now_usecs_timestamp();
+    comm_msg.send_time_stamp = clock.wall_nsecs(mono) / 1000;
+    comm_msg.mono_time_stamp = monotonic_stamp ? mono : 0;
+    comm_msg.correlation_id = spdmq_msg.correlation_id;
+    comm_msg.ttl = spdmq_msg.ttl;
+}
+
+// Send to now in nanoseconds, on the monotonic clock when the message carries its stamp, else on the wall clock
+inline int64_t comm_msg_latency_nsecs(const comm_msg_t& comm_msg, int64_t mono) {
+    if (comm_msg.mono_time_stamp) {
+        return mono - comm_msg.mono_time_stamp;
+    }
+    return spdmq_clock::instance().wall_nsecs(mono) - comm_msg.send_time_stamp * 1000;
 }
 
 inline void comm_msg_to_spdmq_msg(comm_msg_t& comm_msg, spdmq_msg_t& spdmq_msg) {
     spdmq_msg.session_id = comm_msg.session_id;
     spdmq_msg.topic = std::move(comm_msg.topic);
     spdmq_msg.payload = std::move(comm_msg.payload);
-    spdmq_msg.time_cost = now_usecs_timestamp() - comm_msg.send_time_stamp;
+    spdmq_msg.time_cost_ns = comm_msg_latency_nsecs(comm_msg, spdmq_clock::instance().mono_nsecs());
+    spdmq_msg.time_cost = spdmq_msg.time_cost_ns / 1000;
+    spdmq_msg.correlation_id = comm_msg.correlation_id;
+    spdmq_msg.sequence = comm_msg.sequence;
+    spdmq_msg.ttl = comm_msg.ttl;
 }
 
 } /* namespace speed::mq */
\ No newline at end of file
@@ -1,20 +1,107 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
 #pragma once
 
-#include <iostream>
-#include <string>
-#include <sstream>
-#include <iomanip>
-#include <chrono>
+#include <mutex>
+#include <ctime>
 #include <atomic>
-// #include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "spdmq_ring.hpp"
+#include "spdmq_clock.hpp"
+
+/**
+ * @brief Asynchronous printf style logger.
+ *        A call copies the format string pointer and its arguments into a ring of the calling thread,
+ *        a background thread formats and writes them. Levels below SPDMQ_MIN_LOG_LEVEL
+ *        (0 DEBUG, 1 INFO, 2 WARN, 3 ERROR) are not compiled at all, the others are filtered by set_loglevel.
+ *        Arguments are arithmetic values and pointers, char pointers are taken as C strings and copied.
+ *        The *_RATE macros log at most per_sec records per second from their call site.
+ *
+ */
+
+#ifndef SPDMQ_MIN_LOG_LEVEL
+#define SPDMQ_MIN_LOG_LEVEL 0
+#endif
+
+#ifndef __FILENAME__
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+#endif
+
+#define SPDMQ_LOG(level, ...)                                                                      \
+    do {                                                                                           \
+        if (speed::mq::spdmq_logger::instance().enabled(level)) {                                  \
+            if (false) {                                                                           \
+                speed::mq::spdmq_log_format_check(__VA_ARGS__);                                    \
+            }                                                                                      \
+            speed::mq::spdmq_logger::instance().log(level, __FILENAME__, __LINE__, __VA_ARGS__);   \
+        }                                                                                          \
+    } while (0)
+
+#define SPDMQ_LOG_RATE(level, per_sec, ...)                                                        \
+    do {                                                                                           \
+        static speed::mq::spdmq_log_limiter spdmq_log_limiter_(per_sec);                           \
+        if (speed::mq::spdmq_logger::instance().enabled(level) && spdmq_log_limiter_.allow()) {    \
+            SPDMQ_LOG(level, __VA_ARGS__);                                                         \
+        }                                                                                          \
+    } while (0)
 
-#define __FILENAME__ (strrchr(__FILE__, '/') ? std::strrchr(__FILE__, '/') + 1 : __FILE__)
-#define LOGD(...) opendbus::spdmq_logger::instance()->log(opendbus::LOG_LEVEL::DEBUG, __FILENAME__, __LINE__, __VA_ARGS__)
-#define LOGI(...) opendbus::spdmq_logger::instance()->log(opendbus::LOG_LEVEL::INFO, __FILENAME__, __LINE__, __VA_ARGS__)
-#define LOGW(...) opendbus::spdmq_logger::instance()->log(opendbus::LOG_LEVEL::WARN, __FILENAME__, __LINE__, __VA_ARGS__)
-#define LOGE(...) opendbus::spdmq_logger::instance()->log(opendbus::LOG_LEVEL::ERROR, __FILENAME__, __LINE__, __VA_ARGS__)
+#define SPDMQ_LOG_NONE(...) do {} while (0)
 
-namespace opendbus {
+#if SPDMQ_MIN_LOG_LEVEL <= 0
+#define LOGD(...) SPDMQ_LOG(speed::mq::LOG_LEVEL::DEBUG, __VA_ARGS__)
+#define LOGD_RATE(per_sec, ...) SPDMQ_LOG_RATE(speed::mq::LOG_LEVEL::DEBUG, per_sec, __VA_ARGS__)
+#else
+#define LOGD(...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#define LOGD_RATE(per_sec, ...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#endif
+
+#if SPDMQ_MIN_LOG_LEVEL <= 1
+#define LOGI(...) SPDMQ_LOG(speed::mq::LOG_LEVEL::INFO, __VA_ARGS__)
+#define LOGI_RATE(per_sec, ...) SPDMQ_LOG_RATE(speed::mq::LOG_LEVEL::INFO, per_sec, __VA_ARGS__)
+#else
+#define LOGI(...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#define LOGI_RATE(per_sec, ...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#endif
+
+#if SPDMQ_MIN_LOG_LEVEL <= 2
+#define LOGW(...) SPDMQ_LOG(speed::mq::LOG_LEVEL::WARN, __VA_ARGS__)
+#define LOGW_RATE(per_sec, ...) SPDMQ_LOG_RATE(speed::mq::LOG_LEVEL::WARN, per_sec, __VA_ARGS__)
+#else
+#define LOGW(...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#define LOGW_RATE(per_sec, ...) SPDMQ_LOG_NONE(__VA_ARGS__)
+#endif
+
+#define LOGE(...) SPDMQ_LOG(speed::mq::LOG_LEVEL::ERROR, __VA_ARGS__)
+#define LOGE_RATE(per_sec, ...) SPDMQ_LOG_RATE(speed::mq::LOG_LEVEL::ERROR, per_sec, __VA_ARGS__)
+
+namespace speed::mq {
 
 enum class LOG_LEVEL: uint8_t {
     DEBUG = 0,
@@ -23,80 +110,303 @@ enum class LOG_LEVEL: uint8_t {
     ERROR = 3,
 };
 
+// Never called, lets the compiler check the format string against the arguments
+[[gnu::format(printf, 1, 2)]] inline void spdmq_log_format_check(const char*, ...) {}
+
+// Allows per_sec calls a second, without a lock, a suppressed call costs a clock read and two relaxed loads
+class spdmq_log_limiter {
+private:
+    static constexpr int64_t WINDOW = 1000000000; // nanoseconds
+
+    uint32_t per_sec_;
+    std::atomic<int64_t> window_ = {0};   // monotonic start of the current window
+    std::atomic<uint32_t> count_ = {0};   // calls in the current window
+
+public:
+    explicit spdmq_log_limiter(uint32_t per_sec) : per_sec_(per_sec) {}
+
+    bool allow() {
+        auto now = spdmq_clock::instance().mono_nsecs();
+        auto window = window_.load(std::memory_order_relaxed);
+        if (now - window >= WINDOW) {
+            if (window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+                count_.store(0, std::memory_order_relaxed);
+            }
+        }
+        else if (count_.load(std::memory_order_relaxed) >= per_sec_) {
+            return false;
+        }
+        return count_.fetch_add(1, std::memory_order_relaxed) < per_sec_;
+    }
+};
+
 class spdmq_logger {
 private:
-    std::atomic<uint8_t> log_level_;
+    static constexpr std::size_t ARGS_SIZE = 216;    // bytes of the arguments of one record, C strings are cut to fit,
+                                                     // the last one is kept '\0' for the strings that do not fit at all
+    static constexpr std::size_t RING_SIZE = 1024;   // records a thread may have waiting
+    static constexpr std::size_t LINE_SIZE = 1024;   // longest formatted message
+    static constexpr auto IDLE_WAIT = std::chrono::milliseconds(50);
+
+    struct log_record;
+    using formatter_t = int (*)(const log_record& record, char* out, std::size_t size);
+
+    struct log_record {
+        const char* fmt = nullptr;
+        const char* file = nullptr;
+        formatter_t format = nullptr;
+        int64_t mono = 0;
+        uint32_t line = 0;
+        LOG_LEVEL level = LOG_LEVEL::DEBUG;
+        uint8_t args[ARGS_SIZE];
+    };
+
+    struct log_ring {
+        spdmq_ring<log_record> records{RING_SIZE};
+        int32_t tid = static_cast<int32_t>(::syscall(SYS_gettid));
+        std::atomic<uint64_t> dropped = {0};  // records the full ring could not take
+        std::atomic<bool> retired = {false};  // its thread has exited
+    };
+
+    // Registers the ring of a thread on its first record and retires it when the thread exits
+    struct log_producer {
+        std::shared_ptr<log_ring> ring;
+
+        ~log_producer() {
+            if (ring) {
+                ring->retired.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    // Argument stored in a record, char pointers are stored as the offset of their copy
+    template<typename T>
+    struct log_arg {
+        static_assert(std::is_arithmetic_v<T> || std::is_pointer_v<T>, "log arguments are arithmetic values and pointers");
+        using stored_t = T;
+
+        static stored_t store(T value, uint8_t*, std::size_t&) {
+            return value;
+        }
+
+        static T load(stored_t value, const uint8_t*) {
+            return value;
+        }
+    };
+
+    struct log_str {
+        using stored_t = uint16_t;
+
+        static stored_t store(const char* value, uint8_t* args, std::size_t& used) {
+            constexpr std::size_t limit = ARGS_SIZE - 1;
+            if (used >= limit) {
+                return limit;
+            }
+            auto size = value ? std::min(std::strlen(value), limit - used - 1) : 0;
+            std::memcpy(args + used, value, size);
+            args[used + size] = '\0';
+            auto offset = used;
+            used += size + 1;
+            return static_cast<stored_t>(offset);
+        }
+
+        static const char* load(stored_t offset, const uint8_t* args) {
+            return reinterpret_cast<const char*>(args + offset);
+        }
+    };
+
+    template<typename T>
+    using arg_t = std::conditional_t<std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>,
+                                     log_str, log_arg<std::decay_t<T>>>;
+
+    std::atomic<uint8_t> log_level_ = {static_cast<uint8_t>(LOG_LEVEL::INFO)};
+    std::FILE* output_ = stdout;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<log_ring>> rings_;  // guarded by mutex_
+    uint64_t flush_requested_ = 0;                  // guarded by mutex_
+    uint64_t flush_done_ = 0;                       // guarded by mutex_
+    bool stop_ = false;                             // guarded by mutex_
+    time_t second_ = -1;                            // second of time_text_, used by the background thread only
+    char time_text_[40] = {};
+    std::thread thread_;
 
 public:
-    static spdmq_logger* instance() {
-        static spdmq_logger impl;
-        return &impl;
+    static spdmq_logger& instance() {
+        static spdmq_logger logger;
+        return logger;
     }
 
-    spdmq_logger() {
-        log_level_.store(static_cast<uint8_t>(LOG_LEVEL::DEBUG));
+    ~spdmq_logger() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
     }
 
     void set_loglevel(LOG_LEVEL level) {
-        log_level_.store(static_cast<uint8_t>(level));
+        log_level_.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+
+    // Where the lines go, stdout by default
+    void set_output(std::FILE* output) {
+        std::lock_guard<std::mutex> lk(mutex_);
+        output_ = output;
+    }
+
+    bool enabled(LOG_LEVEL level) const {
+        return static_cast<uint8_t>(level) >= log_level_.load(std::memory_order_relaxed);
     }
 
     template<typename... Args>
-    void log(LOG_LEVEL level, const std::string &file, int line, Args... args) {
-        
-        if (log_level_.load() > static_cast<uint8_t>(level)) return;
-
-        std::ostringstream messageStream;
-        build_message(messageStream, args...);
-
-        std::ostringstream log_stream;
-        log_stream << "[" << get_current_time() << "] ";
-        
-        switch (level) {
-            case LOG_LEVEL::DEBUG:
-                log_stream << "[DEBUG] ";
-                break;
-            case LOG_LEVEL::INFO:
-                log_stream << "[INFO] ";
-                break;
-            case LOG_LEVEL::WARN:
-                log_stream << "[WARN] ";
-                break;
-            case LOG_LEVEL::ERROR:
-                log_stream << "[ERROR] ";
-                break;
+    void log(LOG_LEVEL level, const char* file, uint32_t line, const char* fmt, const Args&... args) {
+        static_assert((0 + ... + sizeof(typename arg_t<Args>::stored_t)) < ARGS_SIZE, "too many log arguments");
+        auto& ring = ring_of_thread();
+        log_record record;
+        record.fmt = fmt;
+        record.file = file;
+        record.format = &format<Args...>;
+        record.mono = spdmq_clock::instance().mono_nsecs();
+        record.line = line;
+        record.level = level;
+        record.args[ARGS_SIZE - 1] = '\0';
+
+        // Fixed size arguments first, the copies of C strings after them, in argument order
+        [[maybe_unused]] std::size_t used = (0 + ... + sizeof(typename arg_t<Args>::stored_t));
+        [[maybe_unused]] std::size_t offset = 0;
+        [[maybe_unused]] int expand[] = {0, (put(record.args, offset, arg_t<Args>::store(args, record.args, used)), 0)...};
+        if (!ring.records.push(std::move(record))) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
         }
+        if (level >= LOG_LEVEL::WARN) {
+            cv_.notify_one();
+        }
+    }
 
-        log_stream << "[" << file << ":" << line << "] " << messageStream.str();
-        // log_stream << messageStream.str();
-        std::cout << log_stream.str() << std::endl;
+    // Waits until the records logged before are written
+    void flush() {
+        std::unique_lock<std::mutex> lk(mutex_);
+        auto request = ++flush_requested_;
+        cv_.notify_one();
+        cv_.wait(lk, [&] { return flush_done_ >= request || stop_; });
     }
 
 private:
-    std::string get_current_time() {
-        auto now = std::chrono::system_clock::now();
-        auto now_as_timet = std::chrono::system_clock::to_time_t(now);
-        auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+    spdmq_logger() {
+        thread_ = std::thread([this] { drain_loop(); });
+    }
+
+    log_ring& ring_of_thread() {
+        thread_local log_producer producer;
+        if (!producer.ring) {
+            producer.ring = std::make_shared<log_ring>();
+            std::lock_guard<std::mutex> lk(mutex_);
+            rings_.push_back(producer.ring);
+        }
+        return *producer.ring;
+    }
+
+    template<typename T>
+    static void put(uint8_t* args, std::size_t& offset, const T& value) {
+        std::memcpy(args + offset, &value, sizeof(T));
+        offset += sizeof(T);
+    }
 
-        std::tm now_tm = *std::localtime(&now_as_timet);
-        std::ostringstream stream;
-        stream << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S");
-        stream << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
+    template<typename T>
+    static T get(const uint8_t* args, std::size_t& offset) {
+        T value;
+        std::memcpy(&value, args + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
 
-        return stream.str();
+    template<typename... Args>
+    static int format(const log_record& record, char* out, std::size_t size) {
+        [[maybe_unused]] std::size_t offset = 0;
+        // Braces read the arguments in order
+        std::tuple<decltype(arg_t<Args>::load(typename arg_t<Args>::stored_t{}, record.args))...> values{
+            arg_t<Args>::load(get<typename arg_t<Args>::stored_t>(record.args, offset), record.args)...};
+        return std::apply([&](auto... arguments) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+            return std::snprintf(out, size, record.fmt, arguments...);
+#pragma GCC diagnostic pop
+        }, values);
     }
 
-    template<typename T, typename... Args>
-    void build_message(std::ostringstream &stream, T& first, Args... args) {
-        stream << first;
-        build_message(stream, args...);
+    void drain_loop() {
+        std::string lines;
+        std::unique_lock<std::mutex> lk(mutex_);
+        for (;;) {
+            auto request = flush_requested_;
+            auto stop = stop_;
+            auto rings = rings_;
+            auto output = output_;
+            lk.unlock();
+
+            lines.clear();
+            for (auto& ring : rings) {
+                drain(*ring, lines);
+            }
+            if (!lines.empty()) {
+                std::fwrite(lines.data(), 1, lines.size(), output);
+                std::fflush(output);
+            }
+
+            lk.lock();
+            // A retired ring goes once its thread can not log any more and it has been drained
+            rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<log_ring>& ring) {
+                return ring->retired.load(std::memory_order_acquire) && ring->records.empty();
+            }), rings_.end());
+            flush_done_ = request;
+            cv_.notify_all();
+            if (stop) {
+                return;
+            }
+            if (lines.empty() && flush_requested_ == request && !stop_) {
+                cv_.wait_for(lk, IDLE_WAIT);
+            }
+        }
     }
 
-    template<typename T, typename... Args>
-    void build_message(std::ostringstream &stream, T& first) {
-        stream << first;
+    void drain(log_ring& ring, std::string& lines) {
+        static const char* LEVEL_NAME[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+        char message[LINE_SIZE];
+        log_record record;
+        while (ring.records.pop(record)) {
+            auto length = record.format(record, message, sizeof(message));
+            length = std::clamp<int>(length, 0, sizeof(message) - 1);
+            char prefix[128];
+            auto prefix_length = std::snprintf(prefix, sizeof(prefix), "[%s] [%s] [%d] [%s:%u] ", time_of(record.mono),
+                                               LEVEL_NAME[static_cast<uint8_t>(record.level)], ring.tid, record.file, record.line);
+            lines.append(prefix, std::clamp<int>(prefix_length, 0, sizeof(prefix) - 1));
+            lines.append(message, length);
+            lines.push_back('\n');
+        }
+        if (auto dropped = ring.dropped.exchange(0, std::memory_order_relaxed)) {
+            char line[128];
+            auto length = std::snprintf(line, sizeof(line), "[%s] [WARN] [%d] %llu log records dropped\n",
+                                        time_of(spdmq_clock::instance().mono_nsecs()), ring.tid, static_cast<unsigned long long>(dropped));
+            lines.append(line, std::clamp<int>(length, 0, sizeof(line) - 1));
+        }
     }
 
+    // Local time with microseconds, the date part is only formatted again when the second changes
+    const char* time_of(int64_t mono) {
+        auto wall = spdmq_clock::instance().wall_nsecs(mono);
+        auto now = static_cast<time_t>(wall / 1000000000);
+        if (now != second_) {
+            std::tm tm;
+            localtime_r(&now, &tm);
+            std::strftime(time_text_, 20, "%Y-%m-%d %H:%M:%S", &tm);
+            second_ = now;
+        }
+        std::snprintf(time_text_ + 19, sizeof(time_text_) - 19, ".%06d", static_cast<int32_t>(wall / 1000 % 1000000));
+        return time_text_;
+    }
 };
 
-} /* namespace opendbus */
+} /* namespace speed::mq */
@@ -0,0 +1,83 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include "spdmq_uncopyable.h"
+
+/**
+ * @brief This is a lock-free ring buffer for one producer thread and one consumer thread.
+ *        The capacity is rounded up to a power of two.
+ *
+ */
+
+namespace speed::mq {
+
+template<typename T>
+class spdmq_ring : public spdmq_uncopyable {
+private:
+    std::vector<T> buffer_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_ = {0}; // next slot to read, written by the consumer only
+    alignas(64) std::atomic<std::size_t> tail_ = {0}; // next slot to write, written by the producer only
+
+public:
+    explicit spdmq_ring(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    bool push(T&& value) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == buffer_.size()) {
+            return false;
+        }
+        buffer_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    std::size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const {
+        return buffer_.size();
+    }
+};
+
+} /* namespace speed::mq */
@@ -0,0 +1,98 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include "spdmq_def.h"
+
+namespace speed::mq {
+
+// The settings of spdmq_ctx read per message, frozen when the first bind or connect registers the company.
+// The hot paths read plain fields instead of calling the getters, and look up a topic only when something is set for one.
+// The context may still be changed afterwards, only the endpoints added later see it
+class spdmq_runtime {
+public:
+    uint32_t send_hwm;
+    uint32_t heartbeat;
+    uint32_t reconnect_interval;
+    uint32_t replay_depth;
+    bool last_value_cache;
+    uint8_t frame_version;
+    bool checksum;
+    bool monotonic_stamp;
+    push_strategy_t push_strategy;
+    spdmq_credit_window_t credit_window;
+    bool credit_enabled;                   // credit_window limits something
+    std::set<std::string> topics;
+    std::set<std::string> conflate_topics;
+
+private:
+    std::map<std::string, int64_t, std::less<>> topic_ttls_;
+    std::map<std::string, spdmq_compression_opt_t, std::less<>> compressions_;
+    const spdmq_compression_opt_t* default_compression_ = nullptr; // of every topic without its own, nullptr - none
+
+public:
+    explicit spdmq_runtime(const spdmq_ctx_t& ctx)
+        : send_hwm(ctx._send_hwm),
+          heartbeat(ctx._heartbeat),
+          reconnect_interval(ctx._reconnect_interval),
+          replay_depth(ctx._replay_depth),
+          last_value_cache(ctx._last_value_cache),
+          frame_version(ctx._frame_version),
+          checksum(ctx._checksum),
+          monotonic_stamp(ctx._monotonic_stamp),
+          push_strategy(ctx._push_strategy),
+          credit_window(ctx._credit_window),
+          credit_enabled(ctx._credit_window.messages || ctx._credit_window.bytes),
+          topics(ctx._topics),
+          conflate_topics(ctx._conflate_topics),
+          topic_ttls_(ctx._topic_ttls.begin(), ctx._topic_ttls.end()),
+          compressions_(ctx._compressions)
+    {
+        auto it = compressions_.find(std::string_view());
+        if (it != compressions_.end()) {
+            default_compression_ = &it->second;
+        }
+    }
+
+    // time to live of the messages sent on the topic without their own, 0 - none
+    int64_t topic_ttl(std::string_view topic) const {
+        if (topic_ttls_.empty()) {
+            return 0;
+        }
+        auto it = topic_ttls_.find(topic);
+        return it == topic_ttls_.end() ? 0 : it->second;
+    }
+
+    const spdmq_compression_opt_t& compression(std::string_view topic) const {
+        static const spdmq_compression_opt_t none;
+        if (compressions_.empty()) {
+            return none;
+        }
+        auto it = compressions_.find(topic);
+        if (it != compressions_.end()) {
+            return it->second;
+        }
+        return default_compression_ ? *default_compression_ : none;
+    }
+};
+
+} /* namespace speed::mq */
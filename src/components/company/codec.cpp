@@ -0,0 +1,384 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#include "codec.h"
+
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#ifdef SPDMQ_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef SPDMQ_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace speed::mq {
+
+// Built-in codec, an LZ77 block in the layout of LZ4: a token of literal length and match length,
+// the literals, a 2 byte offset into the 64 KB before them, lengths of 15 and above continue in extra bytes
+constexpr std::size_t LZ_HASH_LOG = 12;      // small payloads without a dictionary use a smaller table, it is cleared per payload
+constexpr std::size_t LZ_HASH_LOG_MIN = 8;
+constexpr std::size_t LZ_HASH_SIZE = 1 << LZ_HASH_LOG;
+constexpr std::size_t LZ_MAX_OFFSET = 65535;
+constexpr std::size_t LZ_MIN_MATCH = 4;
+constexpr std::size_t LZ_LAST_LITERALS = 5; // the block ends with literals, matches stop before them
+constexpr std::size_t LZ_MATCH_LIMIT = 12;  // no match starts within the last bytes
+constexpr std::size_t LZ_WILD_COPY = 32;    // slack after the output, copies go in whole chunks past their end
+constexpr std::size_t LZ_RESTORE_LIMIT = 1024; // below it a primed table is restored slot by slot rather than copied whole
+
+static inline uint32_t lz_hash(const uint8_t* ptr, std::size_t hash_log) {
+    uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return (value * 2654435761u) >> (32 - hash_log);
+}
+
+static inline uint8_t* lz_put_length(uint8_t* op, std::size_t length) {
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+// base[0, start) is the dictionary whose positions are in table already, base[start, end) is compressed
+static bool lz_compress(const uint8_t* base, std::size_t start, std::size_t end, uint32_t* table, std::size_t hash_log, std::vector<uint8_t>& dst) {
+    std::size_t size = end - start;
+    dst.resize(size + size / 255 + 16);
+    uint8_t* op = dst.data();
+    uint8_t* const limit = dst.data() + size; // it has to come out smaller than it went in
+
+    auto emit = [&](std::size_t anchor, std::size_t literals, std::size_t offset, std::size_t match) {
+        if (op + 1 + literals + literals / 255 + 1 + (offset ? 2 + match / 255 + 1 : 0) >= limit) {
+            return false;
+        }
+        uint8_t* token = op++;
+        *token = static_cast<uint8_t>(std::min<std::size_t>(literals, 15) << 4);
+        if (literals >= 15) {
+            op = lz_put_length(op, literals - 15);
+        }
+        std::memcpy(op, base + anchor, literals);
+        op += literals;
+        if (offset) {
+            *op++ = static_cast<uint8_t>(offset);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            match -= LZ_MIN_MATCH;
+            *token |= static_cast<uint8_t>(std::min<std::size_t>(match, 15));
+            if (match >= 15) {
+                op = lz_put_length(op, match - 15);
+            }
+        }
+        return true;
+    };
+
+    std::size_t anchor = start;
+    if (size > LZ_MATCH_LIMIT) {
+        const std::size_t match_limit = end - LZ_LAST_LITERALS;
+        const std::size_t search_limit = end - LZ_MATCH_LIMIT;
+        std::size_t ip = start;
+        while (ip < search_limit) {
+            auto hash = lz_hash(base + ip, hash_log);
+            std::size_t ref = table[hash];
+            table[hash] = ip;
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || std::memcmp(base + ref, base + ip, LZ_MIN_MATCH) != 0) {
+                // Incompressible stretches are stepped over faster the longer they get
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            while (ip > anchor && ref > 0 && base[ip - 1] == base[ref - 1]) {
+                --ip;
+                --ref;
+            }
+
+            // Eight bytes at a time, the first differing byte is found from the lowest set bit
+            std::size_t match = LZ_MIN_MATCH;
+            while (ip + match + sizeof(uint64_t) <= match_limit) {
+                uint64_t a, b;
+                std::memcpy(&a, base + ref + match, sizeof(a));
+                std::memcpy(&b, base + ip + match, sizeof(b));
+                if (a != b) {
+                    match += __builtin_ctzll(a ^ b) >> 3;
+                    break;
+                }
+                match += sizeof(uint64_t);
+            }
+            while (ip + match < match_limit && base[ref + match] == base[ip + match]) {
+                ++match;
+            }
+
+            if (!emit(anchor, ip - anchor, ip - ref, match)) {
+                return false;
+            }
+            ip += match;
+            anchor = ip;
+            if (ip < search_limit) {
+                table[lz_hash(base + ip - 2, hash_log)] = ip - 2;
+            }
+        }
+    }
+    if (!emit(anchor, end - anchor, 0, 0)) {
+        return false;
+    }
+    dst.resize(op - dst.data());
+    return true;
+}
+
+// out has LZ_WILD_COPY bytes of slack after raw_size
+static bool lz_decompress(const uint8_t* src, std::size_t size, const uint8_t* dict, std::size_t dict_size, uint8_t* out, std::size_t raw_size) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + size;
+    std::size_t op = 0;
+    auto get_length = [&ip, iend](std::size_t& length) {
+        uint8_t byte;
+        do {
+            if (ip >= iend) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        std::size_t literals = token >> 4;
+        if ((literals == 15 && !get_length(literals)) || literals > static_cast<std::size_t>(iend - ip) || literals > raw_size - op) {
+            return false;
+        }
+        if (literals <= 16 && iend - ip >= 16) {
+            std::memcpy(out + op, ip, 16);
+        }
+        else {
+            std::memcpy(out + op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+
+        // The last sequence has literals only
+        if (ip == iend) {
+            break;
+        }
+        if (iend - ip < 2) {
+            return false;
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        std::size_t match = token & 15;
+        if (match == 15 && !get_length(match)) {
+            return false;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op + dict_size || match > raw_size - op) {
+            return false;
+        }
+
+        // A match reaching back before the output starts in the dictionary
+        if (offset > op) {
+            std::size_t from_dict = std::min(offset - op, match);
+            std::memcpy(out + op, dict + dict_size - (offset - op), from_dict);
+            op += from_dict;
+            match -= from_dict;
+        }
+
+        // Chunks no longer than the distance never overlap their own source, a short offset repeats a pattern
+        // which is copied from a whole number of periods back once that distance reaches 8
+        auto dst = out + op;
+        if (offset >= 16) {
+            for (std::size_t copied = 0; copied < match; copied += 16) {
+                std::memcpy(dst + copied, dst - offset + copied, 16);
+            }
+        }
+        else {
+            std::size_t distance = offset;
+            std::size_t copied = 0;
+            if (offset < 8) {
+                distance = (8 + offset - 1) / offset * offset;
+                for (; copied < distance && copied < match; ++copied) {
+                    dst[copied] = (dst - offset)[copied];
+                }
+            }
+            for (; copied < match; copied += 8) {
+                std::memcpy(dst + copied, dst - distance + copied, 8);
+            }
+        }
+        op += match;
+    }
+    return op == raw_size;
+}
+
+class lz_codec : public codec {
+public:
+    bool compress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, int32_t level, std::vector<uint8_t>& dst) override {
+        if (dictionary.empty()) {
+            // A table about the size of the payload, cleared for each one
+            thread_local std::vector<uint32_t> table(LZ_HASH_SIZE);
+            std::size_t hash_log = LZ_HASH_LOG_MIN;
+            while (hash_log < LZ_HASH_LOG && (std::size_t(1) << hash_log) < size) {
+                ++hash_log;
+            }
+            std::fill(table.begin(), table.begin() + (std::size_t(1) << hash_log), 0);
+            return lz_compress(src, 0, size, table.data(), hash_log, dst);
+        }
+
+        // The tail of the dictionary starts the window, its positions are hashed once per thread and dictionary,
+        // the slots a payload took are given back to the dictionary afterwards
+        thread_local struct {
+            const uint8_t* data = nullptr;
+            std::size_t size = 0;
+            std::vector<uint8_t> window;
+            std::vector<uint32_t> primed;
+            std::vector<uint32_t> table;
+        } cache;
+        std::size_t dict_size = std::min(dictionary.size(), LZ_MAX_OFFSET);
+        if (cache.data != dictionary.data() || cache.size != dictionary.size()) {
+            cache.data = dictionary.data();
+            cache.size = dictionary.size();
+            cache.window.assign(dictionary.end() - dict_size, dictionary.end());
+            cache.primed.assign(LZ_HASH_SIZE, 0);
+            for (std::size_t pos = 0; pos + LZ_MIN_MATCH <= dict_size; ++pos) {
+                cache.primed[lz_hash(cache.window.data() + pos, LZ_HASH_LOG)] = pos;
+            }
+            cache.table = cache.primed;
+        }
+        cache.window.resize(dict_size);
+        cache.window.insert(cache.window.end(), src, src + size);
+        auto packed = lz_compress(cache.window.data(), dict_size, dict_size + size, cache.table.data(), LZ_HASH_LOG, dst);
+        if (size >= LZ_RESTORE_LIMIT) {
+            std::copy(cache.primed.begin(), cache.primed.end(), cache.table.begin());
+        }
+        else {
+            for (std::size_t pos = dict_size; pos + LZ_MIN_MATCH <= dict_size + size; ++pos) {
+                auto hash = lz_hash(cache.window.data() + pos, LZ_HASH_LOG);
+                cache.table[hash] = cache.primed[hash];
+            }
+        }
+        return packed;
+    }
+
+    bool decompress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, std::size_t raw_size, std::vector<uint8_t>& dst) override {
+        std::size_t dict_size = std::min(dictionary.size(), LZ_MAX_OFFSET);
+        dst.resize(raw_size + LZ_WILD_COPY);
+        auto unpacked = lz_decompress(src, size, dictionary.data() + dictionary.size() - dict_size, dict_size, dst.data(), raw_size);
+        dst.resize(raw_size);
+        return unpacked;
+    }
+};
+
+#ifdef SPDMQ_WITH_LZ4
+class lz4_codec : public codec {
+public:
+    bool compress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, int32_t level, std::vector<uint8_t>& dst) override {
+        // level is the acceleration of LZ4, higher is faster
+        dst.resize(LZ4_compressBound(size));
+        int32_t ret;
+        if (dictionary.empty()) {
+            ret = LZ4_compress_fast(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst.data()), size, dst.size(), std::max(level, 1));
+        }
+        else {
+            thread_local LZ4_stream_t stream;
+            LZ4_loadDict(&stream, reinterpret_cast<const char*>(dictionary.data()), dictionary.size());
+            ret = LZ4_compress_fast_continue(&stream, reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst.data()), size, dst.size(), std::max(level, 1));
+        }
+        if (ret <= 0 || static_cast<std::size_t>(ret) >= size) {
+            return false;
+        }
+        dst.resize(ret);
+        return true;
+    }
+
+    bool decompress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, std::size_t raw_size, std::vector<uint8_t>& dst) override {
+        dst.resize(raw_size);
+        auto ret = LZ4_decompress_safe_usingDict(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst.data()), size, raw_size,
+                                                 reinterpret_cast<const char*>(dictionary.data()), dictionary.size());
+        return ret >= 0 && static_cast<std::size_t>(ret) == raw_size;
+    }
+};
+#endif
+
+#ifdef SPDMQ_WITH_ZSTD
+class zstd_codec : public codec {
+public:
+    bool compress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, int32_t level, std::vector<uint8_t>& dst) override {
+        // level 0 is the default level of zstd
+        thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        dst.resize(ZSTD_compressBound(size));
+        auto ret = ZSTD_compress_usingDict(cctx.get(), dst.data(), dst.size(), src, size, dictionary.data(), dictionary.size(), level);
+        if (ZSTD_isError(ret) || ret >= size) {
+            return false;
+        }
+        dst.resize(ret);
+        return true;
+    }
+
+    bool decompress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, std::size_t raw_size, std::vector<uint8_t>& dst) override {
+        thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        dst.resize(raw_size);
+        auto ret = ZSTD_decompress_usingDict(dctx.get(), dst.data(), raw_size, src, size, dictionary.data(), dictionary.size());
+        return !ZSTD_isError(ret) && ret == raw_size;
+    }
+};
+#endif
+
+codec* codec::of(compression_t type) {
+    static lz_codec lz;
+#ifdef SPDMQ_WITH_LZ4
+    static lz4_codec lz4;
+#endif
+#ifdef SPDMQ_WITH_ZSTD
+    static zstd_codec zstd;
+#endif
+    switch (type) {
+        case COMPRESSION::LZ:
+            return &lz;
+#ifdef SPDMQ_WITH_LZ4
+        case COMPRESSION::LZ4:
+            return &lz4;
+#endif
+#ifdef SPDMQ_WITH_ZSTD
+        case COMPRESSION::ZSTD:
+            return &zstd;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+uint32_t codec::available() {
+    uint32_t codecs = 1 << static_cast<uint32_t>(COMPRESSION::LZ);
+#ifdef SPDMQ_WITH_LZ4
+    codecs |= 1 << static_cast<uint32_t>(COMPRESSION::LZ4);
+#endif
+#ifdef SPDMQ_WITH_ZSTD
+    codecs |= 1 << static_cast<uint32_t>(COMPRESSION::ZSTD);
+#endif
+    return codecs;
+}
+
+uint32_t dictionary_id(const std::vector<uint8_t>& dictionary) {
+    // FNV-1a
+    if (dictionary.empty()) {
+        return 0;
+    }
+    uint32_t hash = 2166136261u;
+    for (auto byte : dictionary) {
+        hash = (hash ^ byte) * 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,49 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "spdmq_def.h"
+
+namespace speed::mq {
+
+// Payload codec behind the COMPRESSED flag of v2 frames. A dictionary given to compress must be given
+// to decompress as well, it primes the codec with content typical of the topic, which pays off for small payloads.
+class codec {
+public:
+    virtual ~codec() = default;
+
+    // false - the payload does not shrink, it is sent as it is
+    virtual bool compress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, int32_t level, std::vector<uint8_t>& dst) = 0;
+
+    // false - the input is corrupt or does not come out at raw_size bytes
+    virtual bool decompress(const uint8_t* src, std::size_t size, const std::vector<uint8_t>& dictionary, std::size_t raw_size, std::vector<uint8_t>& dst) = 0;
+
+    // nullptr - the codec was not found at configure time
+    static codec* of(compression_t type);
+
+    // bit 1 << compression_t of every codec built in, announced to peers in the HELLO of the frame format
+    static uint32_t available();
+};
+
+// Tells the dictionaries of two sides apart, 0 - no dictionary
+uint32_t dictionary_id(const std::vector<uint8_t>& dictionary);
+
+} /* namespace speed::mq */
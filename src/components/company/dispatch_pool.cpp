@@ -0,0 +1,78 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#include "dispatch_pool.h"
+#include <thread>
+
+namespace speed::mq {
+
+dispatch_pool::dispatch_pool(uint32_t threads, dispatch_key_t key, std::size_t depth, std::function<void(comm_msg_t&&)> on_recv)
+    : key_(key), depth_(depth ? depth : 1), on_recv_(std::move(on_recv))
+{
+    for (uint32_t i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<worker_t>());
+    }
+    for (auto& worker : workers_) {
+        std::thread([this, worker = worker.get()] { run(*worker); }).detach();
+    }
+}
+
+void dispatch_pool::dispatch(comm_msg_t&& msg) {
+    auto& worker = worker_of(msg);
+    {
+        std::unique_lock<std::mutex> lk(worker.lock);
+        worker.cv.wait(lk, [&] { return worker.msgs.size() < depth_; });
+        worker.msgs.push_back(std::move(msg));
+        worker.queued.store(worker.msgs.size(), std::memory_order_relaxed);
+    }
+    worker.cv.notify_all();
+}
+
+std::vector<spdmq_dispatch_stat_t> dispatch_pool::dispatch_stats() {
+    std::vector<spdmq_dispatch_stat_t> stats;
+    for (auto& worker : workers_) {
+        spdmq_dispatch_stat_t stat;
+        stat.queued = worker->queued.load(std::memory_order_relaxed);
+        stat.dispatched = worker->dispatched.load(std::memory_order_relaxed);
+        stats.push_back(stat);
+    }
+    return stats;
+}
+
+dispatch_pool::worker_t& dispatch_pool::worker_of(const comm_msg_t& msg) {
+    // inproc session ids are negative, they hash like any other
+    std::size_t hash = key_ == DISPATCH_KEY::TOPIC ? std::hash<std::string>()(msg.topic) : static_cast<uint32_t>(msg.session_id);
+    return *workers_[hash % workers_.size()];
+}
+
+void dispatch_pool::run(worker_t& worker) {
+    while (true) {
+        comm_msg_t msg;
+        {
+            std::unique_lock<std::mutex> lk(worker.lock);
+            worker.cv.wait(lk, [&] { return !worker.msgs.empty(); });
+            msg = std::move(worker.msgs.front());
+            worker.msgs.pop_front();
+            worker.queued.store(worker.msgs.size(), std::memory_order_relaxed);
+        }
+        worker.cv.notify_all();
+        on_recv_(std::move(msg));
+        worker.dispatched.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,60 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "spdmq_def.h"
+#include "spdmq_internal_def.h"
+
+namespace speed::mq {
+
+// Calls on_recv on several threads with the messages taken off the receive queue. A message goes to the thread
+// of its key, so the messages of one session, or topic, are called back in order while other keys run in parallel.
+// A thread queues up to depth messages, then dispatch waits for it and the receive queue applies its drop policy
+class dispatch_pool {
+private:
+    typedef struct worker {
+        std::mutex lock;
+        std::condition_variable cv;        // a message was queued, or taken off a full queue
+        std::deque<comm_msg_t> msgs;       // guarded by lock
+        std::atomic<uint64_t> queued = {0};
+        std::atomic<uint64_t> dispatched = {0};
+    } worker_t;
+
+    std::vector<std::unique_ptr<worker_t>> workers_;
+    dispatch_key_t key_;
+    std::size_t depth_;
+    std::function<void(comm_msg_t&&)> on_recv_;
+
+public:
+    dispatch_pool(uint32_t threads, dispatch_key_t key, std::size_t depth, std::function<void(comm_msg_t&&)> on_recv);
+    void dispatch(comm_msg_t&& msg);
+    std::vector<spdmq_dispatch_stat_t> dispatch_stats();
+
+private:
+    worker_t& worker_of(const comm_msg_t& msg);
+    void run(worker_t& worker);
+};
+
+} /* namespace speed::mq */
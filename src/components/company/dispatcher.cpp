@@ -27,36 +27,26 @@ namespace speed::mq {
 dispatcher::dispatcher(spdmq_ctx_t& ctx) : ctx_(ctx) {}
 
 void dispatcher::registered_company(spdmq_ctx_t& ctx) {
-    // Create socket ptr
-    auto comm_mode = ctx.mode();
-    if (comm_mode == COMM_MODE::SPDMQ_PUB) {
-        spdmq_socket_ptr_ = server_factory::instance()->create_socket(ctx);
-    }
-    else if (comm_mode == COMM_MODE::SPDMQ_SUB) {
-        spdmq_socket_ptr_ = client_factory::instance()->create_socket(ctx);
-    }
-    else {
-        throw std::runtime_error("Unsupported communication mode");
-    }
-    spdmq_socket_ptr_->open_socket();
-
     // Create event ptr
     spdmq_event_ptr_ = event_factory::instance()->create_event(ctx);
     spdmq_event_ptr_->event_create();
     spdmq_event_ptr_->event_build();
-    // sleep_ms(100);
 
     // Create storeroom ptr
     storeroom_ptr_ = std::make_shared<storeroom>(ctx);
 
     // Create porter ptr
-    porter_ptr_ = std::make_shared<porter>(ctx, spdmq_event_ptr_, spdmq_socket_ptr_, storeroom_ptr_);
+    porter_ptr_ = std::make_shared<porter>(ctx, spdmq_event_ptr_, storeroom_ptr_);
 
     // Set event callback
     spdmq_event_ptr_->on_read = [this](auto&& T) {
         porter_ptr_->on_read(std::forward<decltype(T)>(T));
     };
 
+    spdmq_event_ptr_->on_write = [this](auto&& T) {
+        porter_ptr_->on_write(std::forward<decltype(T)>(T));
+    };
+
     spdmq_event_ptr_->on_connecting = [this](auto&& T) {
         porter_ptr_->on_connecting(std::forward<decltype(T)>(T));
     };
@@ -68,48 +58,71 @@ void dispatcher::registered_company(spdmq_ctx_t& ctx) {
     spdmq_event_ptr_->on_disconnect = [this](auto&& T) {
         porter_ptr_->on_disconnect(std::forward<decltype(T)>(T));
     };
+
+    spdmq_event_ptr_->on_tick = [this] {
+        porter_ptr_->on_tick();
+    };
 }
 
-void dispatcher::bind_company(spdmq_ctx_t& ctx) {
-    spdmq_socket_ptr_->resolve_address();
-    spdmq_socket_ptr_->bind();
-    spdmq_socket_ptr_->listen();
+void dispatcher::bind_company(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) {
+    // No socket, the peers meet in the process wide registry
+    if (url_parse.socket_mode == SOCKET_MODE::INPROC) {
+        inproc_registry::instance()->bind(url_parse.address, porter_ptr_);
+        return;
+    }
 
-    // Add socket fd to event loop
-    spdmq_event_ptr_->event_add(spdmq_socket_ptr_->socket_fd());
+    auto spdmq_socket_ptr = server_factory::instance()->create_socket(ctx, url_parse);
+    if (!spdmq_socket_ptr) {
+        throw std::runtime_error("Unsupported socket mode");
+    }
+    spdmq_socket_ptr->open_socket();
+    spdmq_socket_ptr->resolve_address();
+    spdmq_socket_ptr->bind();
+    spdmq_socket_ptr->listen();
+    spdmq_socket_list_.emplace_back(spdmq_socket_ptr);
+    porter_ptr_->add_socket(spdmq_socket_ptr->socket_fd(), spdmq_socket_ptr);
+
+    // Add listening socket fd to event loop
+    spdmq_event_ptr_->listener_add(spdmq_socket_ptr->socket_fd());
+
+    // Accept the connections that arrived before the listening socket joined the event loop
+    spdmq_event_ptr_->urgent_event({spdmq_socket_ptr->socket_fd(), EVENT::CONNECTING});
 }
 
-void dispatcher::connect_company(spdmq_ctx_t& ctx) {
-    spdmq_socket_ptr_->resolve_address();
-    porter_ptr_->on_reconnect();
-    // on_connect_company();
+bool dispatcher::connect_company(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse, spdmq_waiter_t* waiter) {
+    // waiter - resumed once this connection comes online, false - given up at once, waiter.code is set
+    if (url_parse.socket_mode == SOCKET_MODE::INPROC) {
+        if (waiter) {
+            porter_ptr_->wait_online(*waiter, url_parse.address);
+        }
+        inproc_registry::instance()->connect(url_parse.address, porter_ptr_);
+        return true;
+    }
+
+    auto spdmq_socket_ptr = client_factory::instance()->create_socket(ctx, url_parse);
+    if (!spdmq_socket_ptr) {
+        throw std::runtime_error("Unsupported socket mode");
+    }
+    spdmq_socket_ptr->open_socket();
+    spdmq_socket_ptr->resolve_address();
+    spdmq_socket_list_.emplace_back(spdmq_socket_ptr);
+    if (waiter) {
+        return porter_ptr_->wait_online(*waiter, spdmq_socket_ptr);
+    }
+    porter_ptr_->on_reconnect(spdmq_socket_ptr);
+    return true;
 }
 
 void dispatcher::operating_company(bool background) {
     spdmq_event_ptr_->event_run(background);
 }
 
-// void dispatcher::on_connect_company() {
-//     std::thread([this] {
-//         while (true) {
-//             if (!spdmq_socket_ptr_->connect()) {
-//                 // Add socket fd to event loop
-//                 spdmq_event_ptr_->event_add(spdmq_socket_ptr_->socket_fd());
-//                 // printf("connect success, spdmq_socket_ptr_->socket_fd:%d\n", spdmq_socket_ptr_->socket_fd());
-
-//                 // Add connection events to the event loop
-//                 // printf("spdmq_event_ptr_->urgent_event\n");
-//                 spdmq_event_ptr_->urgent_event({spdmq_socket_ptr_->socket_fd(), EVENT::CONNECTED});
-//                 break;
-//             }
-//             // printf("reconnect_interval:%d\n", ctx().reconnect_interval());
-//             if (ctx().reconnect_interval() == 0) {
-//                 break;
-//             }
-
-//             sleep_ms(ctx().reconnect_interval());
-//         }
-//     }).detach();
-// }
+int32_t dispatcher::process_company(uint32_t max_events, uint32_t budget) {
+    return spdmq_event_ptr_->event_process(max_events, budget);
+}
+
+fd_t dispatcher::native_handle() {
+    return spdmq_event_ptr_->native_handle();
+}
 
 } /* namespace speed::mq */
@@ -29,7 +29,7 @@ private:
     std::shared_ptr<porter> porter_ptr_;
     std::shared_ptr<storeroom> storeroom_ptr_;
     std::shared_ptr<spdmq_event> spdmq_event_ptr_;
-    std::shared_ptr<spdmq_socket> spdmq_socket_ptr_;
+    std::vector<std::shared_ptr<spdmq_socket>> spdmq_socket_list_; // listeners and outbound connections
 
 public:
     dispatcher(spdmq_ctx_t& ctx);
@@ -37,13 +37,15 @@ public:
     void registered_company (spdmq_ctx_t& ctx);
     void destroy_company (spdmq_ctx_t& ctx) {}
 
-    void bind_company (spdmq_ctx_t& ctx);
+    void bind_company (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     void unbind_company (spdmq_ctx_t& ctx) {};
 
-    void connect_company (spdmq_ctx_t& ctx);
+    bool connect_company (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse, spdmq_waiter_t* waiter = nullptr);
     void disconnect_company (spdmq_ctx_t& ctx) {}
 
     void operating_company (bool background);
+    int32_t process_company (uint32_t max_events, uint32_t budget);
+    fd_t native_handle ();
     void closure_company (bool background) {}
 
 public:
@@ -51,13 +53,6 @@ public:
         return porter_ptr_;
     }
 
-    std::shared_ptr<spdmq_socket>& spdmq_socket_ptr() {
-        return spdmq_socket_ptr_;
-    }
-
-private:
-    // void on_connect_company();
-
 private:
     spdmq_ctx_t& ctx() {
         return ctx_;
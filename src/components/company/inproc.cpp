@@ -0,0 +1,105 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "inproc.h"
+#include "porter.h"
+
+namespace speed::mq {
+
+inproc_pipe::inproc_pipe(std::size_t capacity) : ring_(capacity) {
+}
+
+int32_t inproc_pipe::push(const std::shared_ptr<comm_msg_t>& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(write_lock_);
+        auto value = msg;
+        if (!ring_.push(std::move(value))) {
+            return SPDMQ_CODE_SEND_FAILED_HWM;
+        }
+    }
+
+    // Only the first message after the consumer started draining needs a wake up
+    if (!notified_.exchange(true)) {
+        notify_();
+    }
+    return SPDMQ_CODE_OK;
+}
+
+bool inproc_pipe::pop(std::shared_ptr<comm_msg_t>& msg) {
+    return ring_.pop(msg);
+}
+
+void inproc_pipe::drain() {
+    // Cleared before the consumer pops, a message pushed from now on wakes it up again
+    notified_.store(false);
+}
+
+void inproc_pipe::notify(std::function<void()> notify) {
+    notify_ = std::move(notify);
+}
+
+std::size_t inproc_pipe::size() const {
+    return ring_.size();
+}
+
+inproc_registry* inproc_registry::instance() {
+    static inproc_registry impl;
+    return &impl;
+}
+
+void inproc_registry::bind(const std::string& name, std::shared_ptr<porter> porter_ptr) {
+    std::unique_lock<std::mutex> lk(lock_);
+    if (binder_map_[name].lock()) {
+        throw std::runtime_error("inproc address already in use: " + name);
+    }
+    binder_map_[name] = porter_ptr;
+
+    auto range = pending_map_.equal_range(name);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (auto connector = it->second.lock()) {
+            pair(name, porter_ptr, connector);
+        }
+    }
+    pending_map_.erase(name);
+}
+
+void inproc_registry::connect(const std::string& name, std::shared_ptr<porter> porter_ptr) {
+    std::unique_lock<std::mutex> lk(lock_);
+    auto binder = binder_map_[name].lock();
+    if (!binder) {
+        pending_map_.emplace(name, porter_ptr);
+        return;
+    }
+    pair(name, binder, porter_ptr);
+}
+
+int32_t inproc_registry::next_session_id() {
+    return --session_id_;
+}
+
+void inproc_registry::pair(const std::string& name, std::shared_ptr<porter> binder, std::shared_ptr<porter> connector) {
+    // Each side sizes the pipe it writes to by its own high-water mark
+    auto to_connector = binder->open_inproc();
+    auto to_binder = connector->open_inproc();
+
+    // Both ends are in place before either side is told, so no early message misses its wake up
+    auto binder_session = binder->add_inproc(to_binder, to_connector, false, name);
+    auto connector_session = connector->add_inproc(to_connector, to_binder, true, name);
+    binder->online_inproc(binder_session);
+    connector->online_inproc(connector_session);
+}
+
+} /* namespace speed::mq */
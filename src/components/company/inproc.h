@@ -0,0 +1,76 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <functional>
+#include "spdmq_ring.hpp"
+#include "spdmq_spinlock.hpp"
+#include "spdmq_internal_def.h"
+
+namespace speed::mq {
+
+class porter;
+
+// ring size of inproc:// pipes when the high-water mark is unlimited
+constexpr std::size_t INPROC_RING_SIZE = 65536;
+
+// One direction of an inproc:// connection, messages are moved through it without serialization
+class inproc_pipe {
+private:
+    spdmq_ring<std::shared_ptr<comm_msg_t>> ring_;
+    std::atomic_flag write_lock_ = ATOMIC_FLAG_INIT; // the ring has one producer, user threads take turns
+    std::atomic_bool notified_ = {false};            // the consumer has been told and has not started draining yet
+    std::function<void()> notify_;                   // wakes up the consumer, set before the connection is announced
+
+public:
+    explicit inproc_pipe(std::size_t capacity);
+
+    int32_t push(const std::shared_ptr<comm_msg_t>& msg);
+    bool pop(std::shared_ptr<comm_msg_t>& msg);
+    void drain();
+    void notify(std::function<void()> notify);
+    std::size_t size() const;
+};
+
+// Process wide table of inproc:// names, a connect may come before the bind
+class inproc_registry {
+private:
+    std::mutex lock_;
+    std::map<std::string, std::weak_ptr<porter>> binder_map_;       // name -> porter of the bound endpoint
+    std::multimap<std::string, std::weak_ptr<porter>> pending_map_; // name -> porters waiting for the bind
+    std::atomic<int32_t> session_id_ = {-1};                        // inproc sessions count down from -2, they never collide with fds
+
+public:
+    static inproc_registry* instance();
+
+    void bind(const std::string& name, std::shared_ptr<porter> porter_ptr);
+    void connect(const std::string& name, std::shared_ptr<porter> porter_ptr);
+    int32_t next_session_id();
+
+private:
+    void pair(const std::string& name, std::shared_ptr<porter> binder, std::shared_ptr<porter> connector);
+
+protected:
+    inproc_registry() {}
+    ~inproc_registry() {}
+};
+
+} /* namespace speed::mq */
@@ -0,0 +1,357 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "journal.h"
+#include "spdmq_error.hpp"
+
+#include <deque>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace speed::mq {
+
+// Index entries per segment, one for each 64 bytes of log but never less than this
+constexpr std::size_t JOURNAL_INDEX_MIN = 1024;
+// Name of the segment made ahead, it does not start with a digit so recover passes it by
+constexpr const char* JOURNAL_SPARE = "spare";
+
+// Runs the file work of every journal in order: preallocating, mapping and deleting segments
+// take milliseconds, the publisher appends under its lock and must not wait for them
+class journal_worker {
+private:
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+
+    journal_worker() {
+        std::thread([this] {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lk(lock_);
+                    cv_.wait(lk, [this] { return !tasks_.empty(); });
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+                task();
+            }
+        }).detach();
+    }
+
+public:
+    // Never destroyed, the thread waits on it until the process exits
+    static journal_worker& instance() {
+        static auto worker = new journal_worker;
+        return *worker;
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+};
+
+static void make_dirs(const std::string& path) {
+    for (std::size_t pos = 1; pos != std::string::npos;) {
+        pos = path.find('/', pos + 1);
+        auto dir = path.substr(0, pos);
+        ERRNO_ASSERT(mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST);
+    }
+}
+
+// Topics become directory names, anything but [A-Za-z0-9._-] is written as %XX
+static std::string escape_topic(const std::string& topic) {
+    std::string name;
+    for (unsigned char c : topic) {
+        if (isalnum(c) || c == '.' || c == '_' || c == '-') {
+            name.push_back(c);
+            continue;
+        }
+        char hex[4];
+        snprintf(hex, sizeof hex, "%%%02X", c);
+        name += hex;
+    }
+    return name.empty() || name == "." || name == ".." ? "%" + name : name;
+}
+
+// Maps the file, preallocating it to size first when it is smaller
+static uint8_t* map_file(const std::string& path, std::size_t& size) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    ERRNO_ASSERT(fd != -1);
+
+    struct stat st;
+    ERRNO_ASSERT(fstat(fd, &st) == 0);
+    if (static_cast<std::size_t>(st.st_size) < size) {
+        // Blocks are reserved up front, appending never has to grow the file
+        int rc = fallocate(fd, 0, 0, size);
+        if (rc != 0 && errno == EOPNOTSUPP) {
+            rc = ftruncate(fd, size);
+        }
+        ERRNO_ASSERT(rc == 0);
+    }
+    else {
+        size = st.st_size;
+    }
+
+    auto addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ERRNO_ASSERT(addr != MAP_FAILED);
+    return static_cast<uint8_t*>(addr);
+}
+
+journal::segment::~segment() {
+    if (log) {
+        munmap(log, log_size);
+    }
+    if (index) {
+        munmap(index, index_capacity * sizeof(journal_index_t));
+    }
+}
+
+journal::journal(const spdmq_journal_opt_t& opt, const std::string& topic) : opt_(opt) {
+    dir_ = opt_.path + "/" + escape_topic(topic);
+    make_dirs(dir_);
+    spare_ = std::make_shared<spare_t>();
+    recover();
+}
+
+void journal::append(const comm_msg_t& msg) {
+    auto frame_size = sizeof(comm_header_t) + msg.size();
+    if (!active_ ||
+        active_->first_sequence + active_->count != msg.sequence ||
+        active_->count >= active_->index_capacity ||
+        active_->offset + frame_size > active_->log_size) {
+        roll(msg.sequence, frame_size);
+    }
+
+    // Encoded straight into the mapping, the kernel writes it back, no fsync on this path
+    auto& segment = *active_;
+    serialize_comm_frame(msg, segment.log + segment.offset);
+    segment.index[segment.count] = {msg.sequence, msg.send_time_stamp, segment.offset};
+    segment.offset += frame_size;
+    ++segment.count;
+    committed_.store(msg.sequence, std::memory_order_release);
+
+    // The next segment is asked for halfway through this one, it is ready long before the roll
+    if (!preparing_ && (segment.offset > segment.log_size / 2 || segment.count > segment.index_capacity / 2)) {
+        prepare();
+    }
+}
+
+uint64_t journal::first_sequence() {
+    std::lock_guard<std::mutex> lk(lock_);
+    return segments_.empty() ? committed_.load() + 1 : segments_.begin()->first;
+}
+
+uint64_t journal::last_sequence() {
+    return committed_.load(std::memory_order_acquire);
+}
+
+uint64_t journal::sequence_since(int64_t time_stamp) {
+    std::vector<std::shared_ptr<segment_t>> segments;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        for (auto& segment : segments_) {
+            segments.push_back(segment.second);
+        }
+    }
+
+    auto committed = last_sequence();
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+        auto last = i + 1 < segments.size() ? segments[i + 1]->first_sequence - 1 : committed;
+        if (last < segments[i]->first_sequence) {
+            continue;
+        }
+
+        // Send times only go forward within a topic, the first entry at or after time_stamp is searched
+        auto begin = segments[i]->index;
+        auto end = begin + (last - segments[i]->first_sequence + 1);
+        if ((end - 1)->time_stamp < time_stamp) {
+            continue;
+        }
+        auto it = std::lower_bound(begin, end, time_stamp, [](const journal_index_t& entry, int64_t time_stamp) {
+            return entry.time_stamp < time_stamp;
+        });
+        return segments[i]->first_sequence + (it - begin);
+    }
+    return committed + 1;
+}
+
+uint64_t journal::read(uint64_t from, uint64_t to, const std::function<bool(const uint8_t*, std::size_t)>& on_frame) {
+    from = std::max(from, first_sequence());
+    to = std::min(to, last_sequence());
+
+    // The segment is held while it is read, a roll that deletes it leaves the mapping alone
+    std::shared_ptr<segment_t> segment;
+    uint64_t segment_end = 0;
+    while (from <= to) {
+        if (!segment || from >= segment_end) {
+            std::lock_guard<std::mutex> lk(lock_);
+            auto it = segments_.upper_bound(from);
+            if (it == segments_.begin()) {
+                break;
+            }
+            segment_end = it == segments_.end() ? UINT64_MAX : it->first;
+            segment = std::prev(it)->second;
+        }
+
+        auto& entry = segment->index[from - segment->first_sequence];
+        comm_header_t header;
+        memcpy(&header, segment->log + entry.offset, sizeof(header));
+        if (!on_frame(segment->log + entry.offset, sizeof(header) + header.comm_msg_len)) {
+            break;
+        }
+        ++from;
+    }
+    return from;
+}
+
+void journal::recover() {
+    // Segments are named by their first sequence, the last one goes on where it stopped
+    DIR* dir = opendir(dir_.c_str());
+    ERRNO_ASSERT(dir != nullptr);
+    std::vector<uint64_t> sequences;
+    while (auto entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && isdigit(static_cast<unsigned char>(name[0])) && name.compare(name.size() - 4, 4, ".log") == 0) {
+            sequences.push_back(std::stoull(name.substr(0, name.size() - 4)));
+        }
+    }
+    closedir(dir);
+    if (sequences.empty()) {
+        return;
+    }
+
+    for (auto sequence : sequences) {
+        segments_[sequence] = open_segment(segment_name(sequence), sequence, 0);
+    }
+    active_ = segments_.rbegin()->second;
+
+    // Entries are written in order into a zero filled file, the first empty one ends the segment
+    auto begin = active_->index;
+    auto end = begin + active_->index_capacity;
+    auto it = std::partition_point(begin, end, [](const journal_index_t& entry) { return entry.sequence != 0; });
+    active_->count = it - begin;
+    if (active_->count) {
+        comm_header_t header;
+        memcpy(&header, active_->log + (it - 1)->offset, sizeof(header));
+        active_->offset = (it - 1)->offset + sizeof(header) + header.comm_msg_len;
+    }
+    committed_.store(active_->first_sequence + active_->count - 1);
+}
+
+void journal::roll(uint64_t first_sequence, std::size_t frame_size) {
+    std::shared_ptr<segment_t> segment;
+    {
+        std::lock_guard<std::mutex> lk(spare_->lock);
+        if (spare_->segment && spare_->segment->log_size >= frame_size) {
+            segment.swap(spare_->segment);
+        }
+        preparing_ = spare_->segment || spare_->pending;
+    }
+
+    if (segment) {
+        // The index goes first, a log found without it is recovered as empty.
+        // A segment left over by a publisher that numbered differently is replaced
+        auto name = segment_name(first_sequence);
+        ERRNO_ASSERT(rename((segment->name + ".idx").c_str(), (name + ".idx").c_str()) == 0);
+        ERRNO_ASSERT(rename((segment->name + ".log").c_str(), (name + ".log").c_str()) == 0);
+        segment->name = name;
+        segment->first_sequence = first_sequence;
+    }
+    else {
+        // The first segment, one the worker has not made yet or a frame larger than a spare
+        segment = open_segment(segment_name(first_sequence), first_sequence, std::max<std::size_t>(opt_.segment_size, frame_size));
+        if (segment->index[0].sequence) {
+            // Left over by a publisher that numbered differently, start it afresh
+            memset(segment->index, 0, segment->index_capacity * sizeof(journal_index_t));
+        }
+    }
+
+    std::vector<std::shared_ptr<segment_t>> retired;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        segments_[first_sequence] = segment;
+        active_ = segment;
+        while (opt_.max_segments && segments_.size() > opt_.max_segments) {
+            retired.push_back(std::move(segments_.begin()->second));
+            segments_.erase(segments_.begin());
+        }
+    }
+
+    // Readers still holding a retired segment keep its mapping, the last of them unmaps it
+    if (!retired.empty()) {
+        journal_worker::instance().post([retired = std::move(retired)] {
+            for (auto& segment : retired) {
+                unlink((segment->name + ".log").c_str());
+                unlink((segment->name + ".idx").c_str());
+            }
+        });
+    }
+}
+
+void journal::prepare() {
+    preparing_ = true;
+    {
+        std::lock_guard<std::mutex> lk(spare_->lock);
+        spare_->pending = true;
+    }
+
+    auto spare = spare_;
+    auto name = dir_ + "/" + JOURNAL_SPARE;
+    auto log_size = opt_.segment_size;
+    journal_worker::instance().post([spare, name, log_size] {
+        auto segment = open_segment(name, 0, log_size);
+        if (segment->index[0].sequence) {
+            memset(segment->index, 0, segment->index_capacity * sizeof(journal_index_t));
+        }
+        std::lock_guard<std::mutex> lk(spare->lock);
+        spare->segment = segment;
+        spare->pending = false;
+    });
+}
+
+std::string journal::segment_name(uint64_t first_sequence) {
+    char name[32];
+    snprintf(name, sizeof name, "%020llu", static_cast<unsigned long long>(first_sequence));
+    return dir_ + "/" + name;
+}
+
+std::shared_ptr<journal::segment_t> journal::open_segment(const std::string& name, uint64_t first_sequence, std::size_t log_size) {
+    auto segment = std::make_shared<segment_t>();
+    segment->first_sequence = first_sequence;
+    segment->name = name;
+    segment->log_size = log_size;
+    segment->log = map_file(segment->name + ".log", segment->log_size);
+
+    auto index_size = std::max(segment->log_size / 64, JOURNAL_INDEX_MIN) * sizeof(journal_index_t);
+    segment->index = reinterpret_cast<journal_index_t*>(map_file(segment->name + ".idx", index_size));
+    segment->index_capacity = index_size / sizeof(journal_index_t);
+    return segment;
+}
+
+} /* namespace speed::mq */
\ No newline at end of file
@@ -0,0 +1,90 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <functional>
+#include "spdmq_def.h"
+#include "spdmq_internal_def.h"
+
+namespace speed::mq {
+
+// Append-only log of the frames of one topic. Frames go into memory-mapped segment files preallocated
+// to segment_size, next to each one an index file holds a fixed size entry per sequence.
+// One thread appends, any thread reads what has been committed.
+// The next segment is made ahead and the oldest ones deleted on a worker thread, so a roll only renames files
+class journal {
+private:
+    typedef struct journal_index {
+        uint64_t sequence;   // 0 - not written yet
+        int64_t time_stamp;  // send time of the message
+        uint64_t offset;     // offset of the frame in the segment
+    } journal_index_t;
+
+    typedef struct segment {
+        uint64_t first_sequence = 0;
+        std::string name;               // path of the files without extension
+        uint8_t* log = nullptr;
+        std::size_t log_size = 0;
+        journal_index_t* index = nullptr;
+        std::size_t index_capacity = 0;
+        std::size_t count = 0;          // frames written, used by the writer only
+        std::size_t offset = 0;         // bytes written, used by the writer only
+        ~segment();
+    } segment_t;
+
+    typedef struct spare {
+        std::mutex lock;
+        std::shared_ptr<segment_t> segment; // made ahead under a temporary name, renamed by the roll that takes it
+        bool pending = false;               // the worker is making it
+    } spare_t;
+
+    spdmq_journal_opt_t opt_;
+    std::string dir_;
+    std::mutex lock_;                                         // guards segments_ against a roll
+    std::map<uint64_t, std::shared_ptr<segment_t>> segments_; // first sequence -> segment
+    std::shared_ptr<segment_t> active_;                       // segment appended to
+    std::atomic<uint64_t> committed_ = {0};                   // sequence of the last frame readers may see
+    std::shared_ptr<spare_t> spare_;                          // shared with the worker, which may outlive the journal
+    bool preparing_ = false;                                  // the next segment has been asked for, used by the writer only
+
+public:
+    journal(const spdmq_journal_opt_t& opt, const std::string& topic);
+
+    // The message carries its sequence, consecutive to the previous one
+    void append(const comm_msg_t& msg);
+    uint64_t first_sequence();
+    uint64_t last_sequence();
+    uint64_t sequence_since(int64_t time_stamp);
+
+    // Hands the frames from..to (inclusive, as far as committed) to on_frame until it returns false,
+    // returns the sequence to read next
+    uint64_t read(uint64_t from, uint64_t to, const std::function<bool(const uint8_t*, std::size_t)>& on_frame);
+
+private:
+    void recover();
+    void roll(uint64_t first_sequence, std::size_t frame_size);
+    void prepare();
+    std::string segment_name(uint64_t first_sequence);
+    static std::shared_ptr<segment_t> open_segment(const std::string& name, uint64_t first_sequence, std::size_t log_size);
+};
+
+} /* namespace speed::mq */
\ No newline at end of file
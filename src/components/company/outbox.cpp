@@ -0,0 +1,229 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "outbox.h"
+#include "spdmq_spinlock.hpp"
+
+namespace speed::mq {
+
+wire_frame::wire_frame(const frame_ptr_t& v1, uint32_t topic_id, int64_t epoch, bool checksum, const frame_ptr_t& packed, compression_t codec)
+    : v1_(v1), topic_id_(topic_id), epoch_(epoch), checksum_(checksum), packed_(packed), codec_(codec) {
+}
+
+const frame_ptr_t& wire_frame::v1() const {
+    return v1_;
+}
+
+frame_ptr_t wire_frame::v2() {
+    // Encoded by the first session that needs it, the others wait for it
+    spdmq_spinlock<std::atomic_flag> lk(v2_lock_);
+    if (!v2_) {
+        auto frame = std::make_shared<std::vector<uint8_t>>();
+        comm_frame_view_t view;
+        if (view_comm_frame(v1_->data(), v1_->size(), view)) {
+            encode_comm_frame_v2(view, topic_id_, false, epoch_, checksum_, *frame);
+        }
+        v2_ = frame;
+    }
+    return v2_;
+}
+
+const frame_ptr_t& wire_frame::packed() const {
+    return packed_;
+}
+
+compression_t wire_frame::codec() const {
+    return codec_;
+}
+
+uint32_t wire_frame::topic_id() const {
+    return topic_id_;
+}
+
+bool wire_frame::checksum() const {
+    return checksum_;
+}
+
+int32_t outbox::push(spdmq_socket& socket, spdmq_event& event, int32_t session_id, const wire_frame_ptr_t& wire, std::string_view topic, int64_t deadline, std::size_t hwm) {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (!frames_.empty() && !credited_) {
+        // Expired frames make room before the high-water mark is checked
+        int64_t now = 0;
+        expire(now);
+    }
+    if (version_ < FRAME_VERSION_2) {
+        return put(socket, event, session_id, {wire->v1(), wire, deadline}, topic, hwm);
+    }
+
+    // The name of a topic id goes ahead of its first use in a frame of its own, which is never dropped
+    auto topic_id = wire->topic_id();
+    if (topic_id && (defined_.size() <= topic_id || !defined_[topic_id])) {
+        comm_frame_view_t view;
+        view.msg_type = MESSAGE_TYPE::HEARTBEAT;
+        view.topic = topic;
+        auto define = std::make_shared<std::vector<uint8_t>>();
+        encode_comm_frame_v2(view, topic_id, true, 0, wire->checksum(), *define);
+        auto ret = put(socket, event, session_id, {define, nullptr, 0}, {}, 0);
+        if (ret != SPDMQ_CODE_OK) {
+            return ret;
+        }
+        defined_.resize(std::max<std::size_t>(defined_.size(), topic_id + 1));
+        defined_[topic_id] = true;
+    }
+    if (wire->packed() && (codecs_ & (1u << static_cast<uint32_t>(wire->codec())))) {
+        return put(socket, event, session_id, {wire->packed(), wire, deadline}, topic, hwm);
+    }
+    return put(socket, event, session_id, {wire->v2(), wire, deadline}, topic, hwm);
+}
+
+int32_t outbox::upgrade(spdmq_socket& socket, spdmq_event& event, int32_t session_id, const frame_ptr_t& control, uint32_t codecs) {
+    // The control frame is the last one in v1, the frames queued behind it are in v2
+    std::lock_guard<std::mutex> lk(lock_);
+    auto ret = put(socket, event, session_id, {control, nullptr, 0}, {}, 0);
+    version_ = FRAME_VERSION_2;
+    codecs_ = codecs;
+    switched_at_ = popped_ + frames_.size();
+    return ret;
+}
+
+int32_t outbox::put(spdmq_socket& socket, spdmq_event& event, int32_t session_id, queued_frame_t&& frame, std::string_view topic, std::size_t hwm) {
+    if (!frames_.empty()) {
+        // A backed up session keeps only the latest frame of a conflated topic
+        if (replace(frame, topic)) {
+            return SPDMQ_CODE_OK;
+        }
+        if (hwm && frames_.size() >= hwm) {
+            return SPDMQ_CODE_SEND_FAILED_HWM;
+        }
+        enqueue(std::move(frame), topic);
+        return SPDMQ_CODE_OK;
+    }
+
+    auto ret = socket.write_data(session_id, *frame.frame, 0);
+    if (ret >= 0 && static_cast<std::size_t>(ret) == frame.frame->size()) {
+        return SPDMQ_CODE_OK;
+    }
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        return SPDMQ_CODE_CONNECT_TO_BROKEN;
+    }
+
+    // The socket is full, keep the rest and wait until it becomes writable,
+    // armed under the lock so that it can not race with the flush that disarms it
+    offset_ = ret > 0 ? ret : 0;
+    enqueue(std::move(frame), topic);
+    event.event_writable(session_id, true);
+    return SPDMQ_CODE_OK;
+}
+
+int32_t outbox::flush(spdmq_socket& socket, spdmq_event& event, int32_t session_id) {
+    std::lock_guard<std::mutex> lk(lock_);
+    int64_t now = 0;
+    while (!frames_.empty()) {
+        if (!credited_) {
+            expire(now);
+        }
+        if (frames_.empty()) {
+            break;
+        }
+        auto& frame = *frames_.front().frame;
+        auto ret = socket.write_data(session_id, frame, offset_);
+        if (ret < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? SPDMQ_CODE_OK : SPDMQ_CODE_CONNECT_TO_BROKEN;
+        }
+        offset_ += ret;
+        if (offset_ < frame.size()) {
+            continue;
+        }
+        offset_ = 0;
+        frames_.pop_front();
+        ++popped_;
+        size_.store(frames_.size());
+    }
+    event.event_writable(session_id, false);
+    return SPDMQ_CODE_OK;
+}
+
+void outbox::conflate(const std::string& topic) {
+    std::lock_guard<std::mutex> lk(lock_);
+    conflate_topics_.insert(topic);
+}
+
+void outbox::credited() {
+    // Credit already bounds what is queued, and the subscriber gives back the credit of what it drops itself
+    std::lock_guard<std::mutex> lk(lock_);
+    credited_ = true;
+}
+
+std::size_t outbox::size() const {
+    return size_.load();
+}
+
+bool outbox::replace(queued_frame_t& frame, std::string_view topic) {
+    if (conflate_topics_.empty() || topic.empty() || credited_) {
+        return false;
+    }
+    auto it = latest_map_.find(topic);
+    if (it == latest_map_.end() || it->second < popped_) {
+        return false;
+    }
+
+    // The first frame may be partly written already, its bytes can no longer change
+    auto index = it->second - popped_;
+    if (index == 0 && offset_ > 0) {
+        return false;
+    }
+    // A frame queued before the switch stays in v1 in its place
+    if (it->second < switched_at_ && frame.wire) {
+        frame.frame = frame.wire->v1();
+    }
+    frames_[index] = std::move(frame);
+    return true;
+}
+
+void outbox::enqueue(queued_frame_t&& frame, std::string_view topic) {
+    if (!conflate_topics_.empty() && conflate_topics_.find(topic) != conflate_topics_.end()) {
+        auto it = latest_map_.find(topic);
+        if (it == latest_map_.end()) {
+            it = latest_map_.emplace(std::string(topic), 0).first;
+        }
+        it->second = popped_ + frames_.size();
+    }
+    frames_.push_back(std::move(frame));
+    size_.store(frames_.size());
+}
+
+void outbox::expire(int64_t& now) {
+    // In queue order past a partly written first frame, the clock is read once and only if a deadline is met
+    std::size_t first = offset_ > 0 ? 1 : 0;
+    while (frames_.size() > first && frames_[first].deadline) {
+        now = now ? now : now_usecs_timestamp();
+        if (frames_[first].deadline >= now) {
+            break;
+        }
+        if (on_expire) {
+            on_expire(*frames_[first].wire->v1());
+        }
+        // The partly written frame takes the place of the expired one, so the sequences behind it stay as they are
+        if (first) {
+            frames_[1] = std::move(frames_[0]);
+        }
+        frames_.pop_front();
+        ++popped_;
+    }
+    size_.store(frames_.size());
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,105 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <set>
+#include <map>
+#include <mutex>
+#include <deque>
+#include <string_view>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "spdmq_event.h"
+#include "spdmq_socket.h"
+#include "spdmq_internal_def.h"
+
+namespace speed::mq {
+
+using frame_ptr_t = std::shared_ptr<const std::vector<uint8_t>>;
+
+// A frame in the v1 format, with its v2 encoding made on first use and shared by the sessions that speak v2,
+// and the v2 encoding with a compressed payload for the sessions that can decompress it. Both end with a checksum when asked.
+class wire_frame {
+private:
+    frame_ptr_t v1_;
+    uint32_t topic_id_; // id of the topic on v2 sessions, 0 - the topic goes as a string
+    int64_t epoch_;     // the timestamp of v2 counts from it
+    bool checksum_;     // v2 encodings end with a CRC32C
+    std::atomic_flag v2_lock_ = ATOMIC_FLAG_INIT;
+    frame_ptr_t v2_;    // guarded by v2_lock_, set once
+    frame_ptr_t packed_;
+    compression_t codec_;
+
+public:
+    wire_frame(const frame_ptr_t& v1, uint32_t topic_id, int64_t epoch, bool checksum, const frame_ptr_t& packed = nullptr, compression_t codec = COMPRESSION::NONE);
+    const frame_ptr_t& v1() const;
+    frame_ptr_t v2();
+    const frame_ptr_t& packed() const;
+    compression_t codec() const;
+    uint32_t topic_id() const;
+    bool checksum() const;
+};
+
+using wire_frame_ptr_t = std::shared_ptr<wire_frame>;
+
+// Outbound queue of one session. Frames are written at once while the socket takes them,
+// the rest waits here and is flushed by the event thread when the socket becomes writable.
+// Waiting frames whose time to live runs out are dropped before they are started,
+// except on a session under credit flow control, where a dropped frame would take its credit with it.
+// Frames are written in v1 until upgrade, after that in v2, with each topic id defined once before its first use.
+class outbox {
+private:
+    typedef struct queued_frame {
+        frame_ptr_t frame;     // bytes written to the socket
+        wire_frame_ptr_t wire; // the message it encodes, none for the frames of the outbox itself
+        int64_t deadline;      // time the frame expires at, 0 - never
+    } queued_frame_t;
+
+    std::mutex lock_;
+    std::deque<queued_frame_t> frames_;   // frames waiting for the socket, the first one may be partly written
+    std::size_t offset_ = 0;              // bytes of the first frame already written
+    std::atomic<std::size_t> size_ = {0}; // frames waiting, read without the lock
+    std::size_t popped_ = 0;              // frames written so far, the sequence of frames_.front()
+    std::set<std::string, std::less<>> conflate_topics_;          // topics of which only the latest frame is kept
+    std::map<std::string, std::size_t, std::less<>> latest_map_; // conflated topic -> sequence of its queued frame
+    uint8_t version_ = FRAME_VERSION_1;   // frame format written
+    std::size_t switched_at_ = 0;         // sequence of the first frame queued in version_
+    std::vector<bool> defined_;           // topic ids the peer knows the name of
+    uint32_t codecs_ = 0;                 // codecs the peer can decompress, see frame_control_t::features
+    bool credited_ = false;               // the peer grants credit, queued frames are neither replaced nor expired
+
+public:
+    std::function<void(const std::vector<uint8_t>&)> on_expire; // called under the lock with the v1 frame dropped for its time to live
+
+public:
+    int32_t push(spdmq_socket& socket, spdmq_event& event, int32_t session_id, const wire_frame_ptr_t& wire, std::string_view topic, int64_t deadline, std::size_t hwm);
+    int32_t upgrade(spdmq_socket& socket, spdmq_event& event, int32_t session_id, const frame_ptr_t& control, uint32_t codecs);
+    int32_t flush(spdmq_socket& socket, spdmq_event& event, int32_t session_id);
+    void conflate(const std::string& topic);
+    void credited();
+    std::size_t size() const;
+
+private:
+    int32_t put(spdmq_socket& socket, spdmq_event& event, int32_t session_id, queued_frame_t&& frame, std::string_view topic, std::size_t hwm);
+    bool replace(queued_frame_t& frame, std::string_view topic);
+    void enqueue(queued_frame_t&& frame, std::string_view topic);
+    void expire(int64_t& now);
+};
+
+} /* namespace speed::mq */
@@ -15,132 +15,797 @@
 */
 
 #include "porter.h"
+#include "spdmq_logger.hpp"
 #include <cstdio>
+#include <cstring>
 
 namespace speed::mq {
 
+// Only data messages replace each other in a conflated outbox
+static std::string_view conflate_key(const comm_msg_t& comm_msg) {
+    return comm_msg.msg_type == MESSAGE_TYPE::DATA ? std::string_view(comm_msg.topic) : std::string_view();
+}
+
 porter::porter (spdmq_ctx_t& ctx,
                 std::shared_ptr<spdmq_event> spdmq_event_ptr, 
-                std::shared_ptr<spdmq_socket> spdmq_socket_ptr,
                 std::shared_ptr<storeroom> storeroom_ptr)
     : ctx_(ctx),
+      runtime_ (ctx),
       spdmq_event_ptr_ (spdmq_event_ptr), 
-      spdmq_socket_ptr_ (spdmq_socket_ptr),
-      storeroom_ptr_ (storeroom_ptr)
+      storeroom_ptr_ (storeroom_ptr),
+      epoch_ (now_usecs_timestamp()),
+      dispatch_inline_ (!ctx.dispatch_threads() || ctx.external_loop()),
+      external_loop_ (ctx.external_loop())
 {
+        if (dispatch_inline_) {
+            return;
+        }
+
+        // More threads take the messages from this one by their keys, it keeps feeding them in the order of the receive queue
+        if (ctx.dispatch_threads() > 1) {
+            dispatch_pool_ptr_ = std::make_shared<dispatch_pool>(ctx.dispatch_threads(), ctx.dispatch_key(), ctx.queue_size(), [this](comm_msg_t&& comm_msg) {
+                on_recv(std::move(comm_msg));
+            });
+        }
+
         std::thread([this] {
             while (true) {
                 std::unique_lock<std::mutex> lk(lock_);
-                cv_.wait(lk, [&] { return !queue().empty() && on_recv; });
+                cv_.wait(lk, [&] { return !storeroom_ptr_->empty() && on_recv; });
                 
                 comm_msg_t comm_msg;
-                queue().pop(comm_msg);
-                on_recv(std::move(comm_msg));
+                std::vector<comm_msg_t> expired;
+                auto popped = storeroom_ptr_->pop(comm_msg, expired);
+                lk.unlock();
+                dropped(expired);
+                if (!popped) {
+                    continue;
+                }
+                if (dispatch_pool_ptr_) {
+                    dispatch_pool_ptr_->dispatch(std::move(comm_msg));
+                }
+                else {
+                    on_recv(std::move(comm_msg));
+                    dispatched_.fetch_add(1, std::memory_order_relaxed);
+                }
             }
         }).detach();
 }
 
 int32_t porter::send_msg(int32_t session_id, const comm_msg_t& comm_msg) {
-    // printf("comm_msg.payload size:%lu\n", comm_msg.payload.size());
-    return on_send_msg(session_id, comm_msg);
+    if (expire(comm_msg.deadline(), comm_msg.topic)) {
+        return SPDMQ_CODE_SEND_FAILED_EXPIRED;
+    }
+    if (is_inproc_session(session_id)) {
+        return on_send_inproc(session_id, std::make_shared<comm_msg_t>(comm_msg));
+    }
+
+    auto frame = std::make_shared<std::vector<uint8_t>>();
+    serialize_comm_frame(comm_msg, *frame);
+    std::string_view topic = conflate_key(comm_msg);
+    return on_send_msg(session_id, wire_of(frame, topic), topic, comm_msg.deadline());
 }
 
-int32_t porter::recv_msg(int32_t session_id, comm_msg_t& comm_msg, time_msec_t time_out) {
-    
-    // The received callback has intercepted the data
+int32_t porter::send_msg(int32_t session_id, comm_msg_t&& comm_msg) {
+    // Moved as it is to an inproc peer
+    if (is_inproc_session(session_id)) {
+        if (expire(comm_msg.deadline(), comm_msg.topic)) {
+            return SPDMQ_CODE_SEND_FAILED_EXPIRED;
+        }
+        return on_send_inproc(session_id, std::make_shared<comm_msg_t>(std::move(comm_msg)));
+    }
+    return send_msg(session_id, static_cast<const comm_msg_t&>(comm_msg));
+}
+
+int32_t porter::send_msg(const std::set<int32_t>& session_ids, const comm_msg_t& comm_msg) {
+    if (session_ids.empty()) {
+        return SPDMQ_CODE_OK;
+    }
+
+    // inproc peers share one copy of the message
+    if (is_inproc_session(*session_ids.begin())) {
+        return send_msg(session_ids, comm_msg_t(comm_msg));
+    }
+
+    // An expired message is not fanned out at all
+    if (expire(comm_msg.deadline(), comm_msg.topic)) {
+        return SPDMQ_CODE_SEND_FAILED_EXPIRED;
+    }
+
+    // Encode once, then fan out the same frame to every session whatever its transport,
+    // a session above its high-water mark misses this one without holding up the others
+    auto frame = std::make_shared<std::vector<uint8_t>>();
+    serialize_comm_frame(comm_msg, *frame);
+    std::string_view topic = conflate_key(comm_msg);
+    auto wire = wire_of(frame, topic);
+    for (auto session_id : session_ids) {
+        on_send_msg(session_id, wire, topic, comm_msg.deadline());
+    }
+    return SPDMQ_CODE_OK;
+}
+
+int32_t porter::send_msg(const std::set<int32_t>& session_ids, comm_msg_t&& comm_msg, std::set<int32_t>* refused) {
+    // refused - the sessions the message was not queued for, such as those at their high-water mark
+    if (session_ids.empty()) {
+        return SPDMQ_CODE_OK;
+    }
+    auto deadline = comm_msg.deadline();
+    if (expire(deadline, comm_msg.topic)) {
+        if (refused) {
+            *refused = session_ids;
+        }
+        return SPDMQ_CODE_SEND_FAILED_EXPIRED;
+    }
+
+    // inproc ids are negative and come first, the frame is encoded before the message is moved to them
+    std::string_view topic = conflate_key(comm_msg);
+    wire_frame_ptr_t wire;
+    if (!is_inproc_session(*session_ids.rbegin())) {
+        auto frame = std::make_shared<std::vector<uint8_t>>();
+        serialize_comm_frame(comm_msg, *frame);
+        wire = wire_of(frame, topic);
+    }
+
+    std::shared_ptr<comm_msg_t> shared_msg;
+    for (auto session_id : session_ids) {
+        int32_t ret;
+        if (!is_inproc_session(session_id)) {
+            ret = on_send_msg(session_id, wire, topic, deadline);
+        }
+        else {
+            if (!shared_msg) {
+                shared_msg = std::make_shared<comm_msg_t>(std::move(comm_msg));
+            }
+            ret = on_send_inproc(session_id, shared_msg);
+        }
+        if (ret != SPDMQ_CODE_OK && refused) {
+            refused->insert(session_id);
+        }
+    }
+    return SPDMQ_CODE_OK;
+}
+
+int32_t porter::send_frame(const std::set<int32_t>& session_ids, const frame_ptr_t& frame, std::string_view topic, std::set<int32_t>* refused) {
+    // Relayed and replayed frames may have expired on the way
+    auto deadline = peek_comm_frame_deadline(*frame);
+    if (expire(deadline, topic)) {
+        if (refused) {
+            *refused = session_ids;
+        }
+        return SPDMQ_CODE_SEND_FAILED_EXPIRED;
+    }
+
+    std::shared_ptr<comm_msg_t> shared_msg;
+    wire_frame_ptr_t wire;
+    for (auto session_id : session_ids) {
+        int32_t ret;
+        if (!is_inproc_session(session_id)) {
+            if (!wire) {
+                wire = wire_of(frame, topic);
+            }
+            ret = on_send_msg(session_id, wire, topic, deadline);
+        }
+        else {
+            // inproc peers take messages, the frame is decoded once for all of them
+            if (!shared_msg) {
+                shared_msg = std::make_shared<comm_msg_t>();
+                deserialize_comm_msg_t(frame->data() + sizeof(comm_header_t), frame->size() - sizeof(comm_header_t), *shared_msg);
+            }
+            ret = on_send_inproc(session_id, shared_msg);
+        }
+        if (ret != SPDMQ_CODE_OK && refused) {
+            refused->insert(session_id);
+        }
+    }
+    return SPDMQ_CODE_OK;
+}
+
+int32_t porter::recv_msg(comm_msg_t& comm_msg, time_msec_t time_out) {
+    return recv_msg(time_out, [&](std::vector<comm_msg_t>& expired) { return storeroom_ptr_->pop(comm_msg, expired); });
+}
+
+int32_t porter::recv_msg(comm_msg_t& comm_msg, const std::string& topic, time_msec_t time_out) {
+    return recv_msg(time_out, [&](std::vector<comm_msg_t>& expired) { return storeroom_ptr_->pop(comm_msg, topic, expired); });
+}
+
+bool porter::wait_recv(spdmq_waiter_t& waiter) {
     if (on_recv) {
-        return SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA;
+        waiter.code = SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA;
+        return false;
+    }
+
+    // Parked under the lock messages are queued with, so none can arrive unnoticed in between.
+    // Once parked the waiter belongs to the event thread, it may be resumed before this returns
+    comm_msg_t comm_msg;
+    std::vector<comm_msg_t> expired;
+    bool popped;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        popped = pop_for(waiter, comm_msg, expired);
+        if (!popped) {
+            recv_waiters_.push_back(&waiter);
+        }
+    }
+    dropped(expired);
+    if (popped) {
+        handoff(waiter, comm_msg);
+    }
+    return !popped;
+}
+
+bool porter::wait_writable(spdmq_waiter_t& waiter) {
+    std::lock_guard<std::mutex> lk(lock_);
+    if (writable()) {
+        waiter.code = SPDMQ_CODE_OK;
+        return false;
+    }
+    write_waiters_.push_back(&waiter);
+    return true;
+}
+
+bool porter::wait_online(spdmq_waiter_t& waiter, std::shared_ptr<spdmq_socket> spdmq_socket_ptr) {
+    // Parked before connecting, so the session can not come online unnoticed
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        online_waiters_.emplace(spdmq_socket_ptr.get(), &waiter);
+    }
+    if (on_reconnect(spdmq_socket_ptr)) {
+        return true;
     }
 
-    if (queue().empty()) {
-        // non-blocking mode
-        if (time_out < 0) {
-            return SPDMQ_CODE_NO_DATA;
+    // Given up at once, nothing else has seen the waiter
+    std::lock_guard<std::mutex> lk(lock_);
+    auto range = online_waiters_.equal_range(spdmq_socket_ptr.get());
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == &waiter) {
+            online_waiters_.erase(it);
+            break;
         }
+    }
+    waiter.code = SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET;
+    return false;
+}
+
+void porter::wait_online(spdmq_waiter_t& waiter, const std::string& name) {
+    // An inproc:// connect waits for its bind, it is never given up
+    std::lock_guard<std::mutex> lk(lock_);
+    inproc_waiters_.emplace(name, &waiter);
+}
+
+std::map<std::string, spdmq_topic_stat_t> porter::topic_stats() {
+    return storeroom_ptr_->topic_stats();
+}
+
+spdmq_checksum_stat_t porter::checksum_stats() {
+    spdmq_checksum_stat_t stat;
+    stat.frames = checksum_frames_.load(std::memory_order_relaxed);
+    stat.bytes = checksum_bytes_.load(std::memory_order_relaxed);
+    stat.mismatches = checksum_mismatches_.load(std::memory_order_relaxed);
+    return stat;
+}
+
+std::vector<spdmq_dispatch_stat_t> porter::dispatch_stats() {
+    if (dispatch_pool_ptr_) {
+        return dispatch_pool_ptr_->dispatch_stats();
+    }
+
+    // The one thread takes the messages straight off the receive queue
+    spdmq_dispatch_stat_t stat;
+    if (!dispatch_inline_ && on_recv) {
+        stat.queued = storeroom_ptr_->size();
+    }
+    stat.dispatched = dispatched_.load(std::memory_order_relaxed);
+    return {stat};
+}
+
+void porter::missed(const std::string& topic, uint64_t count) {
+    storeroom_ptr_->missed(topic, count);
+}
 
-        // blocking mode
+void porter::expired(const std::string& topic, uint64_t count) {
+    storeroom_ptr_->expired(topic, count);
+}
+
+int32_t porter::recv_msg(time_msec_t time_out, const std::function<bool(std::vector<comm_msg_t>&)>& pop) {
+    // The received callback has intercepted the data
+    if (on_recv) {
+        return SPDMQ_CODE_RECV_CB_INTERCEPTED_DATA;
+    }
+
+    // Expired messages skipped on the way are handed to on_drop once the wait is over
+    std::vector<comm_msg_t> expired;
+    auto popped = pop(expired);
+    if (!popped && time_out >= 0) {
+        // Messages are stored under the same lock, so a notification can not slip in between the check and the wait
+        std::unique_lock<std::mutex> lk(lock_);
+        auto ready = [&] { return pop(expired); };
         if (time_out == 0) {
-            std::unique_lock<std::mutex> lk(lock_);
-            cv_.wait(lk, [&] { return !queue().empty(); });
+            cv_.wait(lk, ready);
+            popped = true;
         }
-        else if (time_out > 0) {
-            std::unique_lock<std::mutex> lk(lock_);
+        else {
             using namespace std::chrono_literals;
-            if (!cv_.wait_for(lk, time_out * 1ms,[&] { return !queue().empty(); })) {
-                return SPDMQ_CODE_NO_DATA;
-            }
+            popped = cv_.wait_for(lk, time_out * 1ms, ready);
         }
     }
+    dropped(expired);
+    return popped ? SPDMQ_CODE_OK : SPDMQ_CODE_NO_DATA;
+}
 
-    queue().pop(comm_msg);
-    // printf("pop comm_msg.payload size :%lu\n", comm_msg.payload.size());
+bool porter::pop_for(const spdmq_waiter_t& waiter, comm_msg_t& comm_msg, std::vector<comm_msg_t>& expired) {
+    if (waiter.topic.empty()) {
+        return storeroom_ptr_->pop(comm_msg, expired);
+    }
+    return storeroom_ptr_->pop(comm_msg, waiter.topic, expired);
+}
 
-    return SPDMQ_CODE_OK;
+void porter::handoff(spdmq_waiter_t& waiter, comm_msg_t& comm_msg) {
+    if (on_handoff) {
+        on_handoff(comm_msg);
+    }
+    comm_msg_to_spdmq_msg(comm_msg, waiter.msg);
+    waiter.code = SPDMQ_CODE_OK;
 }
 
-void porter::on_reconnect() {
-    std::thread([this] {
+void porter::resume(spdmq_waiter_t& waiter) {
+    auto& executor = ctx().executor();
+    if (executor) {
+        executor(waiter.resume, waiter.context);
+    }
+    else {
+        waiter.resume(waiter.context);
+    }
+}
+
+void porter::resume_all(std::vector<spdmq_waiter_t*>& waiters) {
+    for (auto waiter : waiters) {
+        waiter->code = SPDMQ_CODE_OK;
+        resume(*waiter);
+    }
+}
+
+bool porter::writable() {
+    // true - no outbound queue is at the high-water mark
+    auto hwm = runtime_.send_hwm;
+    if (!hwm) {
+        return true;
+    }
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    for (auto& outbox : outbox_map_) {
+        if (outbox.second->size() >= hwm) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void porter::wake_writers() {
+    std::vector<spdmq_waiter_t*> waiters;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        if (write_waiters_.empty() || !writable()) {
+            return;
+        }
+        waiters.swap(write_waiters_);
+    }
+    resume_all(waiters);
+}
+
+std::size_t porter::outbound(int32_t session_id) {
+    if (is_inproc_session(session_id)) {
+        inproc_session_t inproc;
+        return inproc_of(session_id, inproc) ? inproc.out->size() : 0;
+    }
+
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    auto it = outbox_map_.find(session_id);
+    return it == outbox_map_.end() ? 0 : it->second->size();
+}
+
+void porter::conflate(int32_t session_id, const std::string& topic) {
+    // The ring of an inproc peer is lock-free and cannot replace a queued message, only socket sessions conflate
+    if (is_inproc_session(session_id) || topic.empty()) {
+        return;
+    }
+    std::shared_ptr<spdmq_socket> spdmq_socket_ptr;
+    auto outbox_ptr = outbox_of(session_id, spdmq_socket_ptr);
+    if (outbox_ptr) {
+        outbox_ptr->conflate(topic);
+    }
+}
+
+void porter::credited(int32_t session_id) {
+    // What an inproc peer is sent can not be dropped on the way, it is refused at once when its ring is full
+    if (is_inproc_session(session_id)) {
+        return;
+    }
+    std::shared_ptr<spdmq_socket> spdmq_socket_ptr;
+    auto outbox_ptr = outbox_of(session_id, spdmq_socket_ptr);
+    if (outbox_ptr) {
+        outbox_ptr->credited();
+    }
+}
+
+std::size_t porter::queued() {
+    return storeroom_ptr_->size();
+}
+
+bool porter::outgoing(int32_t session_id) {
+    if (is_inproc_session(session_id)) {
+        inproc_session_t inproc;
+        return inproc_of(session_id, inproc) && inproc.outgoing;
+    }
+
+    auto spdmq_socket_ptr = socket_of(session_id);
+    return spdmq_socket_ptr && spdmq_socket_ptr->socket_fd() == session_id;
+}
+
+std::string porter::endpoint(int32_t session_id) {
+    // The address a session was connected to, it stays the same when the session reconnects
+    auto spdmq_socket_ptr = is_inproc_session(session_id) ? nullptr : socket_of(session_id);
+    if (!spdmq_socket_ptr) {
+        return std::to_string(session_id);
+    }
+    auto& url_parse = spdmq_socket_ptr->url_parse();
+    return url_parse.ip.empty() ? url_parse.address : url_parse.ip + ":" + std::to_string(url_parse.port);
+}
+
+void porter::wake_at(std::chrono::steady_clock::time_point time_point) {
+    spdmq_event_ptr_->event_deadline(std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count());
+}
+
+void porter::add_socket(fd_t fd, std::shared_ptr<spdmq_socket> spdmq_socket_ptr) {
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    socket_map_[fd] = spdmq_socket_ptr;
+}
+
+std::shared_ptr<inproc_pipe> porter::open_inproc() {
+    // Sized by the high-water mark of the writing side
+    return std::make_shared<inproc_pipe>(runtime_.send_hwm ? runtime_.send_hwm : INPROC_RING_SIZE);
+}
+
+int32_t porter::add_inproc(std::shared_ptr<inproc_pipe> in, std::shared_ptr<inproc_pipe> out, bool outgoing, const std::string& name) {
+    auto session_id = inproc_registry::instance()->next_session_id();
+    in->notify([event = spdmq_event_ptr_, session_id] {
+        event->normal_event({session_id, EVENT::READ});
+    });
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    inproc_map_[session_id] = {in, out, outgoing, name};
+    return session_id;
+}
+
+void porter::online_inproc(int32_t session_id) {
+    spdmq_event_ptr_->urgent_event({session_id, EVENT::CONNECTED});
+}
+
+bool porter::on_reconnect(std::shared_ptr<spdmq_socket> spdmq_socket_ptr) {
+    // The thread of the application does not wait, on_tick tries again, false - given up at once
+    if (external_loop_) {
+        if (connect_once(spdmq_socket_ptr)) {
+            return true;
+        }
+        if (!runtime_.reconnect_interval) {
+            return false;
+        }
+        reconnects_.emplace_back(spdmq_clock::instance().mono_nsecs() / 1000000 + runtime_.reconnect_interval, spdmq_socket_ptr);
+        return true;
+    }
+
+    std::thread([this, spdmq_socket_ptr] {
         while (true) {
-            if (!spdmq_socket_ptr_->connect()) {
-                // Add socket fd to event loop
-                spdmq_event_ptr_->event_add(spdmq_socket_ptr_->socket_fd());
-                // printf("connect success, spdmq_socket_ptr_->socket_fd:%d\n", spdmq_socket_ptr_->socket_fd());
-
-                // Add connection events to the event loop
-                // printf("spdmq_event_ptr_->urgent_event\n");
-                spdmq_event_ptr_->urgent_event({spdmq_socket_ptr_->socket_fd(), EVENT::CONNECTED});
+            if (connect_once(spdmq_socket_ptr)) {
                 break;
             }
-            // printf("reconnect_interval:%d\n", ctx().reconnect_interval());
-            if (ctx().reconnect_interval() == 0) {
+            if (runtime_.reconnect_interval == 0) {
+                give_up(spdmq_socket_ptr.get());
                 break;
             }
+            LOGD_RATE(1, "connect to %s failed, retry every %u ms", spdmq_socket_ptr->url_parse().address.c_str(), runtime_.reconnect_interval);
 
-            sleep_ms(ctx().reconnect_interval());
+            sleep_ms(runtime_.reconnect_interval);
         }
     }).detach();
+    return true;
+}
+
+bool porter::connect_once(const std::shared_ptr<spdmq_socket>& spdmq_socket_ptr) {
+    // The thread of the application does not wait for the handshake either, connect_done finishes it
+    auto fd = spdmq_socket_ptr->socket_fd();
+    if (external_loop_) {
+        spdmq_socket_ptr->set_nonblocking(fd);
+    }
+    if (spdmq_socket_ptr->connect()) {
+        if (!external_loop_ || errno != EINPROGRESS) {
+            return false;
+        }
+        connecting_[fd] = spdmq_socket_ptr;
+        spdmq_event_ptr_->event_add(fd);
+        spdmq_event_ptr_->event_writable(fd, true);
+        return true;
+    }
+    add_socket(spdmq_socket_ptr->socket_fd(), spdmq_socket_ptr);
+
+    // Add socket fd to event loop
+    spdmq_event_ptr_->event_add(spdmq_socket_ptr->socket_fd());
+
+    // Add connection events to the event loop
+    spdmq_event_ptr_->urgent_event({spdmq_socket_ptr->socket_fd(), EVENT::CONNECTED});
+    return true;
+}
+
+void porter::connect_done(fd_t fd) {
+    auto spdmq_socket_ptr = connecting_[fd];
+    connecting_.erase(fd);
+    int32_t error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        error = errno;
+    }
+
+    // Tried again like a connect that failed at once
+    if (error) {
+        LOGD_RATE(1, "connect to %s failed: %s", spdmq_socket_ptr->url_parse().address.c_str(), std::strerror(error));
+        spdmq_event_ptr_->event_del(fd);
+        if (runtime_.reconnect_interval) {
+            reconnects_.emplace_back(spdmq_clock::instance().mono_nsecs() / 1000000 + runtime_.reconnect_interval, spdmq_socket_ptr);
+        }
+        else {
+            give_up(spdmq_socket_ptr.get());
+        }
+        return;
+    }
+    spdmq_event_ptr_->event_writable(fd, false);
+    add_socket(fd, spdmq_socket_ptr);
+    spdmq_event_ptr_->urgent_event({fd, EVENT::CONNECTED});
+}
+
+void porter::on_tick() {
+    // The timer ticks as often as the shortest interval, a tick a little early still counts
+    auto now = spdmq_clock::instance().mono_nsecs() / 1000000;
+    auto heartbeat_interval = static_cast<int64_t>(runtime_.heartbeat);
+    if (heartbeat_interval && now - heart_sent_ >= heartbeat_interval - heartbeat_interval / 4) {
+        heart_sent_ = now;
+        for (auto& heart : heart_map_) {
+            heartbeat(heart.second);
+        }
+    }
+
+    auto slack = static_cast<int64_t>(runtime_.reconnect_interval / 4);
+    std::vector<std::pair<int64_t, std::shared_ptr<spdmq_socket>>> reconnects;
+    reconnects.swap(reconnects_);
+    for (auto& reconnect : reconnects) {
+        if (reconnect.first - slack > now) {
+            reconnects_.push_back(std::move(reconnect));
+            continue;
+        }
+        on_reconnect(reconnect.second);
+    }
+
+    if (on_timer) {
+        on_timer();
+    }
 }
 
 void porter::on_read(int32_t session_id) {
-    // printf("porter::on_read\n");
+    if (is_inproc_session(session_id)) {
+        on_read_inproc(session_id);
+        return;
+    }
+    // A connect that failed may be reported as readable only
+    if (connecting_.count(session_id)) {
+        connect_done(session_id);
+        return;
+    }
+
+    auto spdmq_socket_ptr = socket_of(session_id);
+    if (!spdmq_socket_ptr) {
+        return;
+    }
+
+    auto wire_it = wire_map_.find(session_id);
+    if (wire_it == wire_map_.end()) {
+        wire_it = wire_map_.emplace(session_id, wire_state_t()).first;
+        wire_it->second.local = spdmq_socket_ptr->same_host(session_id);
+    }
+    auto& wire = wire_it->second;
     while (true) {
-        comm_header header;
-        std::vector<uint8_t> body;
-        auto rc = spdmq_socket_ptr_->read_data(session_id, header, body);
-        // printf("rc:%d\n", rc);
+        std::vector<uint8_t> frame;
+        auto rc = spdmq_socket_ptr->read_data(session_id, frame);
         if (rc <= 0) {
-            // printf("rc:%d, error msg:%s\n", rc, std::strerror(errno));
-            // spdmq_event_ptr_->event_del(spdmq_socket_ptr_->socket_fd());
-            // spdmq_event_ptr_->urgent_event({spdmq_socket_ptr_->socket_fd(), EVENT::DISCONNECT});
+            // The peer has closed the connection
+            if (rc == 0) {
+                spdmq_event_ptr_->urgent_event({session_id, EVENT::DISCONNECT});
+            }
             return;
         }
-        // printf("rc:%d\n", rc);
 
-        // Deserialize comm_msg_t
         comm_msg_t comm_msg;
-        deserialize_comm_msg_t(body, comm_msg);
+        if (wire.version >= FRAME_VERSION_2) {
+            // A corrupt frame is dropped, its length was right so the frames after it are read as usual
+            std::size_t size = rc;
+            if (!verify(session_id, frame.data(), size)) {
+                continue;
+            }
+
+            // A frame that can not be decoded leaves the rest of the session undecodable too
+            frame_compression_t compression;
+            if (!decode_comm_frame_v2(frame.data(), size, wire.epoch, wire.topics, comm_msg, compression)) {
+                spdmq_event_ptr_->urgent_event({session_id, EVENT::DISCONNECT});
+                return;
+            }
+            // The monotonic clock of another host means nothing here, time_cost falls back to the wall clock
+            if (!wire.local) {
+                comm_msg.mono_time_stamp = 0;
+            }
+
+            // A payload that does not decompress is dropped, it still counts as consumed for flow control.
+            // The sender charged the credit with the raw size, which is only a number here and never allocated
+            if (compression.codec != COMPRESSION::NONE && !unpack(comm_msg, compression)) {
+                if (on_drop) {
+                    comm_msg.session_id = session_id;
+                    comm_msg.payload.clear();
+                    on_drop(comm_msg, compression.raw_size);
+                }
+                continue;
+            }
+        }
+        else {
+            // Cleared in place, 0 stands for no stamp
+            auto mono_stamp = wire.local ? nullptr : comm_frame_extension(frame.data(), frame.size(), FRAME_EXTENSION::MONO_STAMP);
+            if (mono_stamp) {
+                std::memset(mono_stamp, 0, sizeof(comm_msg_t::mono_time_stamp));
+            }
+
+            // Relayed by the mode as it is, such as the data of a proxy
+            if (on_frame && on_frame(session_id, frame)) {
+                continue;
+            }
+
+            // Deserialize comm_msg_t
+            deserialize_comm_msg_t(frame.data() + sizeof(comm_header_t), rc, comm_msg);
+        }
         comm_msg.session_id = session_id;
-        // printf("comm_msg.payload size :%lu\n", comm_msg.payload.size());
 
-        // Update heartbeat status
+        // Update heartbeat status, only accepted sessions are watched
         if (MESSAGE_TYPE::HEARTBEAT == comm_msg.msg_type) {
-            spdmq_event_ptr_->update_session(session_id);
-            return;
+            on_control(session_id, *spdmq_socket_ptr, wire, comm_msg);
+            if (session_id != spdmq_socket_ptr->socket_fd()) {
+                spdmq_event_ptr_->update_session(session_id);
+            }
+            continue;
         }
 
-        storeroom_ptr_->comm_msg_queue(std::move(comm_msg));
-        cv_.notify_all();
+        on_message(std::move(comm_msg));
+    }
+}
+
+void porter::on_read_inproc(int32_t session_id) {
+    inproc_session_t inproc;
+    if (!inproc_of(session_id, inproc)) {
+        return;
+    }
+
+    inproc.in->drain();
+    std::shared_ptr<comm_msg_t> shared_msg;
+    while (inproc.in->pop(shared_msg)) {
+        // The last owner takes the message, a message shared with other inproc peers is copied
+        comm_msg_t comm_msg = shared_msg.use_count() == 1 ? std::move(*shared_msg) : *shared_msg;
+        shared_msg.reset();
+        comm_msg.session_id = session_id;
+
+        // Modes relaying raw frames get one built for them
+        if (on_frame) {
+            std::vector<uint8_t> frame;
+            serialize_comm_frame(comm_msg, frame);
+            if (on_frame(session_id, frame)) {
+                continue;
+            }
+        }
+
+        on_message(std::move(comm_msg));
+    }
+}
+
+void porter::on_message(comm_msg_t&& comm_msg) {
+    // Consumed by the mode on the event thread, such as a reply matched with its pending request
+    if (on_arrive && on_arrive(comm_msg)) {
+        return;
+    }
+
+    // Called back at once, through the receive queue for its policies and statistics
+    if (dispatch_inline_ && on_recv) {
+        std::vector<comm_msg_t> msgs;
+        comm_msg_t taken;
+        bool popped;
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            storeroom_ptr_->comm_msg_queue(std::move(comm_msg), msgs);
+            popped = storeroom_ptr_->pop(taken, msgs);
+        }
+        dropped(msgs);
+        if (popped) {
+            on_recv(std::move(taken));
+            dispatched_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // Queued first, so the waiters take it by the turns and policies of the queues like recv does,
+    // each arrival can satisfy one waiter, the first one that takes it
+    std::vector<comm_msg_t> msgs;
+    spdmq_waiter_t* waiter = nullptr;
+    comm_msg_t handed;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        storeroom_ptr_->comm_msg_queue(std::move(comm_msg), msgs);
+        for (auto it = recv_waiters_.begin(); it != recv_waiters_.end(); ++it) {
+            if (pop_for(**it, handed, msgs)) {
+                waiter = *it;
+                recv_waiters_.erase(it);
+                break;
+            }
+        }
+    }
+    cv_.notify_all();
+    dropped(msgs);
+    if (waiter) {
+        handoff(*waiter, handed);
+        resume(*waiter);
+    }
+}
+
+void porter::dropped(std::vector<comm_msg_t>& msgs) {
+    // Flow control of the mode counts them as consumed, otherwise their credit would never come back
+    if (on_drop) {
+        for (auto& msg : msgs) {
+            on_drop(msg, msg.payload.size());
+        }
+    }
+}
+
+bool porter::expire(int64_t deadline, std::string_view topic) {
+    // true - the message has expired and is counted against its topic
+    if (!deadline || deadline >= now_usecs_timestamp()) {
+        return false;
+    }
+    storeroom_ptr_->expired(std::string(topic), 1);
+    return true;
+}
+
+void porter::on_write(int32_t session_id) {
+    if (connecting_.count(session_id)) {
+        connect_done(session_id);
+        return;
+    }
+
+    std::shared_ptr<spdmq_socket> spdmq_socket_ptr;
+    auto outbox_ptr = outbox_of(session_id, spdmq_socket_ptr);
+    if (!outbox_ptr) {
+        return;
+    }
+
+    if (outbox_ptr->flush(*spdmq_socket_ptr, *spdmq_event_ptr_, session_id) != SPDMQ_CODE_OK) {
+        spdmq_event_ptr_->urgent_event({session_id, EVENT::DISCONNECT});
+    }
+    wake_writers();
+    if (on_drain) {
+        on_drain(session_id);
     }
 }
 
 void porter::on_connecting(int32_t session_id) {
+    auto spdmq_socket_ptr = socket_of(session_id);
+    if (!spdmq_socket_ptr) {
+        return;
+    }
+
     while (true) {
-        auto client_fd = spdmq_socket_ptr_->accept(session_id);
+        auto client_fd = spdmq_socket_ptr->accept(session_id);
         if (client_fd > 3) {
+            add_socket(client_fd, spdmq_socket_ptr);
             spdmq_event_ptr_->urgent_event({client_fd, EVENT::CONNECTED});
         }
         else {
-            // printf("client_fd failed failed\n");
             break;
         }
     }
@@ -148,73 +813,352 @@ void porter::on_connecting(int32_t session_id) {
 }
 
 void porter::on_connected(int32_t session_id) {
-    // printf("porter::on_connected session_id:%d\n", session_id);
-    if (session_id != spdmq_socket_ptr_->socket_fd()) {
+    LOGD("session %d connected", session_id);
+    // No socket, no heartbeat, the peer lives in the same process
+    if (is_inproc_session(session_id)) {
+        online(session_id);
+        return;
+    }
+
+    auto spdmq_socket_ptr = socket_of(session_id);
+    if (!spdmq_socket_ptr) {
+        return;
+    }
+
+    if (session_id != spdmq_socket_ptr->socket_fd()) {
         spdmq_event_ptr_->event_add(session_id);
         spdmq_event_ptr_->update_session(session_id);
     }
     else {
-        spdmq_socket_ptr_->start_heart([this] {
-            comm_msg msg;
-            msg.session_id = spdmq_socket_ptr_->socket_fd();
-            msg.msg_type = MESSAGE_TYPE::HEARTBEAT;
-            // printf("send heartbeat\n");
-            auto ret = send_msg(spdmq_socket_ptr_->socket_fd(), msg);
-            // printf("ret:%d\n", ret);
-            if (ret != 0) {
-                // printf("ret:%d\n", ret);
-                spdmq_event_ptr_->event_del(spdmq_socket_ptr_->socket_fd());
-                spdmq_event_ptr_->urgent_event({spdmq_socket_ptr_->socket_fd(), EVENT::DISCONNECT});
-            }
-        });
+        // Offer v2 to the peer, a v1 peer takes it for a heartbeat and never answers.
+        // Packets of SOCK_SEQPACKET carry their own length and keep v1.
+        if (frame_version() >= FRAME_VERSION_2 && spdmq_socket_ptr->url_parse().protocol_type == COMM_PROTOCOL_TYPE::TCP) {
+            on_send_msg(session_id, wire_of(control_frame(FRAME_CONTROL::HELLO), {}), {}, 0);
+        }
+
+        auto socket = spdmq_socket_ptr.get();
+        if (external_loop_) {
+            heart_map_[session_id] = socket;
+        }
+        else {
+            // The socket owns the heartbeat timer, so a raw pointer outlives the task
+            socket->start_heart([this, socket] {
+                heartbeat(socket);
+            });
+        }
     }
+    online(session_id);
+}
+
+void porter::heartbeat(spdmq_socket* socket) {
+    comm_msg msg;
+    msg.session_id = socket->socket_fd();
+    msg.msg_type = MESSAGE_TYPE::HEARTBEAT;
+    auto ret = send_msg(socket->socket_fd(), msg);
+    if (ret == SPDMQ_CODE_CONNECT_TO_BROKEN) {
+        LOGW("heartbeat of session %d failed, connection broken", socket->socket_fd());
+        spdmq_event_ptr_->event_del(socket->socket_fd());
+        spdmq_event_ptr_->urgent_event({socket->socket_fd(), EVENT::DISCONNECT});
+    }
+}
+
+void porter::online(int32_t session_id) {
     if (on_online) {
         on_online(session_id);
     }
+
+    // Waiters of spdmq::wait_connect resume once the connection they made comes online,
+    // a session accepted by a listener or paired on the bound side has none
+    std::vector<spdmq_waiter_t*> waiters;
+    inproc_session_t inproc;
+    if (is_inproc_session(session_id)) {
+        if (inproc_of(session_id, inproc) && inproc.outgoing) {
+            std::lock_guard<std::mutex> lk(lock_);
+            auto range = inproc_waiters_.equal_range(inproc.name);
+            for (auto it = range.first; it != range.second; ++it) {
+                waiters.push_back(it->second);
+            }
+            inproc_waiters_.erase(range.first, range.second);
+        }
+    }
+    else if (auto spdmq_socket_ptr = socket_of(session_id); spdmq_socket_ptr && spdmq_socket_ptr->socket_fd() == session_id) {
+        std::lock_guard<std::mutex> lk(lock_);
+        auto range = online_waiters_.equal_range(spdmq_socket_ptr.get());
+        for (auto it = range.first; it != range.second; ++it) {
+            waiters.push_back(it->second);
+        }
+        online_waiters_.erase(range.first, range.second);
+    }
+    resume_all(waiters);
+}
+
+void porter::give_up(const spdmq_socket* socket) {
+    // The connect is not tried again, spdmq_ctx::reconnect_interval is 0
+    std::vector<spdmq_waiter_t*> waiters;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        auto range = online_waiters_.equal_range(socket);
+        for (auto it = range.first; it != range.second; ++it) {
+            waiters.push_back(it->second);
+        }
+        online_waiters_.erase(range.first, range.second);
+    }
+    for (auto waiter : waiters) {
+        waiter->code = SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET;
+        resume(*waiter);
+    }
 }
 
 void porter::on_disconnect(int32_t session_id) {
-    if (session_id != spdmq_socket_ptr_->socket_fd()) {
+    // A session may be reported by both the heartbeat and the read path, handle it once
+    auto spdmq_socket_ptr = socket_of(session_id);
+    if (!spdmq_socket_ptr) {
+        return;
+    }
+    remove_socket(session_id);
+    spdmq_socket_ptr->remove_read_buffer(session_id);
+    wire_map_.erase(session_id);
+
+    if (session_id != spdmq_socket_ptr->socket_fd()) {
         spdmq_event_ptr_->event_del(session_id);
         spdmq_event_ptr_->remove_session(session_id);
     }
     else {
-        // printf("porter::on_disconnect session_id:%d\n", session_id);
-        spdmq_socket_ptr_->stop_heart();
-        close(spdmq_socket_ptr_->socket_fd());
-        if (ctx().reconnect_interval()) {
-            spdmq_socket_ptr_->open_socket();
-            on_reconnect();
+        LOGD("session %d disconnected", session_id);
+        spdmq_socket_ptr->stop_heart();
+        heart_map_.erase(session_id);
+        spdmq_event_ptr_->event_del(session_id);
+        spdmq_socket_ptr->close_socket();
+        if (runtime_.reconnect_interval) {
+            spdmq_socket_ptr->open_socket();
+            on_reconnect(spdmq_socket_ptr);
         }
     }
     if (on_offline) {
         on_offline(session_id);
     }
+
+    // Its outbound queue went with it
+    wake_writers();
+}
+
+int32_t porter::on_send_msg(int32_t session_id, const wire_frame_ptr_t& wire, std::string_view topic, int64_t deadline) {
+    std::shared_ptr<spdmq_socket> spdmq_socket_ptr;
+    auto outbox_ptr = outbox_of(session_id, spdmq_socket_ptr);
+    if (!outbox_ptr) {
+        return SPDMQ_CODE_CONNECT_TO_BROKEN;
+    }
+
+    return outbox_ptr->push(*spdmq_socket_ptr, *spdmq_event_ptr_, session_id, wire, topic, deadline, runtime_.send_hwm);
+}
+
+wire_frame_ptr_t porter::wire_of(const frame_ptr_t& frame, std::string_view topic) {
+    // Data topics get an id shared by all sessions, the first frame of a topic on a v2 session defines it
+    uint32_t topic_id = 0;
+    if (!topic.empty() && frame_version() >= FRAME_VERSION_2) {
+        spdmq_spinlock<std::atomic_flag> lk(topic_id_lock_);
+        auto it = topic_ids_.find(topic);
+        if (it == topic_ids_.end()) {
+            it = topic_ids_.emplace(std::string(topic), topic_ids_.size() + 1).first;
+        }
+        topic_id = it->second;
+    }
+    if (!topic_id || runtime_.compression(topic).codec == COMPRESSION::NONE) {
+        return std::make_shared<wire_frame>(frame, topic_id, epoch_, runtime_.checksum);
+    }
+    compression_t codec;
+    auto packed = pack(frame, topic, topic_id, codec);
+    return std::make_shared<wire_frame>(frame, topic_id, epoch_, runtime_.checksum, packed, codec);
 }
 
-int32_t porter::on_send_msg(int32_t session_id, const comm_msg& msg) {
-    comm_header header;
-    header.comm_msg_len = msg.size();
-    std::vector<uint8_t> body;
-    serialize_comm_msg_t(msg, body);
+frame_ptr_t porter::pack(const frame_ptr_t& frame, std::string_view topic, uint32_t topic_id, compression_t& codec) {
+    // Compressed once for every session that can decompress it, nullptr - below the threshold or it does not shrink
+    auto& opt = runtime_.compression(topic);
+    auto codec_ptr = codec::of(opt.codec);
+    comm_frame_view_t view;
+    if (!codec_ptr || !view_comm_frame(frame->data(), frame->size(), view) || view.payload_size < opt.threshold) {
+        return nullptr;
+    }
 
-    comm_msg msg1;
-    deserialize_comm_msg_t(body, msg1);
-    // printf("msg1.payload size:%lu, body size:%lu\n", msg1.payload.size(), body.size());
+    thread_local std::vector<uint8_t> payload;
+    auto& clock = spdmq_clock::instance();
+    auto begin = clock.mono_nsecs();
+    auto packed = codec_ptr->compress(view.payload, view.payload_size, opt.dictionary, opt.level, payload);
+    auto nsecs = clock.mono_nsecs() - begin;
+    storeroom_ptr_->compressed(std::string(topic), view.payload_size, packed ? payload.size() : view.payload_size, nsecs);
+    if (!packed) {
+        return nullptr;
+    }
 
-    auto ret = spdmq_socket_ptr_->write_data(session_id, header, body);
-    if (ret < 0) {
-        // printf("session_id:%d, ret:%d, errno:%s\n", session_id, ret, std::strerror(errno));
-        // TODO "Are you considering doing something with the session ID ?"
-        // spdmq_event_ptr_->event_del(session_id);
-        // spdmq_event_ptr_->urgent_event({session_id, EVENT::DISCONNECT});
+    codec = opt.codec;
+    view.compression = {opt.codec, view.payload_size, dictionary_of(opt.dictionary)};
+    view.payload = payload.data();
+    view.payload_size = payload.size();
+    auto packed_frame = std::make_shared<std::vector<uint8_t>>();
+    encode_comm_frame_v2(view, topic_id, false, epoch_, runtime_.checksum, *packed_frame);
+    return packed_frame;
+}
+
+bool porter::unpack(comm_msg_t& comm_msg, const frame_compression_t& compression) {
+    // The dictionary is the one of the topic on this side, it has to be the one the sender used
+    auto& opt = runtime_.compression(comm_msg.topic);
+    auto codec_ptr = codec::of(compression.codec);
+    thread_local std::vector<uint8_t> payload;
+    auto& clock = spdmq_clock::instance();
+    auto begin = clock.mono_nsecs();
+    auto unpacked = codec_ptr && compression.dictionary_id == dictionary_of(opt.dictionary) &&
+                    codec_ptr->decompress(comm_msg.payload.data(), comm_msg.payload.size(), opt.dictionary, compression.raw_size, payload);
+    auto nsecs = clock.mono_nsecs() - begin;
+    storeroom_ptr_->decompressed(comm_msg.topic, compression.raw_size, comm_msg.payload.size(), nsecs, unpacked);
+    if (unpacked) {
+        comm_msg.payload.swap(payload);
+    }
+    return unpacked;
+}
+
+bool porter::verify(int32_t session_id, const uint8_t* body, std::size_t& size) {
+    auto checked = verify_comm_frame_v2(body, size);
+    if (FRAME_CHECKSUM::NONE == checked) {
+        return true;
+    }
+    checksum_frames_.fetch_add(1, std::memory_order_relaxed);
+    checksum_bytes_.fetch_add(size, std::memory_order_relaxed);
+    if (FRAME_CHECKSUM::MATCH == checked) {
+        return true;
+    }
+    checksum_mismatches_.fetch_add(1, std::memory_order_relaxed);
+
+    // Taken at its word a message gives its credit back, the rest of the frame stands for the payload
+    const uint8_t* ptr = body;
+    uint64_t flags;
+    if (get_varint(ptr, body + size, flags) && ptr < body + size && MESSAGE_TYPE::DATA == static_cast<message_type_t>(*ptr)) {
+        std::vector<comm_msg_t> msgs;
+        msgs.emplace_back(session_id);
+        msgs.back().msg_type = MESSAGE_TYPE::DATA;
+        msgs.back().payload.resize(body + size - ptr - 1);
+        dropped(msgs);
+    }
+    return false;
+}
+
+uint32_t porter::dictionary_of(const std::vector<uint8_t>& dictionary) {
+    // Hashed once, the dictionaries live in the ctx
+    if (dictionary.empty()) {
+        return 0;
+    }
+    spdmq_spinlock<std::atomic_flag> lk(topic_id_lock_);
+    auto it = dictionary_ids_.find(dictionary.data());
+    if (it == dictionary_ids_.end()) {
+        it = dictionary_ids_.emplace(dictionary.data(), dictionary_id(dictionary)).first;
+    }
+    return it->second;
+}
+
+uint8_t porter::frame_version() const {
+    // Modes relaying raw frames keep their sessions on v1, so that the frames go out as they came in
+    return on_frame ? FRAME_VERSION_1 : runtime_.frame_version;
+}
+
+frame_ptr_t porter::control_frame(frame_control_type_t type) {
+    frame_control_t control;
+    control.type = type;
+    control.version = FRAME_VERSION_2;
+    control.epoch = epoch_;
+    control.features = codec::available() | FRAME_FEATURE_CHECKSUM;
+
+    comm_msg_t comm_msg;
+    comm_msg.msg_type = MESSAGE_TYPE::HEARTBEAT;
+    comm_msg.payload = frame_control_payload(control);
+    auto frame = std::make_shared<std::vector<uint8_t>>();
+    serialize_comm_frame(comm_msg, *frame);
+    return frame;
+}
+
+void porter::on_control(int32_t session_id, spdmq_socket& socket, wire_state_t& wire, const comm_msg_t& comm_msg) {
+    frame_control_t control;
+    if (!frame_control_of(comm_msg.payload, control) || frame_version() < FRAME_VERSION_2 || control.version < FRAME_VERSION_2) {
+        return;
+    }
+
+    // The peer writes v2 from the next frame on
+    if (FRAME_CONTROL::SWITCH == control.type) {
+        wire.version = FRAME_VERSION_2;
+        socket.read_version(session_id, FRAME_VERSION_2);
+        return;
+    }
+    if (FRAME_CONTROL::HELLO != control.type || socket.url_parse().protocol_type != COMM_PROTOCOL_TYPE::TCP) {
+        return;
+    }
+
+    // The accepting side answers the HELLO, then both switch their writing side
+    wire.epoch = control.epoch;
+    std::shared_ptr<spdmq_socket> spdmq_socket_ptr;
+    auto outbox_ptr = outbox_of(session_id, spdmq_socket_ptr);
+    if (!outbox_ptr) {
+        return;
+    }
+    if (session_id != socket.socket_fd()) {
+        on_send_msg(session_id, wire_of(control_frame(FRAME_CONTROL::HELLO), {}), {}, 0);
+    }
+
+    // A peer that would not verify the checksum would not read the frames that carry one either, it is written v1
+    if (runtime_.checksum && !(control.features & FRAME_FEATURE_CHECKSUM)) {
+        return;
+    }
+    if (outbox_ptr->upgrade(socket, *spdmq_event_ptr_, session_id, control_frame(FRAME_CONTROL::SWITCH), control.features) != SPDMQ_CODE_OK) {
+        spdmq_event_ptr_->urgent_event({session_id, EVENT::DISCONNECT});
+    }
+}
+
+int32_t porter::on_send_inproc(int32_t session_id, const std::shared_ptr<comm_msg_t>& comm_msg) {
+    inproc_session_t inproc;
+    if (!inproc_of(session_id, inproc)) {
         return SPDMQ_CODE_CONNECT_TO_BROKEN;
     }
-    return SPDMQ_CODE_OK;
+    return inproc.out->push(comm_msg);
+}
+
+bool porter::inproc_of(int32_t session_id, inproc_session_t& inproc) {
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    auto it = inproc_map_.find(session_id);
+    if (it == inproc_map_.end()) {
+        return false;
+    }
+    inproc = it->second;
+    return true;
+}
+
+std::shared_ptr<spdmq_socket> porter::socket_of(fd_t fd) {
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    auto it = socket_map_.find(fd);
+    return it == socket_map_.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<outbox> porter::outbox_of(fd_t fd, std::shared_ptr<spdmq_socket>& spdmq_socket_ptr) {
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    auto it = socket_map_.find(fd);
+    if (it == socket_map_.end()) {
+        return nullptr;
+    }
+    spdmq_socket_ptr = it->second;
+    auto& outbox_ptr = outbox_map_[fd];
+    if (!outbox_ptr) {
+        outbox_ptr = std::make_shared<outbox>();
+        outbox_ptr->on_expire = [this](const std::vector<uint8_t>& frame) {
+            message_type_t msg_type;
+            std::string_view topic;
+            if (peek_comm_frame(frame, msg_type, topic)) {
+                storeroom_ptr_->expired(std::string(topic), 1);
+            }
+        };
+    }
+    return outbox_ptr;
 }
 
-spdmq_queue<comm_msg_t>& porter::queue() {
-    return storeroom_ptr_->comm_msg_queue();
+void porter::remove_socket(fd_t fd) {
+    spdmq_spinlock<std::atomic_flag> lk(socket_lock_);
+    socket_map_.erase(fd);
+    outbox_map_.erase(fd);
 }
 
 spdmq_ctx_t& porter::ctx() {
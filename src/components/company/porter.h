@@ -16,9 +16,14 @@
 
 #pragma once
 
+#include "codec.h"
+#include "inproc.h"
+#include "outbox.h"
 #include "storeroom.h"
+#include "dispatch_pool.h"
 #include "spdmq_event.h"
 #include "spdmq_socket.h"
+#include "spdmq_runtime.hpp"
 #include "spdmq_internal_def.h"
 
 namespace speed::mq {
@@ -27,35 +32,137 @@ class porter
 {
 private:
     spdmq_ctx_t& ctx_;
+    const spdmq_runtime runtime_;                             // the context as it was when the porter was made
     std::shared_ptr<spdmq_event> spdmq_event_ptr_;
-    std::shared_ptr<spdmq_socket> spdmq_socket_ptr_;
     std::shared_ptr<storeroom> storeroom_ptr_;
     std::mutex lock_;
     std::condition_variable cv_;
+    std::atomic_flag socket_lock_ = ATOMIC_FLAG_INIT;
+    std::map<fd_t, std::shared_ptr<spdmq_socket>> socket_map_; // session or listener fd -> owning socket
+    std::map<fd_t, std::shared_ptr<outbox>> outbox_map_;       // session fd -> outbound queue, guarded by socket_lock_
+
+    typedef struct inproc_session {
+        std::shared_ptr<inproc_pipe> in;  // messages to this side
+        std::shared_ptr<inproc_pipe> out; // messages to the peer
+        bool outgoing;                    // created by connect
+        std::string name;                 // the inproc:// name it was paired on
+    } inproc_session_t;
+    std::map<int32_t, inproc_session_t> inproc_map_;          // inproc session id -> pipes, guarded by socket_lock_
+
+    typedef struct wire_state {
+        uint8_t version = FRAME_VERSION_1; // frame format read from the session
+        int64_t epoch = 0;                 // the timestamps of the peer count from it
+        std::vector<std::string> topics;   // topic id -> name, as defined by the peer
+        bool local = false;                // the peer runs on this host, its monotonic stamps compare with ours
+    } wire_state_t;
+    std::map<int32_t, wire_state_t> wire_map_;                // socket session id -> what it has negotiated, used by the event thread only
+    int64_t epoch_;                                           // the v2 timestamps sent count from it
+    std::atomic_flag topic_id_lock_ = ATOMIC_FLAG_INIT;
+    std::map<std::string, uint32_t, std::less<>> topic_ids_;  // topic -> id on the sessions that speak v2, guarded by topic_id_lock_
+    std::map<const void*, uint32_t> dictionary_ids_;          // dictionary of spdmq_ctx::compression -> its id, guarded by topic_id_lock_
+    std::atomic<uint64_t> checksum_frames_ = {0};             // see spdmq_checksum_stat_t
+    std::atomic<uint64_t> checksum_bytes_ = {0};
+    std::atomic<uint64_t> checksum_mismatches_ = {0};
+    std::deque<spdmq_waiter_t*> recv_waiters_;                // waiters of spdmq::wait_recv in the order they came, guarded by lock_
+    std::vector<spdmq_waiter_t*> write_waiters_;              // waiters of spdmq::wait_writable, guarded by lock_
+    std::multimap<const spdmq_socket*, spdmq_waiter_t*> online_waiters_; // waiters of spdmq::wait_connect by the socket they connect, guarded by lock_
+    std::multimap<std::string, spdmq_waiter_t*> inproc_waiters_;         // waiters of spdmq::wait_connect by the inproc:// name they connect, guarded by lock_
+    bool dispatch_inline_;                                    // on_recv is called on the event thread, spdmq_ctx::dispatch_threads is 0
+    std::shared_ptr<dispatch_pool> dispatch_pool_ptr_;        // with more than one spdmq_ctx::dispatch_threads
+    std::atomic<uint64_t> dispatched_ = {0};                  // on_recv calls made without the pool
+    bool external_loop_;                                      // spdmq_ctx::external_loop, on_tick sends the heartbeats and reconnects
+    std::map<fd_t, spdmq_socket*> heart_map_;                 // connected sockets whose heartbeat on_tick sends, used by the event thread only
+    int64_t heart_sent_ = 0;                                  // milliseconds of the last heartbeats sent by on_tick
+    std::vector<std::pair<int64_t, std::shared_ptr<spdmq_socket>>> reconnects_; // sockets on_tick connects again from these milliseconds on
+    std::map<fd_t, std::shared_ptr<spdmq_socket>> connecting_; // sockets whose connect completes when they become writable, with external_loop_
 
 public:
     std::function<void(comm_msg_t&&)> on_recv;
     std::function<void(comm_msg_t&&)> on_online;
     std::function<void(comm_msg_t&&)> on_offline;
+    std::function<bool(comm_msg_t&)> on_arrive; // called on the event thread before queuing, true - the message is consumed
+    std::function<bool(int32_t, std::vector<uint8_t>&)> on_frame; // called on the event thread with the raw frame before decoding, true - the frame is consumed, the sessions stay on v1
+    std::function<void(comm_msg_t&, std::size_t)> on_drop; // called with a message the receive queue gave up, dropped or expired, and its payload bytes, outside the locks
+    std::function<void(comm_msg_t&)> on_handoff; // called with a message handed to a waiter of wait_recv, outside the locks
+    std::function<void()> on_timer;              // called on the event thread by on_tick, a time given to wake_at may have come
+    std::function<void(int32_t)> on_drain;       // called on the event thread after the outbound queue of a session has been written
 
 public:
     porter(spdmq_ctx_t& ctx,
            std::shared_ptr<spdmq_event> spdmq_event_ptr, 
-           std::shared_ptr<spdmq_socket> spdmq_socket_ptr,
            std::shared_ptr<storeroom> storeroom_ptr);
 
     int32_t send_msg(int32_t session_id, const comm_msg_t& comm_msg);
-    int32_t recv_msg(int32_t session_id, comm_msg_t& comm_msg, time_msec_t time_out);
+    int32_t send_msg(int32_t session_id, comm_msg_t&& comm_msg);
+    int32_t send_msg(const std::set<int32_t>& session_ids, const comm_msg_t& comm_msg);
+    int32_t send_msg(const std::set<int32_t>& session_ids, comm_msg_t&& comm_msg, std::set<int32_t>* refused = nullptr);
+    int32_t send_frame(const std::set<int32_t>& session_ids, const frame_ptr_t& frame, std::string_view topic, std::set<int32_t>* refused = nullptr);
+    int32_t recv_msg(comm_msg_t& comm_msg, time_msec_t time_out);
+    int32_t recv_msg(comm_msg_t& comm_msg, const std::string& topic, time_msec_t time_out);
+    bool wait_recv(spdmq_waiter_t& waiter);
+    bool wait_writable(spdmq_waiter_t& waiter);
+    bool wait_online(spdmq_waiter_t& waiter, std::shared_ptr<spdmq_socket> spdmq_socket_ptr);
+    void wait_online(spdmq_waiter_t& waiter, const std::string& name);
+    std::map<std::string, spdmq_topic_stat_t> topic_stats();
+    spdmq_checksum_stat_t checksum_stats();
+    std::vector<spdmq_dispatch_stat_t> dispatch_stats();
+
+    const spdmq_runtime& runtime() const {
+        return runtime_;
+    }
+    void missed(const std::string& topic, uint64_t count);
+    void expired(const std::string& topic, uint64_t count);
+    std::size_t outbound(int32_t session_id);
+    std::size_t queued();
+    bool outgoing(int32_t session_id);
+    std::string endpoint(int32_t session_id);
+    void conflate(int32_t session_id, const std::string& topic);
+    void wake_at(std::chrono::steady_clock::time_point time_point);
+    void credited(int32_t session_id);
 
-    void on_reconnect();
+    void add_socket(fd_t fd, std::shared_ptr<spdmq_socket> spdmq_socket_ptr);
+    std::shared_ptr<inproc_pipe> open_inproc();
+    int32_t add_inproc(std::shared_ptr<inproc_pipe> in, std::shared_ptr<inproc_pipe> out, bool outgoing, const std::string& name);
+    void online_inproc(int32_t session_id);
+    bool on_reconnect(std::shared_ptr<spdmq_socket> spdmq_socket_ptr);
+    void on_tick();
     void on_read(int32_t session_id);
+    void on_write(int32_t session_id);
     void on_connecting(int32_t session_id);
     void on_connected(int32_t session_id);
     void on_disconnect(int32_t session_id);
 
 private:
-    int32_t on_send_msg(int32_t session_id, const comm_msg& msg);
-    spdmq_queue<comm_msg_t>& queue();
+    int32_t on_send_msg(int32_t session_id, const wire_frame_ptr_t& wire, std::string_view topic, int64_t deadline);
+    wire_frame_ptr_t wire_of(const frame_ptr_t& frame, std::string_view topic);
+    frame_ptr_t pack(const frame_ptr_t& frame, std::string_view topic, uint32_t topic_id, compression_t& codec);
+    bool unpack(comm_msg_t& comm_msg, const frame_compression_t& compression);
+    bool verify(int32_t session_id, const uint8_t* body, std::size_t& size);
+    uint32_t dictionary_of(const std::vector<uint8_t>& dictionary);
+    uint8_t frame_version() const;
+    frame_ptr_t control_frame(frame_control_type_t type);
+    void on_control(int32_t session_id, spdmq_socket& socket, wire_state_t& wire, const comm_msg_t& comm_msg);
+    bool expire(int64_t deadline, std::string_view topic);
+    void dropped(std::vector<comm_msg_t>& msgs);
+    int32_t on_send_inproc(int32_t session_id, const std::shared_ptr<comm_msg_t>& comm_msg);
+    void on_read_inproc(int32_t session_id);
+    void on_message(comm_msg_t&& comm_msg);
+    int32_t recv_msg(time_msec_t time_out, const std::function<bool(std::vector<comm_msg_t>&)>& pop);
+    bool pop_for(const spdmq_waiter_t& waiter, comm_msg_t& comm_msg, std::vector<comm_msg_t>& expired);
+    void handoff(spdmq_waiter_t& waiter, comm_msg_t& comm_msg);
+    void resume(spdmq_waiter_t& waiter);
+    void resume_all(std::vector<spdmq_waiter_t*>& waiters);
+    bool writable();
+    void wake_writers();
+    void online(int32_t session_id);
+    void give_up(const spdmq_socket* socket);
+    void heartbeat(spdmq_socket* socket);
+    bool connect_once(const std::shared_ptr<spdmq_socket>& spdmq_socket_ptr);
+    void connect_done(fd_t fd);
+    bool inproc_of(int32_t session_id, inproc_session_t& inproc);
+    std::shared_ptr<spdmq_socket> socket_of(fd_t fd);
+    std::shared_ptr<outbox> outbox_of(fd_t fd, std::shared_ptr<spdmq_socket>& spdmq_socket_ptr);
+    void remove_socket(fd_t fd);
     spdmq_ctx_t& ctx();
 };
 
@@ -18,20 +18,178 @@
 
 namespace speed::mq {
 
-storeroom::storeroom(spdmq_ctx_t& ctx) : ctx_(ctx) {}
+storeroom::storeroom(spdmq_ctx_t& ctx) : ctx_(ctx), turn_(topic_map_.end()) {}
 
-void storeroom::comm_msg_queue(comm_msg_t&& msg) {
-    if (comm_msg_queue_.size() < ctx().queue_size()) {
-        comm_msg_queue_.push(std::forward<comm_msg_t>(msg));
+void storeroom::comm_msg_queue(comm_msg_t&& msg, std::vector<comm_msg_t>& dropped) {
+    // Messages given up to the drop policy or expired are handed back in dropped
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto& queue = topic_of(msg.topic);
+    if (queue.msgs.size() >= queue.opt.capacity && !queue.msgs.empty() && queue.msgs.front().ttl) {
+        // A full queue first makes room from its expired messages, they are the oldest
+        auto now = now_usecs_timestamp();
+        while (!queue.msgs.empty() && queue.msgs.front().expired(now)) {
+            dropped.push_back(std::move(queue.msgs.front()));
+            queue.msgs.pop_front();
+            ++queue.stat.expired;
+            --size_;
+        }
+    }
+    if (queue.msgs.size() < queue.opt.capacity) {
+        queue.msgs.push_back(std::move(msg));
+        ++queue.stat.received;
+        ++size_;
+        return;
+    }
+
+    ++queue.stat.dropped;
+    if (queue.opt.drop_policy == DROP_POLICY::DROP_NEWEST || queue.msgs.empty()) {
+        dropped.push_back(std::move(msg));
+        return;
+    }
+    dropped.push_back(std::move(queue.msgs.front()));
+    queue.msgs.pop_front();
+    queue.msgs.push_back(std::move(msg));
+    ++queue.stat.received;
+}
+
+bool storeroom::pop(comm_msg_t& msg, std::vector<comm_msg_t>& expired) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    int64_t now = 0;
+    while (size_) {
+        // Weighted round robin, a topic gives way after weight messages or once it is empty
+        if (turn_ == topic_map_.end()) {
+            turn_ = topic_map_.begin();
+        }
+        while (turn_->second.msgs.empty() || served_ >= turn_->second.opt.weight) {
+            served_ = 0;
+            if (++turn_ == topic_map_.end()) {
+                turn_ = topic_map_.begin();
+            }
+        }
+        if (take(turn_->second, msg, now, expired)) {
+            ++served_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool storeroom::pop(comm_msg_t& msg, std::string_view topic, std::vector<comm_msg_t>& expired) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto it = topic_map_.find(topic);
+    if (it == topic_map_.end()) {
+        return false;
+    }
+    int64_t now = 0;
+    while (!it->second.msgs.empty()) {
+        if (take(it->second, msg, now, expired)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool storeroom::empty() {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    return !size_;
+}
+
+bool storeroom::empty(std::string_view topic) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto it = topic_map_.find(topic);
+    return it == topic_map_.end() || it->second.msgs.empty();
+}
+
+std::size_t storeroom::size() {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    return size_;
+}
+
+std::map<std::string, spdmq_topic_stat_t> storeroom::topic_stats() {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    std::map<std::string, spdmq_topic_stat_t> stats;
+    for (auto& topic_queue : topic_map_) {
+        auto& stat = stats[topic_queue.first];
+        stat = topic_queue.second.stat;
+        stat.queued = topic_queue.second.msgs.size();
+        if (topic_queue.second.latency) {
+            stat.latency = topic_queue.second.latency->summary();
+        }
+    }
+    return stats;
+}
+
+void storeroom::missed(const std::string& topic, uint64_t count) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    topic_of(topic).stat.missed += count;
+}
+
+void storeroom::expired(const std::string& topic, uint64_t count) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    topic_of(topic).stat.expired += count;
+}
+
+void storeroom::compressed(const std::string& topic, uint64_t raw_bytes, uint64_t packed_bytes, int64_t nsecs) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto& stat = topic_of(topic).stat.compress;
+    ++stat.messages;
+    stat.raw_bytes += raw_bytes;
+    stat.packed_bytes += packed_bytes;
+    stat.nsecs += nsecs;
+}
+
+void storeroom::decompressed(const std::string& topic, uint64_t raw_bytes, uint64_t packed_bytes, int64_t nsecs, bool ok) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto& stat = topic_of(topic).stat.decompress;
+    if (!ok) {
+        ++stat.errors;
         return;
     }
-    comm_msg_queue_.pop();
-    comm_msg_queue_.push(std::forward<comm_msg_t>(msg));
+    ++stat.messages;
+    stat.raw_bytes += raw_bytes;
+    stat.packed_bytes += packed_bytes;
+    stat.nsecs += nsecs;
 }
 
-spdmq_queue<comm_msg_t>& storeroom::comm_msg_queue() {
-    return comm_msg_queue_;
+storeroom::topic_queue_t& storeroom::topic_of(const std::string& topic) {
+    auto it = topic_map_.find(topic);
+    if (it == topic_map_.end()) {
+        it = topic_map_.emplace(topic, topic_queue_t()).first;
+        it->second.opt = ctx().topic_queue(topic);
+        it->second.opt.weight = std::max<uint32_t>(it->second.opt.weight, 1);
+        if (ctx().latency_histogram()) {
+            it->second.latency = std::make_unique<spdmq_histogram>();
+        }
+    }
+    return it->second;
 }
 
-} /* namespace speed::mq */
+bool storeroom::take(topic_queue_t& queue, comm_msg_t& msg, int64_t& now, std::vector<comm_msg_t>& expired) {
+    // false - the message had expired and went to expired instead, the clock is read once per pop
+    auto& front = queue.msgs.front();
+    bool alive = true;
+    if (front.ttl) {
+        now = now ? now : now_usecs_timestamp();
+        alive = !front.expired(now);
+    }
+    if (alive) {
+        measure(queue, front);
+        msg = std::move(front);
+    }
+    else {
+        expired.push_back(std::move(front));
+        ++queue.stat.expired;
+    }
+    queue.msgs.pop_front();
+    --size_;
+    return alive;
+}
+
+void storeroom::measure(topic_queue_t& queue, const comm_msg_t& msg) {
+    // Up to recv, like spdmq_msg_t::time_cost
+    if (queue.latency) {
+        queue.latency->record(comm_msg_latency_nsecs(msg, spdmq_clock::instance().mono_nsecs()));
+    }
+}
 
+} /* namespace speed::mq */
\ No newline at end of file
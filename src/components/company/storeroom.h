@@ -16,26 +16,58 @@
 
 #pragma once
 
+#include <map>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
 #include "spdmq_def.h"
-#include "spdmq_queue.hpp"
 #include "spdmq_event.h"
 #include "spdmq_spinlock.hpp"
+#include "spdmq_histogram.hpp"
 #include "spdmq_internal_def.h"
 
 namespace speed::mq {
 
+// Received messages wait here in one bounded queue per topic, so a chatty topic can only
+// overflow its own queue, recv takes the topics in turn by their weights.
+// Messages whose time to live has run out are given up instead of being received
 class storeroom {
 private:
-    spdmq_queue<comm_msg_t> comm_msg_queue_;
+    typedef struct topic_queue {
+        std::deque<comm_msg_t> msgs;
+        spdmq_topic_queue_t opt;
+        spdmq_topic_stat_t stat;
+        std::unique_ptr<spdmq_histogram> latency; // with spdmq_ctx::latency_histogram
+    } topic_queue_t;
+
     spdmq_ctx_t& ctx_;
-    
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    std::map<std::string, topic_queue_t, std::less<>> topic_map_; // topic -> queue, never erased, so turn_ stays valid
+    std::map<std::string, topic_queue_t, std::less<>>::iterator turn_; // topic whose turn it is
+    uint32_t served_ = 0;                                          // messages taken from turn_ in this turn
+    std::size_t size_ = 0;                                         // messages of all topics
 
 public:
     storeroom(spdmq_ctx_t& ctx);
-    void comm_msg_queue(comm_msg_t&& msg);
-    spdmq_queue<comm_msg_t>& comm_msg_queue();
+    void comm_msg_queue(comm_msg_t&& msg, std::vector<comm_msg_t>& dropped);
+    bool pop(comm_msg_t& msg, std::vector<comm_msg_t>& expired);
+    bool pop(comm_msg_t& msg, std::string_view topic, std::vector<comm_msg_t>& expired);
+    bool empty();
+    bool empty(std::string_view topic);
+    std::size_t size();
+    std::map<std::string, spdmq_topic_stat_t> topic_stats();
+    void missed(const std::string& topic, uint64_t count);
+    void expired(const std::string& topic, uint64_t count);
+    void compressed(const std::string& topic, uint64_t raw_bytes, uint64_t packed_bytes, int64_t nsecs);
+    void decompressed(const std::string& topic, uint64_t raw_bytes, uint64_t packed_bytes, int64_t nsecs, bool ok);
 
 private:
+    topic_queue_t& topic_of(const std::string& topic);
+    bool take(topic_queue_t& queue, comm_msg_t& msg, int64_t& now, std::vector<comm_msg_t>& expired);
+    void measure(topic_queue_t& queue, const comm_msg_t& msg);
+
     spdmq_ctx_t& ctx() {
         return ctx_;
     }
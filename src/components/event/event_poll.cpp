@@ -18,6 +18,9 @@
 #include <thread>
 #include <cstdint>
 #include <future>
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 namespace speed::mq {
 
@@ -27,8 +30,16 @@ event_poll::event_poll(spdmq_ctx_t& ctx) : spdmq_event(ctx) {
 
 void event_poll::event_add(fd_t fd) {
     epoll_event evt;
-    evt.events = gEventModeMap.at(ctx().event_mode());
-    evt.data.fd = fd;
+    evt.events = epoll_events_;
+    evt.data.u64 = static_cast<uint32_t>(fd);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &evt);
+}
+
+void event_poll::listener_add(fd_t fd) {
+    // The high half of the user data marks a listening socket, so the loop needs no lookup per event
+    epoll_event evt;
+    evt.events = epoll_events_;
+    evt.data.u64 = (EVENT_LISTENER_TAG << 32) | static_cast<uint32_t>(fd);
     epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &evt);
 }
 
@@ -36,12 +47,130 @@ void event_poll::event_del(fd_t fd) {
     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
 }
 
+void event_poll::event_writable(fd_t fd, bool enable) {
+    epoll_event evt;
+    evt.events = epoll_events_ | (enable ? EPOLLOUT : 0);
+    evt.data.u64 = static_cast<uint32_t>(fd);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &evt);
+}
+
 void event_poll::event_create() {
     epoll_fd_ = epoll_create1(0);
     ERRNO_ASSERT(epoll_fd_ != -1);
+    epoll_events_ = gEventModeMap.at(ctx().event_mode());
+
+    // Disarmed until the first deadline, level triggered like the other timer
+    deadline_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ERRNO_ASSERT(deadline_fd_ != -1);
+    epoll_event evt;
+    evt.events = EPOLLIN;
+    evt.data.u64 = (EVENT_DEADLINE_TAG << 32) | static_cast<uint32_t>(deadline_fd_);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, deadline_fd_, &evt);
+
+    if (ctx().external_loop()) {
+        external_create();
+    }
+}
+
+void event_poll::external_create() {
+    // Both level triggered, they stay readable until event_step reads them
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ERRNO_ASSERT(wakeup_fd_ != -1);
+    epoll_event evt;
+    evt.events = EPOLLIN;
+    evt.data.u64 = (EVENT_WAKEUP_TAG << 32) | static_cast<uint32_t>(wakeup_fd_);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &evt);
+
+    // Ticks as often as the shortest of the heartbeat and the reconnect interval
+    auto interval = std::min(ctx().heartbeat() ? ctx().heartbeat() : UINT32_MAX, ctx().reconnect_interval() ? ctx().reconnect_interval() : UINT32_MAX);
+    if (interval == UINT32_MAX) {
+        return;
+    }
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ERRNO_ASSERT(timer_fd_ != -1);
+    itimerspec spec = {};
+    spec.it_interval.tv_sec = interval / 1000;
+    spec.it_interval.tv_nsec = (interval % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    ERRNO_ASSERT(timerfd_settime(timer_fd_, 0, &spec, nullptr) != -1);
+    evt.data.u64 = (EVENT_TIMER_TAG << 32) | static_cast<uint32_t>(timer_fd_);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &evt);
+}
+
+fd_t event_poll::native_handle() {
+    return epoll_fd_;
+}
+
+void event_poll::event_deadline(int64_t deadline) {
+    // Only ever brought forward, the deadlines after it are armed again by on_tick
+    spdmq_spinlock<std::atomic_flag> lk(deadline_lock_);
+    if (deadline_ && deadline_ <= deadline) {
+        return;
+    }
+    deadline_ = std::max<int64_t>(deadline, 1);
+    itimerspec spec = {};
+    spec.it_value.tv_sec = deadline_ / 1000000000;
+    spec.it_value.tv_nsec = deadline_ % 1000000000;
+    ERRNO_ASSERT(timerfd_settime(deadline_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) != -1);
+}
+
+bool event_poll::timer_fired(uint64_t tag, fd_t fd) {
+    // true - on_tick is due, the expirations are read so that the level triggered timer goes quiet
+    if (tag != EVENT_WAKEUP_TAG && tag != EVENT_TIMER_TAG && tag != EVENT_DEADLINE_TAG) {
+        return false;
+    }
+    uint64_t count;
+    [[maybe_unused]] auto ret = ::read(fd, &count, sizeof(count));
+    if (tag == EVENT_DEADLINE_TAG) {
+        // Disarmed before on_tick runs, so the deadline it arms next is never skipped
+        spdmq_spinlock<std::atomic_flag> lk(deadline_lock_);
+        deadline_ = 0;
+    }
+    if (tag != EVENT_WAKEUP_TAG) {
+        urgent_event().push({fd, EVENT::TICK});
+    }
+    return true;
+}
+
+void event_poll::event_wakeup() {
+    if (wakeup_fd_ != -1) {
+        uint64_t one = 1;
+        [[maybe_unused]] auto ret = ::write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+void event_poll::event_step(uint32_t max_events) {
+    step_events_.resize(max_events ? max_events : 1);
+    auto curr_events = epoll_wait(epoll_fd_, step_events_.data(), static_cast<int>(step_events_.size()), 0);
+    ERRNO_ASSERT(curr_events != -1 || errno == EINTR);
+
+    // Queued without notifying, event_process consumes them right after
+    for (auto i = 0; i < curr_events; ++i) {
+        auto& event = step_events_[i];
+        auto fd = static_cast<int32_t>(event.data.u64 & UINT32_MAX);
+        auto tag = event.data.u64 >> 32;
+        if (timer_fired(tag, fd)) {
+            continue;
+        }
+        if (tag == EVENT_LISTENER_TAG) {
+            urgent_event().push({fd, EVENT::CONNECTING});
+            continue;
+        }
+        if (event.events & EPOLLOUT) {
+            std::pair<int32_t, EVENT> write_event = {fd, EVENT::WRITE};
+            normal_event().push(write_event);
+        }
+        if (event.events & ~EPOLLOUT) {
+            std::pair<int32_t, EVENT> read_event = {fd, EVENT::READ};
+            normal_event().push(read_event);
+        }
+    }
 }
 
 void event_poll::event_build() {
+    if (ctx().external_loop()) {
+        return;
+    }
     // std::async(std::launch::async, &event_poll::event_poll_loop, this);
     std::thread(&event_poll::event_poll_loop, this).detach();
 }
@@ -51,38 +180,35 @@ void event_poll::event_destroy() {
 }
 
 void event_poll::event_poll_loop() {
-    // printf("event_poll_loop\n");
     auto evt_num = ctx().evt_num() < 100 ? 10 : ctx().evt_num() / 10;
     std::shared_ptr<epoll_event> events_ptr(new epoll_event[evt_num](), [] (epoll_event* events) { delete [] events; });
-    auto server_fd = -1;
-    if (ctx().has_config("server_fd")) {
-        // printf("server_fd:%d\n", server_fd);
-        server_fd = ctx().config<fd_t>("server_fd");
-
-        // Prevent blocking caused by server binding and listening before this thread runs, 
-        // and client connecting without any new connections in the future
-        urgent_event({server_fd, EVENT::CONNECTING});
-    }
-    
 
     while (true) {
         
         epoll_event* events = events_ptr.get();
         auto curr_events = epoll_wait(epoll_fd_, events, evt_num, 1000);
-        ERRNO_ASSERT(curr_events != -1);
+        ERRNO_ASSERT(curr_events != -1 || errno == EINTR);
         
         if (destroy_event_loop_.load()) break;
 
         // traverse events
         for (auto i = 0; i < curr_events; ++i) {
-            // printf("events[i].data.fd:%d\n", events[i].data.fd);
-            if (-1 == events[i].data.fd) continue;
-            if (events[i].data.fd == server_fd && ctx().protocol_type() == COMM_PROTOCOL_TYPE::TCP) {
-                // printf("EVENT::CONNECTING events[i].data.fd:%d\n", events[i].data.fd);
-                urgent_event({static_cast<int32_t>(events[i].data.fd), EVENT::CONNECTING});
+            auto fd = static_cast<int32_t>(events[i].data.u64 & UINT32_MAX);
+            if (-1 == fd) continue;
+            if (timer_fired(events[i].data.u64 >> 32, fd)) {
+                notify_event();
+                continue;
+            }
+            if ((events[i].data.u64 >> 32) == EVENT_LISTENER_TAG) {
+                urgent_event({fd, EVENT::CONNECTING});
             }
             else {
-                normal_event({static_cast<int32_t>(events[i].data.fd), EVENT::READ});
+                if (events[i].events & EPOLLOUT) {
+                    normal_event({fd, EVENT::WRITE});
+                }
+                if (events[i].events & ~EPOLLOUT) {
+                    normal_event({fd, EVENT::READ});
+                }
             }
         }
     }
@@ -18,6 +18,7 @@
 
 
 
+#include <vector>
 #include <unistd.h>
 #include "spdmq_event.h"
 #include "spdmq_error.hpp"
@@ -28,7 +29,14 @@ namespace speed::mq {
 class event_poll : public spdmq_event {
 private:
     fd_t epoll_fd_;
+    uint32_t epoll_events_;                // events of spdmq_ctx::event_mode, resolved by event_create
     std::atomic_bool destroy_event_loop_ = false;
+    fd_t wakeup_fd_ = -1;                  // eventfd written by other threads, with spdmq_ctx::external_loop
+    fd_t timer_fd_ = -1;                   // timerfd of the heartbeats and reconnections, with spdmq_ctx::external_loop
+    fd_t deadline_fd_ = -1;                // timerfd of event_deadline
+    std::atomic_flag deadline_lock_ = ATOMIC_FLAG_INIT;
+    int64_t deadline_ = 0;                 // time deadline_fd_ is armed for, 0 - disarmed, guarded by deadline_lock_
+    std::vector<epoll_event> step_events_; // used by event_step
 
 public:
     event_poll(spdmq_ctx_t& ctx);
@@ -36,10 +44,20 @@ public:
     void event_build() override final;
     void event_destroy() override final;
     void event_add(fd_t fd) override final;
+    void listener_add(fd_t fd) override final;
     void event_del(fd_t fd) override final;
+    void event_writable(fd_t fd, bool enable) override final;
+    fd_t native_handle() override final;
+    void event_step(uint32_t max_events) override final;
+    void event_deadline(int64_t deadline) override final;
+
+protected:
+    void event_wakeup() override final;
 
 private:
     void event_poll_loop();
+    void external_create();
+    bool timer_fired(uint64_t tag, fd_t fd);
 };
 
 } /* opendbus*/
\ No newline at end of file
@@ -32,12 +32,21 @@ const std::map<event_mode_t, int32_t> gEventModeMap = {
     {EVENT_MODE::EVENT_POLL_ET, EPOLLIN | EPOLLET},
 };
 
+// tag of listening sockets in the event user data
+constexpr uint64_t EVENT_LISTENER_TAG = 1;
+// tag of the timerfd armed by spdmq_event::event_deadline
+constexpr uint64_t EVENT_DEADLINE_TAG = 2;
+// tags of the eventfd and the timerfd of spdmq_ctx::external_loop
+constexpr uint64_t EVENT_WAKEUP_TAG = 3;
+constexpr uint64_t EVENT_TIMER_TAG = 4;
+
 enum class EVENT : uint8_t {
     READ = 0,
     WRITE = 1,
     CONNECTING = 2,
     CONNECTED = 3,
     DISCONNECT = 4,
+    TICK = 5,
 };
 
 enum class EVENT_PRIORITY : uint8_t {
@@ -32,6 +32,11 @@ spdmq_ctx_t& spdmq_event::ctx() {
 }
 
 void spdmq_event::event_run(bool background) {
+    // Driven by spdmq::process on the threads of the application
+    if (ctx().external_loop()) {
+        return;
+    }
+
     // session_timer_.start(ctx().heartbeat(), std::bind(&spdmq_event::session_clear, this));
     std::thread event_thread(std::bind(&spdmq_event::event_loop, this));
     if (background) {
@@ -42,6 +47,20 @@ void spdmq_event::event_run(bool background) {
     }
 }
 
+int32_t spdmq_event::event_process(uint32_t max_events, uint32_t budget) {
+    event_step(max_events);
+
+    auto limit = budget ? budget : UINT32_MAX;
+    auto handled = event_consume(urgent_event(), limit);
+    handled += event_consume(normal_event(), limit - handled);
+
+    // What the budget left over keeps the handle readable
+    if (!urgent_event().empty() || !normal_event().empty()) {
+        event_wakeup();
+    }
+    return static_cast<int32_t>(handled);
+}
+
 void spdmq_event::event_stop() {
     stop_event_loop_.store(true);
     notify_event();
@@ -59,9 +78,8 @@ void spdmq_event::urgent_event(std::pair<int32_t, EVENT> event) {
 }
 
 void spdmq_event::notify_event() {
-    // printf("cv_.notify_all before\n");
     cv_.notify_one();
-    // printf("cv_.notify_all after\n");
+    event_wakeup();
 }
 
 void spdmq_event::update_session(fd_t session_id) {
@@ -96,45 +114,48 @@ void spdmq_event::event_loop() {
         {
             std::unique_lock<std::mutex> lk(lock_);
             cv_.wait(lk, [this] {
-                // printf("wait\n");
                 return !normal_event().empty() || !urgent_event().empty() || stop_event_loop_; 
             });
         }
-        // printf("wait out2\n");
         if (stop_event_loop_) break;
-        // printf("wait out2\n");
 
-        event_consume(urgent_event());
-        event_consume(normal_event());
-        // printf("wait out3\n");
+        event_consume(urgent_event(), UINT32_MAX);
+        event_consume(normal_event(), UINT32_MAX);
     }
 }
 
 template<typename T>
-void spdmq_event::event_consume(T& queue) {
-    while (!queue.empty()) {
+uint32_t spdmq_event::event_consume(T& queue, uint32_t budget) {
+    uint32_t handled = 0;
+    while (handled < budget && !queue.empty()) {
         auto event = queue.pop();
+        ++handled;
         if (EVENT::READ == event.second && on_read) {
-            // printf("EVENT::READ\n");
             on_read(event.first);
             continue;
         }
+        if (EVENT::WRITE == event.second && on_write) {
+            on_write(event.first);
+            continue;
+        }
         if (EVENT::CONNECTING == event.second && on_connecting) {
-            // printf("EVENT::CONNECTING\n");
             on_connecting(event.first);
             continue;
         }
         if (EVENT::CONNECTED == event.second && on_connected) {
-            // printf("EVENT::CONNECTED\n");
             on_connected(event.first);
             continue;
         }
         if (EVENT::DISCONNECT == event.second && on_disconnect) {
-            // printf("EVENT::DISCONNECT\n");
             on_disconnect(event.first);
             continue;
         }
+        if (EVENT::TICK == event.second && on_tick) {
+            on_tick();
+            continue;
+        }
     }
+    return handled;
 }
 
 set_queue<std::pair<int32_t, EVENT>>& spdmq_event::normal_event() {
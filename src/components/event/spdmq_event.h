@@ -32,9 +32,11 @@ namespace speed::mq {
 class spdmq_event {
 public:
     std::function<void(int32_t)> on_read;       // Read event callback
+    std::function<void(int32_t)> on_write;      // Writable event callback, the outbound queue can be flushed
     std::function<void(int32_t)> on_connecting; // Callback for in progress connection events
     std::function<void(int32_t)> on_connected;  // Callback for completed connection events
     std::function<void(int32_t)> on_disconnect; // Disconnect event callback
+    std::function<void()> on_tick;              // Timer callback, heartbeats and reconnections of spdmq_ctx::external_loop or a deadline may be due
 
 private:
     spdmq_ctx_t& ctx_;
@@ -52,10 +54,15 @@ private:
 
 public:
     virtual void event_add(fd_t fd) = 0;
+    virtual void listener_add(fd_t fd) = 0;
     virtual void event_del(fd_t fd) = 0;
+    virtual void event_writable(fd_t fd, bool enable) = 0;
     virtual void event_create() = 0;
     virtual void event_build() = 0;
     virtual void event_destroy() = 0;
+    virtual fd_t native_handle() = 0;
+    virtual void event_step(uint32_t max_events) = 0; // queues the ready descriptors without waiting, for spdmq_ctx::external_loop
+    virtual void event_deadline(int64_t deadline) = 0; // on_tick is called at this time of std::chrono::steady_clock in nanoseconds at the latest
 
 public:
     spdmq_event(spdmq_ctx_t& ctx);
@@ -63,6 +70,7 @@ public:
     spdmq_ctx_t& ctx();
 
     void event_run(bool background);
+    int32_t event_process(uint32_t max_events, uint32_t budget);
     void event_stop();
     void normal_event(std::pair<int32_t, EVENT> event);
     void urgent_event(std::pair<int32_t, EVENT> event);
@@ -71,14 +79,15 @@ public:
 
 protected:
     void notify_event();
+    virtual void event_wakeup() {}
+    set_queue<std::pair<int32_t, EVENT>>& normal_event();
+    spdmq_queue<std::pair<int32_t, EVENT>>& urgent_event();
 
 private:
     void session_clear();
     void event_loop();
     template<typename T>
-    void event_consume(T& queue);
-    set_queue<std::pair<int32_t, EVENT>>& normal_event();
-    spdmq_queue<std::pair<int32_t, EVENT>>& urgent_event();
+    uint32_t event_consume(T& queue, uint32_t budget);
 };
 
 } /* namespace speed::mq */
@@ -17,6 +17,11 @@
 #include "mode_factory.h"
 #include "mode_publish.h"
 #include "mode_subscribe.h"
+#include "mode_request.h"
+#include "mode_reply.h"
+#include "mode_push.h"
+#include "mode_pull.h"
+#include "mode_proxy.h"
 
 namespace speed::mq {
 
@@ -34,6 +39,21 @@ std::shared_ptr<spdmq_mode> mode_factory::create_mode(spdmq_ctx_t& ctx) {
         case COMM_MODE::SPDMQ_SUB:
             spdmq_mode_ptr = std::make_shared<mode_subscribe>(ctx);
             break;
+        case COMM_MODE::SPDMQ_REQ:
+            spdmq_mode_ptr = std::make_shared<mode_request>(ctx);
+            break;
+        case COMM_MODE::SPDMQ_REP:
+            spdmq_mode_ptr = std::make_shared<mode_reply>(ctx);
+            break;
+        case COMM_MODE::SPDMQ_PUSH:
+            spdmq_mode_ptr = std::make_shared<mode_push>(ctx);
+            break;
+        case COMM_MODE::SPDMQ_PULL:
+            spdmq_mode_ptr = std::make_shared<mode_pull>(ctx);
+            break;
+        case COMM_MODE::SPDMQ_PROXY:
+            spdmq_mode_ptr = std::make_shared<mode_proxy>(ctx);
+            break;
         case COMM_MODE::SPDMQ_UNKNOW:
             throw std::runtime_error("mode_factory::create_mode: unknown mode");
             break;
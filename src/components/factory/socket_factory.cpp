@@ -28,17 +28,17 @@ server_factory* server_factory::instance() {
     return &impl;
 }
 
-std::shared_ptr<spdmq_socket> server_factory::create_socket(spdmq_ctx_t& ctx) {
+std::shared_ptr<spdmq_socket> server_factory::create_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) {
     std::shared_ptr<socket_server> socket_ptr;
-    auto socket_mode = ctx.config<socket_mode_t>("socket_mode");
-    switch (socket_mode) {
+    switch (url_parse.socket_mode) {
         case SOCKET_MODE::TCP:
-            socket_ptr = std::make_shared<tcp_server>(ctx);
+            socket_ptr = std::make_shared<tcp_server>(ctx, url_parse);
             break;
         case SOCKET_MODE::UDP:
+        case SOCKET_MODE::INPROC: // no socket, handled by the dispatcher
             break;
         case SOCKET_MODE::UDS:
-            socket_ptr = std::make_shared<uds_server>(ctx);
+            socket_ptr = std::make_shared<uds_server>(ctx, url_parse);
             break;
     }
     return socket_ptr;
@@ -49,17 +49,17 @@ client_factory* client_factory::instance() {
     return &impl;
 }
 
-std::shared_ptr<spdmq_socket> client_factory::create_socket(spdmq_ctx_t& ctx) {
+std::shared_ptr<spdmq_socket> client_factory::create_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) {
     std::shared_ptr<socket_client> socket_ptr;
-    auto socket_mode = ctx.config<socket_mode_t>("socket_mode");
-    switch (socket_mode) {
+    switch (url_parse.socket_mode) {
         case SOCKET_MODE::TCP:
-            socket_ptr = std::make_shared<tcp_client>(ctx);
+            socket_ptr = std::make_shared<tcp_client>(ctx, url_parse);
             break;
         case SOCKET_MODE::UDP:
+        case SOCKET_MODE::INPROC: // no socket, handled by the dispatcher
             break;
         case SOCKET_MODE::UDS:
-            socket_ptr = std::make_shared<uds_client>(ctx);
+            socket_ptr = std::make_shared<uds_client>(ctx, url_parse);
             break;
     }
     return socket_ptr;
@@ -24,20 +24,20 @@ namespace speed::mq {
 
 class socket_factory {
 public:
-    virtual std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx) = 0;
+    virtual std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) = 0;
     virtual ~socket_factory() {}
 };
 
 class server_factory : public socket_factory {
 public:
     static server_factory* instance();
-    std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx) override;
+    std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) override;
 };
 
 class client_factory : public socket_factory {
 public:
     static client_factory* instance();
-    std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx) override;
+    std::shared_ptr<spdmq_socket> create_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) override;
 };
 
 } /* namespace speed::mq */
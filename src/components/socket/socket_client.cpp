@@ -19,7 +19,7 @@
 
 namespace speed::mq {
 
-socket_client::socket_client (spdmq_ctx_t& ctx) : spdmq_socket(ctx) {
+socket_client::socket_client (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : spdmq_socket(ctx, url_parse) {
 }
 
 socket_client::~socket_client () {
@@ -27,15 +27,11 @@ socket_client::~socket_client () {
 }
 
 int32_t socket_client::connect () {
-    if (ctx().domain() == COMM_DOMAIN::IPV4) {
-        return ::connect(socket_fd(), reinterpret_cast<sockaddr*>(&sock_address_ipv4()), sizeof(sock_address_ipv4()));
+    if (url_parse().domain == COMM_DOMAIN::UNKNOW) {
+        return -1;
     }
 
-    if (ctx().domain() == COMM_DOMAIN::IPC) {
-        return ::connect(socket_fd(), reinterpret_cast<sockaddr*>(&sock_address_un()), sizeof(sock_address_un()));
-    }
-
-    return -1;
+    return ::connect(socket_fd(), sock_address(), sock_address_len());
 }
 
 int32_t socket_client::disconnect () {
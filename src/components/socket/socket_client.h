@@ -28,7 +28,7 @@ private:
     spdmq_timer heart_timer_;
 
 public:
-    socket_client (spdmq_ctx_t& ctx);
+    socket_client (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     virtual ~socket_client ();
 
     int32_t connect () override;
@@ -19,6 +19,7 @@
 #include <map>
 #include <string>
 #include <cstdint>
+#include <vector>
 #include <sys/socket.h>
 
 #include "spdmq_def.h"
@@ -34,6 +35,20 @@ const std::map<comm_domain_t, int32_t> gDomainMap = {
 const std::map<comm_protocol_type_t, int32_t> gProtocolTypeMap = {
     {COMM_PROTOCOL_TYPE::TCP, SOCK_STREAM},
     {COMM_PROTOCOL_TYPE::UDP, SOCK_DGRAM},
+    {COMM_PROTOCOL_TYPE::SEQPACKET, SOCK_SEQPACKET},
 };
 
+// read size of byte stream sessions, frames larger than it grow the buffer
+constexpr std::size_t STREAM_READ_SIZE = 64 * 1024;
+
+typedef struct read_buffer {
+    std::vector<uint8_t> data;
+    std::size_t begin = 0; // first byte not yet taken as a frame
+    std::size_t end = 0;   // end of the received bytes
+    uint8_t version = 1;   // frame format of the session, see FRAME_VERSION_2
+} read_buffer_t;
+
+// minimum receive buffer of SOCK_SEQPACKET mode, the default "net.core.wmem_default" of linux
+constexpr int32_t SEQPACKET_FRAME_SIZE = 212992;
+
 } /* namespace speed::mq */
\ No newline at end of file
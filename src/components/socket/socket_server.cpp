@@ -15,42 +15,62 @@
 */
 
 #include <cstdio>
+#include <fcntl.h>
 #include <unistd.h>
+#include <netinet/in.h>
 #include "socket_server.h"
 #include "spdmq_error.hpp"
 #include "spdmq_internal_def.h"
+#include "spdmq_logger.hpp"
 
 namespace speed::mq {
 
-socket_server::socket_server (spdmq_ctx_t& ctx) : spdmq_socket(ctx) {
+socket_server::socket_server (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : spdmq_socket(ctx, url_parse) {
 }
 
 void socket_server::bind () {
-    ctx().config("server_fd", socket_fd());
-    if (ctx().domain() == COMM_DOMAIN::IPV4) {
+    // Buffer sizes are inherited by the accepted sockets
+    set_socket_opt(socket_fd());
+
+    if (url_parse().domain == COMM_DOMAIN::IPV4 || url_parse().domain == COMM_DOMAIN::IPV6) {
         // enable address reuse
         int32_t optval = 1; // 1 - enable, 0 - disenable
         int32_t rc = setsockopt(socket_fd(), SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
         SOCKET_ASSERT (rc != -1, socket_fd());
 
+        // several listeners, in this or other processes, share the address and the kernel spreads connections
+        if (ctx().socket_opt().reuseport) {
+            rc = setsockopt(socket_fd(), SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
+            SOCKET_ASSERT (rc != -1, socket_fd());
+        }
+
+        // a dual stack listener also accepts ipv4 clients as ipv4-mapped ipv6 addresses
+        if (url_parse().domain == COMM_DOMAIN::IPV6) {
+            optval = ctx().dual_stack() ? 0 : 1;
+            rc = setsockopt(socket_fd(), IPPROTO_IPV6, IPV6_V6ONLY, &optval, sizeof(optval));
+            SOCKET_ASSERT (rc != -1, socket_fd());
+        }
+
         // bind socket_fd to address
-        rc = ::bind(socket_fd(), reinterpret_cast<sockaddr*>(&sock_address_ipv4()), sizeof(sock_address_ipv4()));
+        rc = ::bind(socket_fd(), sock_address(), sock_address_len());
         SOCKET_ASSERT (rc != -1, socket_fd());
     }
 
-    if (ctx().domain() == COMM_DOMAIN::IPC) {
+    if (url_parse().domain == COMM_DOMAIN::IPC) {
 
-        auto url_parse = ctx().config<spdmq_url_parse_t>("url_parse");
-        std::string lock_address = url_parse.address + ".lock";
-        
-        // if the lock is unsuccessful, throw an exception
-        file_lock_ = std::make_shared<spdmq_filelock>(lock_address, true);
-        if (access(url_parse.address.c_str(), F_OK) == 0) {
-            unlink(url_parse.address.c_str());
+        // The abstract namespace has no socket file, the kernel releases the name with the last close
+        if (!url_parse().abstract) {
+            std::string lock_address = url_parse().address + ".lock";
+
+            // if the lock is unsuccessful, throw an exception
+            file_lock_ = std::make_shared<spdmq_filelock>(lock_address, true);
+            if (access(url_parse().address.c_str(), F_OK) == 0) {
+                unlink(url_parse().address.c_str());
+            }
         }
         
         // bind socket_fd to address
-        int32_t rc = ::bind(socket_fd(), reinterpret_cast<sockaddr*>(&sock_address_un()), sizeof(sock_address_un()));
+        int32_t rc = ::bind(socket_fd(), reinterpret_cast<sockaddr*>(&sock_address_un()), sock_address_un_len());
         SOCKET_ASSERT (rc != -1, socket_fd());
     }
 }
@@ -58,24 +78,28 @@ void socket_server::bind () {
 void socket_server::listen () {
     int32_t rc = ::listen(socket_fd(), ctx().evt_num());
     SOCKET_ASSERT (rc != -1, socket_fd());
+
+    // accept until EAGAIN without ever blocking the event thread
+    rc = fcntl(socket_fd(), F_SETFL, fcntl(socket_fd(), F_GETFL) | O_NONBLOCK);
+    SOCKET_ASSERT (rc != -1, socket_fd());
 }
 
 fd_t socket_server::accept (fd_t server_fd) {
-
-    struct timeval timeout = {0,100 * 1000};
-    setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(struct timeval));
-
     fd_t client_fd = -1;
-    if (ctx().domain() == COMM_DOMAIN::IPV4) {
-        sockaddr_in client_address;
+    if (url_parse().domain == COMM_DOMAIN::IPV4 || url_parse().domain == COMM_DOMAIN::IPV6) {
+        sockaddr_storage client_address;
         socklen_t client_address_size = sizeof(client_address);
         client_fd = ::accept(server_fd, reinterpret_cast<sockaddr*>(&client_address), &client_address_size);
     }
 
-    if (ctx().domain() == COMM_DOMAIN::IPC) {
+    if (url_parse().domain == COMM_DOMAIN::IPC) {
         client_fd = ::accept(server_fd, nullptr, nullptr);
     }
-    // printf("accept client_fd:%d\n", client_fd);
+
+    if (client_fd >= 0) {
+        set_socket_opt(client_fd);
+        LOGD_RATE(100, "accept client_fd:%d", client_fd);
+    }
     
     return client_fd;
 }
@@ -32,7 +32,7 @@ public:
     fd_t accept (fd_t server_fd) override;
 
 public:
-    socket_server (spdmq_ctx_t& ctx);
+    socket_server (spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     virtual ~socket_server () {}
 };
 
@@ -16,10 +16,15 @@
 
 #include "spdmq_socket.h"
 #include "spdmq_error.hpp"
+#include "spdmq_logger.hpp"
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <unistd.h>
 #include <fcntl.h>
+#include <net/if.h>
 #include <netinet/tcp.h>
 
 namespace speed::mq {
@@ -33,22 +38,156 @@ void spdmq_socket::open_socket (int32_t domain, int32_t type, int32_t protocol)
     ERRNO_ASSERT (rc != -1);
 }
 
+// Failures are not fatal, the socket works with the system defaults
+static void set_option(fd_t fd, int32_t level, int32_t name, const char* option, int32_t optval) {
+    if (setsockopt(fd, level, name, &optval, sizeof(optval)) == -1) {
+        LOGW("set %s to %d on fd %d failed: %s", option, optval, fd, std::strerror(errno));
+    }
+}
+
+// The kernel caps buffer sizes at net.core.wmem_max/rmem_max without failing, and reports them doubled
+static void set_buffer(fd_t fd, int32_t name, const char* option, int32_t optval) {
+    set_option(fd, SOL_SOCKET, name, option, optval);
+    int32_t actual = 0;
+    socklen_t opt_len = sizeof(actual);
+    if (getsockopt(fd, SOL_SOCKET, name, &actual, &opt_len) == 0 && actual / 2 < optval) {
+        LOGW("%s of fd %d capped at %d bytes instead of %d", option, fd, actual / 2, optval);
+    }
+}
+
+void spdmq_socket::set_socket_opt (fd_t fd) {
+    auto& socket_opt = ctx().socket_opt();
+    if (socket_opt.send_buffer) {
+        set_buffer(fd, SO_SNDBUF, "SO_SNDBUF", socket_opt.send_buffer);
+    }
+    if (socket_opt.recv_buffer) {
+        set_buffer(fd, SO_RCVBUF, "SO_RCVBUF", socket_opt.recv_buffer);
+    }
+
+    // The rest only makes sense for tcp
+    if (url_parse().socket_mode != SOCKET_MODE::TCP) {
+        return;
+    }
+
+    if (socket_opt.tcp_nodelay) {
+        set_option(fd, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
+    }
+    if (socket_opt.tcp_quickack) {
+        // Not sticky, the kernel goes back to delayed ACKs, so on_read_data sets it again after each recv
+        quickack_ = true;
+        set_option(fd, IPPROTO_TCP, TCP_QUICKACK, "TCP_QUICKACK", 1);
+    }
+    if (socket_opt.keepalive) {
+        set_option(fd, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+        if (socket_opt.keepalive_idle) {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE", socket_opt.keepalive_idle);
+        }
+        if (socket_opt.keepalive_interval) {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL", socket_opt.keepalive_interval);
+        }
+        if (socket_opt.keepalive_count) {
+            set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, "TCP_KEEPCNT", socket_opt.keepalive_count);
+        }
+    }
+}
+
+void spdmq_socket::set_nonblocking (fd_t fd) {
+    const int flags = fcntl (fd, F_GETFL);
+    ERRNO_ASSERT (flags != -1 && fcntl (fd, F_SETFL, flags | O_NONBLOCK) != -1);
+}
+
+bool spdmq_socket::same_host (fd_t fd) {
+    // A unix domain peer is, an IP peer when it has a loopback address or the local address of the connection
+    sockaddr_storage local = {}, peer = {};
+    socklen_t local_len = sizeof(local), peer_len = sizeof(peer);
+    if (getsockname (fd, reinterpret_cast<sockaddr*>(&local), &local_len) != 0 ||
+        getpeername (fd, reinterpret_cast<sockaddr*>(&peer), &peer_len) != 0) {
+        return false;
+    }
+
+    if (peer.ss_family == AF_UNIX) {
+        return true;
+    }
+    if (peer.ss_family == AF_INET) {
+        auto& local_addr = reinterpret_cast<sockaddr_in&>(local).sin_addr;
+        auto& peer_addr = reinterpret_cast<sockaddr_in&>(peer).sin_addr;
+        return (ntohl (peer_addr.s_addr) >> 24) == 127 || peer_addr.s_addr == local_addr.s_addr;
+    }
+    if (peer.ss_family == AF_INET6) {
+        auto& local_addr = reinterpret_cast<sockaddr_in6&>(local).sin6_addr;
+        auto& peer_addr = reinterpret_cast<sockaddr_in6&>(peer).sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK (&peer_addr) || (IN6_IS_ADDR_V4MAPPED (&peer_addr) && peer_addr.s6_addr[12] == 127) ||
+               IN6_ARE_ADDR_EQUAL (&peer_addr, &local_addr);
+    }
+    return false;
+}
+
 void spdmq_socket::close_socket () {
+    read_buffer_map_.erase(socket_fd_);
     if (socket_fd_ >= 3) {
         close(socket_fd_);
         socket_fd_ = -1;
     }
 }
 
-int32_t spdmq_socket::on_read_data(int32_t session_id, uint8_t* buf, int32_t buf_len) {
-    int32_t total_bytes_received = 0, bytes_received = 0;
+int32_t spdmq_socket::on_read_data(int32_t session_id, std::vector<uint8_t>& frame) {
+    auto& buffer = read_buffer_map_[session_id];
 
-    // 分段读取数据体
-    while (total_bytes_received < buf_len) {
-        bytes_received = recv(session_id, buf + total_bytes_received, buf_len - total_bytes_received, 0);
-        // printf("bytes_received:%d, errno:%d, errno msg:%s\n", bytes_received, errno, std::strerror(errno));
+    while (true) {
+        comm_header_t header;
+        // Take a complete frame from the buffer, one recv may have brought in several of them
+        std::size_t buffered = buffer.end - buffer.begin;
+        std::size_t frame_len = sizeof header;
+        if (buffer.version >= FRAME_VERSION_2) {
+            // A varint length of at most 5 bytes, only the body is taken
+            const uint8_t* begin = buffer.data.data() + buffer.begin;
+            auto body = begin;
+            uint64_t body_len;
+            if (get_varint(body, begin + buffered, body_len)) {
+                if (body_len == 0 || body_len > INT32_MAX) {
+                    errno = EPROTO;
+                    return 0;
+                }
+                frame_len = (body - begin) + body_len;
+                if (buffered >= frame_len) {
+                    frame.assign(body, begin + frame_len);
+                    buffer.begin += frame_len;
+                    return body_len;
+                }
+            }
+            else if (buffered >= 5) {
+                errno = EPROTO;
+                return 0;
+            }
+        }
+        else if (buffered >= sizeof header) {
+            memcpy(&header, buffer.data.data() + buffer.begin, sizeof header);
+            if (header.comm_msg_len <= 0) {
+                // Corrupted stream, there is no way to find the next frame boundary
+                errno = EPROTO;
+                return 0;
+            }
+            frame_len += header.comm_msg_len;
+            if (buffered >= frame_len) {
+                auto begin = buffer.data.data() + buffer.begin;
+                frame.assign(begin, begin + frame_len);
+                buffer.begin += frame_len;
+                return header.comm_msg_len;
+            }
+        }
 
-        if (bytes_received <= 0) {
+        // Keep the partial frame at the front and make room for the rest of it
+        if (buffer.begin > 0) {
+            memmove(buffer.data.data(), buffer.data.data() + buffer.begin, buffered);
+            buffer.begin = 0;
+            buffer.end = buffered;
+        }
+        if (buffer.data.size() < std::max(frame_len, STREAM_READ_SIZE)) {
+            buffer.data.resize(std::max(frame_len, STREAM_READ_SIZE));
+        }
+
+        auto bytes_received = recv(session_id, buffer.data.data() + buffer.end, buffer.data.size() - buffer.end, MSG_DONTWAIT);
+        if (bytes_received < 0) {
             ERRNO_ASSERT (errno != EBADF && errno != EFAULT && errno != ENOMEM && errno != ENOTSOCK);
 
             // Interrupted system call
@@ -56,44 +195,120 @@ int32_t spdmq_socket::on_read_data(int32_t session_id, uint8_t* buf, int32_t buf
                 continue;
             }
 
-            return bytes_received;
+            // EAGAIN, wait for the next read event
+            return -1;
         }
 
-        total_bytes_received += bytes_received;
-    }
+        if (bytes_received == 0) {
+            return 0;
+        }
+        if (quickack_) {
+            int32_t optval = 1;
+            setsockopt(session_id, IPPROTO_TCP, TCP_QUICKACK, &optval, sizeof(optval));
+        }
 
-    return total_bytes_received;
+        buffer.end += bytes_received;
+    }
 }
 
-int32_t spdmq_socket::read_data(int32_t session_id, comm_header_t& header, std::vector<uint8_t>& body) {
+int32_t spdmq_socket::on_read_packet(int32_t session_id, std::vector<uint8_t>& frame) {
+    if (packet_buffer_.empty()) {
+        int32_t buf_len = 0;
+        socklen_t opt_len = sizeof buf_len;
+        getsockopt(session_id, SOL_SOCKET, SO_RCVBUF, &buf_len, &opt_len);
+        packet_buffer_.resize(std::max(buf_len, SEQPACKET_FRAME_SIZE));
+    }
+
+    iovec iov = {packet_buffer_.data(), packet_buffer_.size()};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    while (true) {
+        int32_t bytes_received = recvmsg(session_id, &msg, MSG_DONTWAIT);
+        if (bytes_received < 0) {
+            ERRNO_ASSERT (errno != EBADF && errno != EFAULT && errno != ENOMEM && errno != ENOTSOCK);
+
+            // Interrupted system call
+            if (errno == EINTR) {
+                continue;
+            }
+        }
+
+        if (bytes_received <= 0) {
+            return bytes_received;
+        }
+
+        // The frame is larger than the receive buffer, the kernel has already discarded the tail
+        if (msg.msg_flags & MSG_TRUNC) {
+            msg.msg_flags = 0;
+            continue;
+        }
 
-    // Read data header
-    int32_t bytes_received = on_read_data(session_id, (uint8_t*)&header, sizeof header);
-    if (bytes_received <= 0) {
+        // Give the packet the same length prefix as a frame of the byte stream
+        comm_header_t header;
+        header.comm_msg_len = bytes_received;
+        frame.resize(sizeof header + bytes_received);
+        memcpy(frame.data(), &header, sizeof header);
+        memcpy(frame.data() + sizeof header, packet_buffer_.data(), bytes_received);
         return bytes_received;
     }
+}
+
+int32_t spdmq_socket::read_data(int32_t session_id, std::vector<uint8_t>& frame) {
+    // Either way the frame is comm_header_t followed by the body, the body length is returned,
+    // a session switched to v2 gets the body alone
 
-    // Read data body
-    body.resize(header.comm_msg_len);
-    return on_read_data(session_id, body.data(), header.comm_msg_len);
+    // One frame per packet, no header to parse
+    if (url_parse().protocol_type == COMM_PROTOCOL_TYPE::SEQPACKET) {
+        return on_read_packet(session_id, frame);
+    }
+
+    // Length-prefixed frames of the byte stream
+    return on_read_data(session_id, frame);
 };
 
-int32_t spdmq_socket::write_data(int32_t session_id, const comm_header_t& header, const std::vector<uint8_t>& body) {
+void spdmq_socket::remove_read_buffer(int32_t session_id) {
+    read_buffer_map_.erase(session_id);
+}
 
-    // Send data header
-    int32_t ret = send(session_id, &header, sizeof header, MSG_NOSIGNAL);
-    if (ret <= 0) {
+void spdmq_socket::read_version(int32_t session_id, uint8_t version) {
+    // Takes effect from the next frame, bytes already buffered behind the current one included
+    read_buffer_map_[session_id].version = version;
+}
+
+int32_t spdmq_socket::write_data(int32_t session_id, const std::vector<uint8_t>& frame, std::size_t offset) {
+    // Never blocks, returns the bytes written from offset, or -1 with errno set (EAGAIN - the socket is full)
+    while (true) {
+        int32_t ret;
+        if (url_parse().protocol_type == COMM_PROTOCOL_TYPE::SEQPACKET) {
+            // One frame per packet, the length is carried by the packet itself, so the header is left out
+            ret = send(session_id, frame.data() + sizeof(comm_header_t), frame.size() - sizeof(comm_header_t), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (ret >= 0) {
+                ret = frame.size() - offset;
+            }
+        }
+        else {
+            // Header and body are contiguous, one call per frame
+            ret = send(session_id, frame.data() + offset, frame.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+
+        // Interrupted system call
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
         return ret;
     }
-
-    // Send data body
-    return send(session_id, body.data(), body.size(), MSG_NOSIGNAL);
 };
 
 spdmq_ctx_t& spdmq_socket::ctx() {
     return ctx_;
 }
 
+const spdmq_url_parse_t& spdmq_socket::url_parse() {
+    return url_parse_;
+}
+
 fd_t& spdmq_socket::socket_fd () {
     return socket_fd_;
 }
@@ -102,6 +317,10 @@ sockaddr_un& spdmq_socket::sock_address_un() {
     return sock_address_un_;
 }
 
+socklen_t spdmq_socket::sock_address_un_len() {
+    return sock_address_un_len_;
+}
+
 sockaddr_in& spdmq_socket::sock_address_ipv4() {
     return sock_address_ipv4_;
 }
@@ -110,26 +329,66 @@ sockaddr_in6& spdmq_socket::sock_address_ipv6() {
     return sock_address_ipv6_;
 }
 
+sockaddr* spdmq_socket::sock_address() {
+    switch (url_parse().domain) {
+        case COMM_DOMAIN::IPV4:
+            return reinterpret_cast<sockaddr*>(&sock_address_ipv4_);
+        case COMM_DOMAIN::IPV6:
+            return reinterpret_cast<sockaddr*>(&sock_address_ipv6_);
+        case COMM_DOMAIN::IPC:
+            return reinterpret_cast<sockaddr*>(&sock_address_un_);
+        default:
+            return nullptr;
+    }
+}
+
+socklen_t spdmq_socket::sock_address_len() {
+    switch (url_parse().domain) {
+        case COMM_DOMAIN::IPV4:
+            return sizeof(sock_address_ipv4_);
+        case COMM_DOMAIN::IPV6:
+            return sizeof(sock_address_ipv6_);
+        case COMM_DOMAIN::IPC:
+            return sock_address_un_len_;
+        default:
+            return 0;
+    }
+}
+
 void spdmq_socket::resolve_address() {
-    if (ctx().domain() == COMM_DOMAIN::IPV4) {
-        sock_address_ipv4_.sin_family = gDomainMap.at(ctx().domain());
-        auto url_parse = ctx().config<spdmq_url_parse_t>("url_parse");
-        inet_pton(gDomainMap.at(ctx().domain()), url_parse.ip.data(), &(sock_address_ipv4_.sin_addr));
-        sock_address_ipv4_.sin_port = htons(url_parse.port);
+    if (url_parse().domain == COMM_DOMAIN::IPV4) {
+        sock_address_ipv4_.sin_family = gDomainMap.at(url_parse().domain);
+        inet_pton(gDomainMap.at(url_parse().domain), url_parse().ip.data(), &(sock_address_ipv4_.sin_addr));
+        sock_address_ipv4_.sin_port = htons(url_parse().port);
         return;
     }
-    if (ctx().domain() == COMM_DOMAIN::IPV6) {
+    if (url_parse().domain == COMM_DOMAIN::IPV6) {
+        sock_address_ipv6_ = {};
+        sock_address_ipv6_.sin6_family = gDomainMap.at(url_parse().domain);
+        inet_pton(gDomainMap.at(url_parse().domain), url_parse().ip.data(), &(sock_address_ipv6_.sin6_addr));
+        sock_address_ipv6_.sin6_port = htons(url_parse().port);
+        if (!url_parse().scope.empty()) {
+            sock_address_ipv6_.sin6_scope_id = if_nametoindex(url_parse().scope.c_str());
+        }
         return;
     }
-    if (ctx().domain() == COMM_DOMAIN::IPC) {
-        sock_address_un_.sun_family = gDomainMap.at(ctx().domain());
-        auto url_parse = ctx().config<spdmq_url_parse_t>("url_parse");
-        strncpy(sock_address_un_.sun_path, url_parse.address.data(), sizeof(sock_address_un_.sun_path) - 1);
+    if (url_parse().domain == COMM_DOMAIN::IPC) {
+        sock_address_un_ = {};
+        sock_address_un_.sun_family = gDomainMap.at(url_parse().domain);
+        if (url_parse().abstract) {
+            // The abstract name starts with '\0' and its length is given by the address length, not a terminator
+            memcpy(sock_address_un_.sun_path + 1, url_parse().address.data(), url_parse().address.size());
+            sock_address_un_len_ = offsetof(sockaddr_un, sun_path) + 1 + url_parse().address.size();
+        }
+        else {
+            strncpy(sock_address_un_.sun_path, url_parse().address.data(), sizeof(sock_address_un_.sun_path) - 1);
+            sock_address_un_len_ = sizeof(sock_address_un_);
+        }
         return;
     }
 }
 
-spdmq_socket::spdmq_socket(spdmq_ctx_t& ctx): ctx_(ctx) {
+spdmq_socket::spdmq_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse): ctx_(ctx), url_parse_(url_parse) {
 }
 
 spdmq_socket::~spdmq_socket () {
@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
+#include <map>
 #include <vector>
 
 namespace speed::mq {
@@ -33,9 +34,14 @@ class spdmq_socket {
 private:
     fd_t socket_fd_;
     sockaddr_un sock_address_un_;
+    socklen_t sock_address_un_len_ = sizeof(sockaddr_un);
     sockaddr_in sock_address_ipv4_;
     sockaddr_in6 sock_address_ipv6_;
     spdmq_ctx_t& ctx_;
+    spdmq_url_parse_t url_parse_; // endpoint of this socket
+    std::vector<uint8_t> packet_buffer_; // receive buffer of SOCK_SEQPACKET mode
+    std::map<int32_t, read_buffer_t> read_buffer_map_; // partial frames of byte stream sessions, used by the event thread only
+    bool quickack_ = false;              // TCP_QUICKACK is set again after each recv, see set_socket_opt
 
 public:
     virtual void open_socket () {};
@@ -47,25 +53,35 @@ public:
     virtual void start_heart (std::function<void ()> task) {}
     virtual void stop_heart () {}
 
-    int32_t read_data(int32_t session_id, comm_header_t& header, std::vector<uint8_t>& data);    
-    int32_t write_data(int32_t session_id, const comm_header_t& header, const std::vector<uint8_t>& data);
+    int32_t read_data(int32_t session_id, std::vector<uint8_t>& frame);
+    int32_t write_data(int32_t session_id, const std::vector<uint8_t>& frame, std::size_t offset);
+    void remove_read_buffer(int32_t session_id);
+    void read_version(int32_t session_id, uint8_t version);
 
 public:
     void open_socket (int32_t domain, int32_t type, int32_t protocol);
     spdmq_ctx_t& ctx ();
+    const spdmq_url_parse_t& url_parse ();
     fd_t& socket_fd ();
     sockaddr_un& sock_address_un ();
+    socklen_t sock_address_un_len ();
     sockaddr_in& sock_address_ipv4 ();
     sockaddr_in6& sock_address_ipv6 ();
+    sockaddr* sock_address ();
+    socklen_t sock_address_len ();
     void resolve_address ();
+    void set_socket_opt (fd_t fd);
+    void set_nonblocking (fd_t fd);
+    bool same_host (fd_t fd);
     void close_socket ();
 
 public:
-    spdmq_socket(spdmq_ctx_t& ctx);
+    spdmq_socket(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     virtual ~spdmq_socket();
 
 private:
-    int32_t on_read_data(int32_t session_id, uint8_t* buf, int32_t buf_len);
+    int32_t on_read_data(int32_t session_id, std::vector<uint8_t>& frame);
+    int32_t on_read_packet(int32_t session_id, std::vector<uint8_t>& frame);
 };
 
 } /* namespace speed::mq */
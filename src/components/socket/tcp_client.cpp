@@ -19,10 +19,11 @@
 
 namespace speed::mq {
 
-tcp_client::tcp_client(spdmq_ctx_t& ctx) : socket_client(ctx) {}
+tcp_client::tcp_client(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : socket_client(ctx, url_parse) {}
 
 void tcp_client::open_socket () {
-    spdmq_socket::open_socket(gDomainMap.at(ctx().domain()), SOCK_STREAM, 0);
+    spdmq_socket::open_socket(gDomainMap.at(url_parse().domain), SOCK_STREAM, 0);
+    set_socket_opt(socket_fd());
 }
 
 } /* namespace speed::mq */
\ No newline at end of file
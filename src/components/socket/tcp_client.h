@@ -21,7 +21,7 @@ namespace speed::mq {
 
 class tcp_client: public socket_client {
 public:
-    tcp_client(spdmq_ctx_t& ctx);
+    tcp_client(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     void open_socket () override;
 };
 
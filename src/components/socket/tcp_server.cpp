@@ -18,10 +18,10 @@
 
 namespace speed::mq {
 
-tcp_server::tcp_server(spdmq_ctx_t& ctx) : socket_server(ctx) {}
+tcp_server::tcp_server(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : socket_server(ctx, url_parse) {}
 
 void tcp_server::open_socket () {
-    spdmq_socket::open_socket(gDomainMap.at(ctx().domain()), SOCK_STREAM, 0);
+    spdmq_socket::open_socket(gDomainMap.at(url_parse().domain), SOCK_STREAM, 0);
 }
 
 
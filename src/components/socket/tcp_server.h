@@ -21,7 +21,7 @@ namespace speed::mq {
 
 class tcp_server: public socket_server {
 public:
-    tcp_server(spdmq_ctx_t& ctx);
+    tcp_server(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     void open_socket () override;
 
 public:
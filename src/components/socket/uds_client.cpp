@@ -18,10 +18,11 @@
 
 namespace speed::mq {
 
-uds_client::uds_client(spdmq_ctx_t& ctx) : socket_client(ctx) {}
+uds_client::uds_client(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : socket_client(ctx, url_parse) {}
 
 void uds_client::open_socket () {
-    spdmq_socket::open_socket(gDomainMap.at(ctx().domain()), gProtocolTypeMap.at(ctx().protocol_type()), 0);
+    spdmq_socket::open_socket(gDomainMap.at(url_parse().domain), gProtocolTypeMap.at(url_parse().protocol_type), 0);
+    set_socket_opt(socket_fd());
 }
 
 } /* namespace speed::mq */
\ No newline at end of file
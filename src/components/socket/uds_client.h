@@ -21,7 +21,7 @@ namespace speed::mq {
 
 class uds_client: public socket_client {
 public:
-    uds_client(spdmq_ctx_t& ctx);
+    uds_client(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     void open_socket () override;
 };
 
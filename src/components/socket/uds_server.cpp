@@ -18,10 +18,10 @@
 
 namespace speed::mq {
 
-uds_server::uds_server(spdmq_ctx_t& ctx) : socket_server(ctx) {}
+uds_server::uds_server(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse) : socket_server(ctx, url_parse) {}
 
 void uds_server::open_socket () {
-    spdmq_socket::open_socket(gDomainMap.at(ctx().domain()), gProtocolTypeMap.at(ctx().protocol_type()), 0);
+    spdmq_socket::open_socket(gDomainMap.at(url_parse().domain), gProtocolTypeMap.at(url_parse().protocol_type), 0);
 }
 
 } /* namespace speed::mq */
\ No newline at end of file
@@ -21,7 +21,7 @@ namespace speed::mq {
 
 class uds_server: public socket_server {
 public:
-    uds_server(spdmq_ctx_t& ctx);
+    uds_server(spdmq_ctx_t& ctx, const spdmq_url_parse_t& url_parse);
     void open_socket () override;
 
 public:
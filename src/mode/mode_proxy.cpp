@@ -0,0 +1,132 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "mode_proxy.h"
+#include "spdmq_spinlock.hpp"
+
+namespace speed::mq {
+
+mode_proxy::mode_proxy(spdmq_ctx& ctx) : spdmq_mode(ctx) {
+}
+
+void mode_proxy::registered() {
+
+    handler()->registered_company(ctx());
+
+    handler()->porter_ptr()->on_frame = [this](int32_t session_id, std::vector<uint8_t>& frame) {
+        return frame_deal(session_id, frame);
+    };
+
+    handler()->porter_ptr()->on_online = [this](auto&& T) {
+        on_online(std::forward<decltype(T)>(T));
+    };
+
+    handler()->porter_ptr()->on_offline = [this](auto&& T) {
+        on_offline(std::forward<decltype(T)>(T));
+    };
+}
+
+void mode_proxy::on_online(comm_msg_t&& msg) {
+    if (handler()->porter_ptr()->outgoing(msg.session_id)) {
+        // A new publisher gets every topic the downstream has asked for so far
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        upstream_sessions_.insert(msg.session_id);
+        for (auto& topic_set : subscribe_table_) {
+            topic_forward(msg.session_id, topic_set.first);
+        }
+    }
+    spdmq_mode::on_online(std::move(msg));
+}
+
+void mode_proxy::on_offline(comm_msg_t&& msg) {
+    {
+        // Publishers keep the topics, there is no unsubscribe message, their data is dropped here
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        upstream_sessions_.erase(msg.session_id);
+        for (auto it = subscribe_table_.begin(); it != subscribe_table_.end();) {
+            it->second.erase(msg.session_id);
+            it = it->second.empty() ? subscribe_table_.erase(it) : std::next(it);
+        }
+    }
+    spdmq_mode::on_offline(std::move(msg));
+}
+
+bool mode_proxy::frame_deal(int32_t session_id, std::vector<uint8_t>& frame) {
+    message_type_t msg_type;
+    std::string_view topic;
+    if (!peek_comm_frame(frame, msg_type, topic)) {
+        return true;
+    }
+
+    // Heartbeats are handled by the porter
+    if (MESSAGE_TYPE::HEARTBEAT == msg_type) {
+        return false;
+    }
+
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto upstream = upstream_sessions_.count(session_id) > 0;
+
+    // Data of a publisher goes to the subscribers of its topic, the frame is moved, not copied
+    if (MESSAGE_TYPE::DATA == msg_type && upstream) {
+        auto it = subscribe_table_.find(topic);
+        if (it != subscribe_table_.end()) {
+            // Numbered again, a subscriber would take the interleaved sequences of several publishers for gaps and restarts.
+            // A gap upstream of the proxy is not seen downstream.
+            auto sequence = comm_frame_sequence(frame.data(), frame.size());
+            if (sequence) {
+                auto last = sequence_map_.find(topic);
+                if (last == sequence_map_.end()) {
+                    last = sequence_map_.emplace(std::string(topic), 0).first;
+                }
+                ++last->second;
+                std::memcpy(sequence, &last->second, sizeof(last->second));
+            }
+
+            // The topic refers to the buffer of the frame, which moves along with it
+            handler()->porter_ptr()->send_frame(it->second, std::make_shared<const std::vector<uint8_t>>(std::move(frame)), topic);
+        }
+        return true;
+    }
+
+    // The first subscriber of a topic subscribes the proxy to it on every publisher
+    if (MESSAGE_TYPE::TOPIC == msg_type && !upstream) {
+        auto it = subscribe_table_.find(topic);
+        if (it == subscribe_table_.end()) {
+            it = subscribe_table_.emplace(std::string(topic), std::set<int32_t>()).first;
+            for (auto upstream_session : upstream_sessions_) {
+                topic_forward(upstream_session, it->first);
+            }
+        }
+        it->second.insert(session_id);
+
+        // The conflation wish of a subscriber applies to the outbox of the proxy towards it
+        comm_msg_t msg;
+        deserialize_comm_msg_t(frame.data() + sizeof(comm_header_t), frame.size() - sizeof(comm_header_t), msg);
+        if (topic_conflated(msg.payload)) {
+            handler()->porter_ptr()->conflate(session_id, msg.topic);
+        }
+    }
+    return true;
+}
+
+void mode_proxy::topic_forward(int32_t session_id, const std::string& topic) {
+    comm_msg_t msg(session_id);
+    msg.topic = topic;
+    msg.msg_type = MESSAGE_TYPE::TOPIC;
+    handler()->porter_ptr()->send_msg(session_id, msg);
+}
+
+} /* namespace speed::mq */
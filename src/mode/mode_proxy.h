@@ -0,0 +1,50 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <set>
+#include <map>
+#include "spdmq_mode.h"
+
+namespace speed::mq {
+
+// Forwarder between publishers and subscribers: connect reaches upstream publishers as a subscriber,
+// bind serves downstream subscribers as a publisher. Data frames are relayed as they were received,
+// but for their sequence, which the proxy numbers per topic itself: the publishers behind it count apart.
+// Its sessions stay on the v1 frame format whatever spdmq_ctx::frame_version says, v2 frames would have to be decoded and encoded again.
+class mode_proxy : public spdmq_mode {
+private:
+    std::map<std::string, std::set<int32_t>, std::less<>> subscribe_table_; // subscription topic table of downstream sessions
+    std::set<int32_t> upstream_sessions_;                                  // sessions to publishers
+    std::map<std::string, uint64_t, std::less<>> sequence_map_;            // topic -> sequence of the latest data relayed
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+
+public:
+    mode_proxy(spdmq_ctx& ctx);
+
+    void registered() override;
+
+    void on_online(comm_msg_t&& msg) override;
+
+    void on_offline(comm_msg_t&& msg) override;
+
+private:
+    bool frame_deal(int32_t session_id, std::vector<uint8_t>& frame);
+    void topic_forward(int32_t session_id, const std::string& topic);
+};
+
+} /* namespace speed::mq */
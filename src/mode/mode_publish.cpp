@@ -19,27 +19,110 @@
 
 namespace speed::mq {
 
+// Frames a replay keeps queued for a subscriber when send_hwm does not bound it
+constexpr std::size_t REPLAY_BATCH = 512;
+// How soon a replay to an inproc subscriber whose ring is full is tried again
+constexpr std::chrono::milliseconds REPLAY_RETRY(1);
+
 mode_publish::mode_publish(spdmq_ctx& ctx) : spdmq_mode(ctx) {
 }
 
 spdmq_code_t mode_publish::send(spdmq_msg_t& msg) {
+    return publish(msg, nullptr);
+}
+
+spdmq_code_t mode_publish::send(spdmq_msg_t& msg, const spdmq_payload_t& payload) {
+    msg.payload.clear();
+    return publish(msg, &payload);
+}
+
+spdmq_code_t mode_publish::publish(spdmq_msg_t& msg, const spdmq_payload_t* payload) {
+    // Nobody has subscribed before the first bind or connect
+    if (!companied()) {
+        return SPDMQ_CODE_OK;
+    }
+
     comm_msg_t comm_msg;
-    spdmq_msg_to_comm_msg(msg, comm_msg);
+    if (!msg.ttl) {
+        msg.ttl = runtime().topic_ttl(msg.topic);
+    }
+    spdmq_msg_to_comm_msg(msg, comm_msg, runtime().monotonic_stamp);
     comm_msg.msg_type = MESSAGE_TYPE::DATA;
     spdmq_spinlock<std::atomic_flag> lk(lock_);
-    // printf("mode_publish::send before\n");
-    for (auto& session_id : subscribe_table_[comm_msg.topic]) {
-        // printf("mode_publish::send in\n");
-        handler()->porter_ptr()->send_msg(session_id, comm_msg);
+    auto& history = history_of(comm_msg.topic);
+    comm_msg.sequence = ++history.sequence;
+    auto depth = std::max<std::size_t>(runtime().replay_depth, runtime().last_value_cache ? 1 : 0);
+    auto it = subscribe_table_.find(comm_msg.topic);
+
+    // A payload written in place goes straight into the frame, unless the message is also kept
+    // or handed to inproc subscribers, which take it without a frame
+    bool inproc = it != subscribe_table_.end() && !it->second.empty() && is_inproc_session(*it->second.begin());
+    if (payload && (history.log || depth || !credit_map_.empty() || inproc)) {
+        comm_msg.payload.resize(payload->size);
+        if (payload->size) {
+            payload->write(payload->value, comm_msg.payload.data());
+        }
+        payload = nullptr;
+    }
+    if (history.log) {
+        history.log->append(comm_msg);
+    }
+    if (depth) {
+        history.recent.push_back(comm_msg);
+        if (history.recent.size() > depth) {
+            history.recent.pop_front();
+        }
+    }
+    if (it == subscribe_table_.end()) {
+        return SPDMQ_CODE_OK;
+    }
+    if (payload) {
+        auto frame = std::make_shared<std::vector<uint8_t>>();
+        serialize_comm_frame(comm_msg, *payload, *frame);
+        return handler()->porter_ptr()->send_frame(it->second, frame, comm_msg.topic);
+    }
+    if (credit_map_.empty()) {
+        return handler()->porter_ptr()->send_msg(it->second, std::move(comm_msg));
     }
 
-    return SPDMQ_CODE_OK;
+    // A subscriber out of credit is skipped instead of queuing more for it,
+    // only the latest message of a topic it conflates is kept until credit comes back.
+    // The credit of a message its session refused, at the high-water mark, is given back at once.
+    auto ret = SPDMQ_CODE_OK;
+    auto bytes = comm_msg.payload.size();
+    std::set<int32_t> session_ids;
+    for (auto session_id : it->second) {
+        auto credit = credit_map_.find(session_id);
+        if (credit == credit_map_.end() || credit_take(credit->second, comm_msg.payload.size())) {
+            session_ids.insert(session_id);
+        }
+        else if (credit->second.conflate_topics.count(comm_msg.topic)) {
+            credit->second.parked[comm_msg.topic] = comm_msg;
+        }
+        else {
+            ret = SPDMQ_CODE_SEND_FAILED_NO_CREDIT;
+        }
+    }
+    std::set<int32_t> refused;
+    handler()->porter_ptr()->send_msg(session_ids, std::move(comm_msg), &refused);
+    for (auto session_id : refused) {
+        auto credit = credit_map_.find(session_id);
+        if (credit != credit_map_.end()) {
+            credit_refund(credit->second, bytes);
+        }
+    }
+    return ret;
 }
 
 void mode_publish::registered() {
 
     handler()->registered_company(ctx());
 
+    // Credit is handled on the event thread, it must not wait behind the receive queue
+    handler()->porter_ptr()->on_arrive = [this](comm_msg_t& msg) {
+        return MESSAGE_TYPE::CREDIT == msg.msg_type && credit_deal(msg);
+    };
+
     handler()->porter_ptr()->on_recv = [this](auto&& T) {
         on_recv(std::forward<decltype(T)>(T));
     };
@@ -53,6 +136,16 @@ void mode_publish::registered() {
     handler()->porter_ptr()->on_offline = [this](auto&& T) {
         on_offline(std::forward<decltype(T)>(T));
     };
+
+    // Replays from the journal go on on the event thread, when woken up or when the outbound queue has been written
+    if (!ctx().journal().path.empty()) {
+        handler()->porter_ptr()->on_timer = [this] {
+            replay_all();
+        };
+        handler()->porter_ptr()->on_drain = [this](int32_t session_id) {
+            replay(session_id);
+        };
+    }
 }
 
 void mode_publish::on_recv(comm_msg_t&& msg) {
@@ -61,6 +154,11 @@ void mode_publish::on_recv(comm_msg_t&& msg) {
 
 void mode_publish::on_offline(comm_msg_t&& msg) {
     session_remove(msg.session_id);
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        credit_map_.erase(msg.session_id);
+        replaying_.erase(msg.session_id);
+    }
     if (on_mode_offline) {
         spdmq_msg_t spdmq_msg;
         comm_msg_to_spdmq_msg(msg, spdmq_msg);
@@ -69,17 +167,293 @@ void mode_publish::on_offline(comm_msg_t&& msg) {
 }
 
 void mode_publish::msg_deal(const comm_msg_t& msg) {
-    // printf("msg_deal session id:%d\n", msg.session_id);
     if (MESSAGE_TYPE::TOPIC == msg.msg_type) {
-        // printf("msg_deal in\n");
-        topic_insert(msg.session_id, msg.topic);
+        topic_insert(msg);
+    }
+}
+
+void mode_publish::topic_insert(const comm_msg_t& msg) {
+    auto conflated = topic_conflated(msg.payload);
+    if (conflated) {
+        handler()->porter_ptr()->conflate(msg.session_id, msg.topic);
+    }
+
+    uint64_t sequence = 0;
+    int64_t time_stamp = 0;
+    auto replay_after = topic_replay(msg.payload, sequence);
+    auto replay_since = !replay_after && topic_replay_since(msg.payload, time_stamp);
+
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    auto credit = credit_map_.end();
+    if (conflated) {
+        credit = credit_map_.emplace(msg.session_id, credit_session_t()).first;
+        credit->second.conflate_topics.insert(msg.topic);
+    }
+    else {
+        credit = credit_map_.find(msg.session_id);
+    }
+
+    // A journaled topic is replayed apart from the live messages, the subscriber joins them once it has caught up
+    auto& history = history_of(msg.topic);
+    if (history.log && (replay_after || replay_since)) {
+        auto from = replay_after ? sequence + 1 : history.log->sequence_since(time_stamp);
+        auto& replaying = replaying_[msg.session_id];
+        if (!replaying.count(msg.topic)) {
+            replaying[msg.topic] = {history.log, from, ++replay_id_};
+            handler()->porter_ptr()->wake_at(std::chrono::steady_clock::now());
+        }
+        return;
+    }
+
+    subscribe_table_[msg.topic].insert(msg.session_id);
+    if (history.recent.empty()) {
+        return;
+    }
+    // Expired messages are skipped before they take any credit
+    auto now = now_usecs_timestamp();
+    auto deliver = [&](const comm_msg_t& recent) {
+        if (recent.expired(now)) {
+            handler()->porter_ptr()->expired(msg.topic, 1);
+            return true;
+        }
+        if (credit == credit_map_.end() || credit_take(credit->second, recent.payload.size())) {
+            if (handler()->porter_ptr()->send_msg(msg.session_id, recent) != SPDMQ_CODE_OK && credit != credit_map_.end()) {
+                credit_refund(credit->second, recent.payload.size());
+            }
+            return true;
+        }
+        if (conflated) {
+            credit->second.parked[msg.topic] = recent;
+        }
+        return false;
+    };
+
+    // A reconnected subscriber gets what it missed as far back as the history reaches,
+    // it finds out about anything older from the gap in the sequence
+    if (replay_after || replay_since) {
+        for (auto& recent : history.recent) {
+            if ((replay_after ? recent.sequence > sequence : recent.send_time_stamp >= time_stamp) && !deliver(recent)) {
+                break;
+            }
+        }
+        return;
+    }
+
+    // A new subscriber starts from the latest message instead of waiting for the next one
+    if (runtime().last_value_cache) {
+        deliver(history.recent.back());
+    }
+}
+
+void mode_publish::replay(int32_t session_id) {
+    std::vector<std::pair<std::string, replay_state_t>> topics;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        auto it = replaying_.find(session_id);
+        if (it == replaying_.end()) {
+            return;
+        }
+        topics.assign(it->second.begin(), it->second.end());
+    }
+
+    // Called with lock_ held, null - the session has gone offline or the replay was finished meanwhile
+    auto state_of = [&](const std::string& topic, uint64_t id) -> replay_state_t* {
+        auto it = replaying_.find(session_id);
+        if (it == replaying_.end()) {
+            return nullptr;
+        }
+        auto state = it->second.find(topic);
+        return state != it->second.end() && state->second.id == id ? &state->second : nullptr;
+    };
+
+    auto porter_ptr = handler()->porter_ptr();
+    auto batch = runtime().send_hwm ? std::max<std::size_t>(runtime().send_hwm / 2, 1) : REPLAY_BATCH;
+    bool progressed = false;
+    bool stalled = false;
+    for (auto& entry : topics) {
+        auto& topic = entry.first;
+        auto& log = entry.second.log;
+        auto from = entry.second.from;
+        auto id = entry.second.id;
+
+        // Called with lock_ held, false - the subscriber is out of credit or its outbound queue is full
+        auto deliver = [&](const uint8_t* frame, std::size_t size) {
+            auto deadline = peek_comm_frame_deadline(frame, size);
+            if (deadline && deadline < now_usecs_timestamp()) {
+                porter_ptr->expired(topic, 1);
+                return true;
+            }
+            auto credit = credit_map_.find(session_id);
+            auto bytes = peek_comm_frame_payload_size(frame, size);
+            if (credit != credit_map_.end() && !credit_take(credit->second, bytes)) {
+                return false;
+            }
+            std::set<int32_t> refused;
+            porter_ptr->send_frame({session_id}, std::make_shared<const std::vector<uint8_t>>(frame, frame + size), topic, &refused);
+            if (refused.empty()) {
+                return true;
+            }
+            if (credit != credit_map_.end()) {
+                credit_refund(credit->second, bytes);
+            }
+            return false;
+        };
+
+        // Frames are read straight from the mapping and paced by the outbound queue of the session
+        if (porter_ptr->outbound(session_id) >= batch) {
+            stalled = true;
+            continue;
+        }
+
+        // The last stretch is sent under lock_ so that no live message slips in between
+        uint64_t next = from;
+        bool last = false;
+        {
+            spdmq_spinlock<std::atomic_flag> lk(lock_);
+            auto state = state_of(topic, id);
+            if (!state) {
+                continue;
+            }
+            if (log->last_sequence() < from + batch) {
+                last = true;
+                next = state->from = log->read(from, UINT64_MAX, deliver);
+                if (next > log->last_sequence()) {
+                    subscribe_table_[topic].insert(session_id);
+                    auto it = replaying_.find(session_id);
+                    it->second.erase(topic);
+                    if (it->second.empty()) {
+                        replaying_.erase(it);
+                    }
+                    continue;
+                }
+            }
+        }
+        if (!last) {
+            next = log->read(from, from + batch - 1, [&](const uint8_t* frame, std::size_t size) {
+                spdmq_spinlock<std::atomic_flag> lk(lock_);
+                return state_of(topic, id) && deliver(frame, size);
+            });
+            spdmq_spinlock<std::atomic_flag> lk(lock_);
+            auto state = state_of(topic, id);
+            if (state) {
+                state->from = next;
+            }
+        }
+        progressed |= next != from;
+        stalled |= next == from;
+    }
+
+    // What is left goes on the next turn of the event loop, so the other sessions are not kept waiting.
+    // A stalled replay goes on with new credit or once the outbound queue has been written,
+    // the ring of an inproc subscriber tells no one when it drains and is tried again shortly
+    if (progressed) {
+        porter_ptr->wake_at(std::chrono::steady_clock::now());
+    }
+    else if (stalled && is_inproc_session(session_id)) {
+        porter_ptr->wake_at(std::chrono::steady_clock::now() + REPLAY_RETRY);
     }
 }
 
-void mode_publish::topic_insert(fd_t session_id, const std::string& topic) {
+void mode_publish::replay_all() {
+    std::vector<int32_t> session_ids;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        for (auto& replaying : replaying_) {
+            session_ids.push_back(replaying.first);
+        }
+    }
+    for (auto session_id : session_ids) {
+        replay(session_id);
+    }
+}
+
+mode_publish::topic_history_t& mode_publish::history_of(const std::string& topic) {
+    auto it = history_map_.find(topic);
+    if (it != history_map_.end()) {
+        return it->second;
+    }
+
+    // The journal of the topic is opened with its first message or subscriber, the sequence goes on from it
+    auto& history = history_map_[topic];
+    auto& opt = ctx().journal();
+    if (!opt.path.empty() && (opt.topics.empty() || opt.topics.count(topic))) {
+        history.log = std::make_shared<journal>(opt, topic);
+        history.sequence = history.log->last_sequence();
+    }
+    return history;
+}
+
+bool mode_publish::credit_deal(const comm_msg_t& msg) {
+    uint32_t messages = 0;
+    uint32_t bytes = 0;
+    if (msg.payload.size() < sizeof(messages) + sizeof(bytes)) {
+        return true;
+    }
+    memcpy(&messages, msg.payload.data(), sizeof(messages));
+    memcpy(&bytes, msg.payload.data() + sizeof(messages), sizeof(bytes));
+
     spdmq_spinlock<std::atomic_flag> lk(lock_);
-    // printf("topic_insert session id:%d, topic:%s\n", session_id, topic.data());
-    subscribe_table_[topic].insert(session_id);
+    auto& credit = credit_map_[msg.session_id];
+    if (!credit.granted) {
+        // The first credit is the window, its non-zero parts are the limits.
+        // From now on the outbound queue keeps what it is given, a frame it dropped would never give its credit back
+        credit.granted = true;
+        credit.by_messages = messages > 0;
+        credit.by_bytes = bytes > 0;
+        handler()->porter_ptr()->credited(msg.session_id);
+    }
+    credit.messages += messages;
+    credit.bytes += bytes;
+
+    // Messages parked for lack of credit go first, unless they have expired meanwhile
+    auto now = now_usecs_timestamp();
+    for (auto it = credit.parked.begin(); it != credit.parked.end();) {
+        if (it->second.expired(now)) {
+            handler()->porter_ptr()->expired(it->first, 1);
+            it = credit.parked.erase(it);
+            continue;
+        }
+        auto size = it->second.payload.size();
+        if (!credit_take(credit, size)) {
+            break;
+        }
+
+        // Refused at the high-water mark it stays parked, the credit of what is queued brings it back
+        const auto& parked = it->second;
+        if (handler()->porter_ptr()->send_msg(msg.session_id, parked) != SPDMQ_CODE_OK) {
+            credit_refund(credit, size);
+            break;
+        }
+        it = credit.parked.erase(it);
+    }
+
+    // A replay waiting for credit goes on
+    if (replaying_.count(msg.session_id)) {
+        handler()->porter_ptr()->wake_at(std::chrono::steady_clock::now());
+    }
+    return true;
+}
+
+bool mode_publish::credit_take(credit_session_t& credit, std::size_t bytes) {
+    // Bytes may run into debt by the last message, a message larger than the whole window still gets through
+    if (!credit.granted) {
+        return true;
+    }
+    if ((credit.by_messages && credit.messages <= 0) || (credit.by_bytes && credit.bytes <= 0)) {
+        return false;
+    }
+    credit.messages -= 1;
+    credit.bytes -= bytes;
+    return true;
+}
+
+void mode_publish::credit_refund(credit_session_t& credit, std::size_t bytes) {
+    // The message never left, the subscriber will not give its credit back
+    if (!credit.granted) {
+        return;
+    }
+    credit.messages += 1;
+    credit.bytes += bytes;
 }
 
 void mode_publish::session_remove(fd_t session_id) {
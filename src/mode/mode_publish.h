@@ -16,14 +16,42 @@
 
 #pragma once
 
+#include <deque>
 #include <cstdint>
+#include "journal.h"
 #include "spdmq_mode.h"
 
 namespace speed::mq {
 
 class mode_publish : public spdmq_mode {
 private:
+    typedef struct credit_session {
+        bool granted = false;                      // the subscriber has announced its window
+        int64_t messages = 0;                      // messages it may still be sent, when its window counts messages
+        int64_t bytes = 0;                         // payload bytes it may still be sent, when its window counts bytes
+        bool by_messages = false;
+        bool by_bytes = false;
+        std::set<std::string> conflate_topics;     // topics of which only the latest message waits for credit
+        std::map<std::string, comm_msg_t> parked;  // conflated topic -> latest message held back for lack of credit
+    } credit_session_t;
+
+    typedef struct topic_history {
+        uint64_t sequence = 0;          // sequence of the latest message of the topic
+        std::deque<comm_msg_t> recent;  // latest messages, for the last value cache and replay
+        std::shared_ptr<journal> log;   // every message of the topic, when it is journaled
+    } topic_history_t;
+
+    typedef struct replay_state {
+        std::shared_ptr<journal> log;   // journal of the topic being replayed
+        uint64_t from = 0;              // sequence of the next message to send
+        uint64_t id = 0;                // tells this replay from a later one of a session that reused the fd
+    } replay_state_t;
+
     std::map<std::string, std::set<int32_t>> subscribe_table_; // subscription topic table
+    std::map<std::string, topic_history_t> history_map_;       // topic -> sequence and recent messages
+    std::map<int32_t, credit_session_t> credit_map_;           // session id -> flow control of subscribers using it or conflating
+    std::map<int32_t, std::map<std::string, replay_state_t>> replaying_; // session id -> topics being replayed to it from the journal
+    uint64_t replay_id_ = 0;
     std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
 
 public:
@@ -33,13 +61,22 @@ public:
 
     spdmq_code_t send(spdmq_msg_t& msg) override;
 
+    spdmq_code_t send(spdmq_msg_t& msg, const spdmq_payload_t& payload) override;
+
     void on_recv(comm_msg_t&& msg) override;
 
     void on_offline(comm_msg_t&& msg) override;
 
 private:
+    spdmq_code_t publish(spdmq_msg_t& msg, const spdmq_payload_t* payload);
+    bool credit_deal(const comm_msg_t& msg);
+    bool credit_take(credit_session_t& credit, std::size_t bytes);
+    void credit_refund(credit_session_t& credit, std::size_t bytes);
+    topic_history_t& history_of(const std::string& topic);
     void msg_deal(const comm_msg_t& msg);
-    void topic_insert(fd_t session_id, const std::string& topic);
+    void topic_insert(const comm_msg_t& msg);
+    void replay(int32_t session_id);
+    void replay_all();
     void session_remove(fd_t session_id);
 };
 
@@ -0,0 +1,127 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "mode_pull.h"
+#include "spdmq_spinlock.hpp"
+
+namespace speed::mq {
+
+// Consumed messages reported per CREDIT message, fewer are reported once the receive queue runs dry
+constexpr uint32_t CREDIT_BATCH = 32;
+
+mode_pull::mode_pull(spdmq_ctx& ctx) : spdmq_mode(ctx) {
+}
+
+void mode_pull::registered() {
+
+    handler()->registered_company(ctx());
+
+    // Only work items are queued
+    handler()->porter_ptr()->on_arrive = [](comm_msg_t& msg) {
+        return MESSAGE_TYPE::DATA != msg.msg_type;
+    };
+
+    if (on_mode_recv) {
+        handler()->porter_ptr()->on_recv = [this](auto&& T) {
+            on_recv(std::forward<decltype(T)>(T));
+        };
+    }
+
+    // A work item dropped by the receive queue is done as far as the PUSH peer is concerned
+    handler()->porter_ptr()->on_drop = [this](comm_msg_t& msg, std::size_t) {
+        consumed(msg.session_id);
+    };
+
+    // So is one handed to a waiting coroutine
+    handler()->porter_ptr()->on_handoff = [this](comm_msg_t& msg) {
+        consumed(msg.session_id);
+    };
+
+    handler()->porter_ptr()->on_online = [this](auto&& T) {
+        on_online(std::forward<decltype(T)>(T));
+    };
+
+    handler()->porter_ptr()->on_offline = [this](auto&& T) {
+        on_offline(std::forward<decltype(T)>(T));
+    };
+}
+
+spdmq_code_t mode_pull::recv(spdmq_msg_t& msg, time_msec_t time_out) {
+    comm_msg_t comm_msg;
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, time_out);
+    if (ret == SPDMQ_CODE_OK) {
+        consumed(comm_msg.session_id);
+        comm_msg_to_spdmq_msg(comm_msg, msg);
+    }
+    return ret;
+}
+
+spdmq_code_t mode_pull::recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) {
+    comm_msg_t comm_msg;
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, topic, time_out);
+    if (ret == SPDMQ_CODE_OK) {
+        consumed(comm_msg.session_id);
+        comm_msg_to_spdmq_msg(comm_msg, msg);
+    }
+    return ret;
+}
+
+bool mode_pull::wait_recv(spdmq_waiter_t& waiter) {
+    return handler()->porter_ptr()->wait_recv(waiter);
+}
+
+void mode_pull::on_recv(comm_msg_t&& msg) {
+    auto session_id = msg.session_id;
+    spdmq_mode::on_recv(std::move(msg));
+    consumed(session_id);
+}
+
+void mode_pull::on_online(comm_msg_t&& msg) {
+    // Tell the PUSH peer our weight, it also marks the start of the credit accounting
+    comm_msg_t ready(msg.session_id);
+    uint32_t weight = ctx().weight();
+    ready.msg_type = MESSAGE_TYPE::READY;
+    ready.payload.assign(reinterpret_cast<uint8_t*>(&weight), reinterpret_cast<uint8_t*>(&weight) + sizeof(weight));
+    handler()->porter_ptr()->send_msg(msg.session_id, ready);
+    spdmq_mode::on_online(std::move(msg));
+}
+
+void mode_pull::on_offline(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        consumed_map_.erase(msg.session_id);
+    }
+    spdmq_mode::on_offline(std::move(msg));
+}
+
+void mode_pull::consumed(int32_t session_id) {
+    uint32_t count;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        count = ++consumed_map_[session_id];
+        if (count < CREDIT_BATCH && handler()->porter_ptr()->queued()) {
+            return;
+        }
+        consumed_map_[session_id] = 0;
+    }
+
+    comm_msg_t credit(session_id);
+    credit.msg_type = MESSAGE_TYPE::CREDIT;
+    credit.payload.assign(reinterpret_cast<uint8_t*>(&count), reinterpret_cast<uint8_t*>(&count) + sizeof(count));
+    handler()->porter_ptr()->send_msg(session_id, credit);
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,170 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "mode_push.h"
+#include "spdmq_spinlock.hpp"
+#include <algorithm>
+
+namespace speed::mq {
+
+mode_push::mode_push(spdmq_ctx& ctx) : spdmq_mode(ctx) {
+}
+
+void mode_push::registered() {
+
+    handler()->registered_company(ctx());
+
+    // READY and CREDIT are handled on the event thread, PULL peers send nothing else
+    handler()->porter_ptr()->on_arrive = [this](comm_msg_t& msg) {
+        return msg_deal(msg);
+    };
+
+    handler()->porter_ptr()->on_online = [this](auto&& T) {
+        on_online(std::forward<decltype(T)>(T));
+    };
+
+    handler()->porter_ptr()->on_offline = [this](auto&& T) {
+        on_offline(std::forward<decltype(T)>(T));
+    };
+}
+
+spdmq_code_t mode_push::send(spdmq_msg_t& msg) {
+    int32_t session_id;
+    auto ret = select_peer(session_id);
+    if (ret != SPDMQ_CODE_OK) {
+        return ret;
+    }
+
+    msg.session_id = session_id;
+    if (!msg.ttl) {
+        msg.ttl = runtime().topic_ttl(msg.topic);
+    }
+    comm_msg_t comm_msg;
+    spdmq_msg_to_comm_msg(msg, comm_msg, runtime().monotonic_stamp);
+    comm_msg.msg_type = MESSAGE_TYPE::DATA;
+    ret = handler()->porter_ptr()->send_msg(session_id, std::move(comm_msg));
+    if (ret != SPDMQ_CODE_OK) {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        for (auto& peer : peers_) {
+            if (peer.session_id == session_id && peer.outstanding) {
+                --peer.outstanding;
+            }
+        }
+    }
+    return ret;
+}
+
+void mode_push::on_online(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        pull_peer_t peer;
+        peer.session_id = msg.session_id;
+        peers_.push_back(peer);
+    }
+    spdmq_mode::on_online(std::move(msg));
+}
+
+void mode_push::on_offline(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        peers_.erase(std::remove_if(peers_.begin(), peers_.end(), [&msg](const pull_peer_t& peer) {
+            return peer.session_id == msg.session_id;
+        }), peers_.end());
+    }
+    spdmq_mode::on_offline(std::move(msg));
+}
+
+bool mode_push::msg_deal(const comm_msg_t& msg) {
+    uint32_t value = 0;
+    if (msg.payload.size() >= sizeof(value)) {
+        memcpy(&value, msg.payload.data(), sizeof(value));
+    }
+
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    for (auto& peer : peers_) {
+        if (peer.session_id != msg.session_id) {
+            continue;
+        }
+        if (MESSAGE_TYPE::READY == msg.msg_type) {
+            peer.weight = std::max<uint32_t>(value, 1);
+        }
+        if (MESSAGE_TYPE::CREDIT == msg.msg_type) {
+            peer.outstanding -= std::min(value, peer.outstanding);
+        }
+        break;
+    }
+    return true;
+}
+
+spdmq_code_t mode_push::select_peer(int32_t& session_id) {
+    spdmq_spinlock<std::atomic_flag> lk(lock_);
+    if (peers_.empty()) {
+        return SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET;
+    }
+
+    // Peers whose outbound queue is at the high-water mark are skipped by every strategy
+    pull_peer_t* selected = nullptr;
+    switch (runtime().push_strategy) {
+        case PUSH_STRATEGY::LEAST_OUTSTANDING:
+            for (std::size_t i = 0; i < peers_.size(); ++i) {
+                // Start from the next peer in turn, so equal peers still take turns
+                auto& peer = peers_[(next_peer_ + i) % peers_.size()];
+                if (writable(peer) && (!selected || peer.outstanding < selected->outstanding)) {
+                    selected = &peer;
+                }
+            }
+            ++next_peer_;
+            break;
+        case PUSH_STRATEGY::WEIGHTED: {
+            int64_t total_weight = 0;
+            for (auto& peer : peers_) {
+                if (!writable(peer)) {
+                    continue;
+                }
+                peer.current_weight += peer.weight;
+                total_weight += peer.weight;
+                if (!selected || peer.current_weight > selected->current_weight) {
+                    selected = &peer;
+                }
+            }
+            if (selected) {
+                selected->current_weight -= total_weight;
+            }
+            break;
+        }
+        default:
+            for (std::size_t i = 0; i < peers_.size() && !selected; ++i) {
+                auto& peer = peers_[next_peer_++ % peers_.size()];
+                if (writable(peer)) {
+                    selected = &peer;
+                }
+            }
+            break;
+    }
+
+    if (!selected) {
+        return SPDMQ_CODE_SEND_FAILED_HWM;
+    }
+    ++selected->outstanding;
+    session_id = selected->session_id;
+    return SPDMQ_CODE_OK;
+}
+
+bool mode_push::writable(const pull_peer_t& peer) {
+    return !runtime().send_hwm || handler()->porter_ptr()->outbound(peer.session_id) < runtime().send_hwm;
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,54 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "spdmq_mode.h"
+
+namespace speed::mq {
+
+class mode_push : public spdmq_mode {
+private:
+    typedef struct pull_peer {
+        int32_t session_id;
+        uint32_t weight = 1;         // announced by the READY message of the peer
+        int64_t current_weight = 0;  // state of smooth weighted round robin
+        uint32_t outstanding = 0;    // sent but not yet reported consumed by a CREDIT message
+    } pull_peer_t;
+
+    std::vector<pull_peer_t> peers_; // online PULL peers
+    std::size_t next_peer_ = 0;
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+
+public:
+    mode_push(spdmq_ctx& ctx);
+
+    void registered() override;
+
+    spdmq_code_t send(spdmq_msg_t& msg) override;
+
+    void on_online(comm_msg_t&& msg) override;
+
+    void on_offline(comm_msg_t&& msg) override;
+
+private:
+    bool msg_deal(const comm_msg_t& msg);
+    spdmq_code_t select_peer(int32_t& session_id);
+    bool writable(const pull_peer_t& peer);
+};
+
+} /* namespace speed::mq */
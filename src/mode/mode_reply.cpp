@@ -0,0 +1,80 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "mode_reply.h"
+
+namespace speed::mq {
+
+mode_reply::mode_reply(spdmq_ctx& ctx) : spdmq_mode(ctx) {
+}
+
+void mode_reply::registered() {
+
+    handler()->registered_company(ctx());
+
+    // Only requests are queued, anything else from a mismatched peer is dropped
+    handler()->porter_ptr()->on_arrive = [](comm_msg_t& msg) {
+        return MESSAGE_TYPE::REQUEST != msg.msg_type;
+    };
+
+    if (on_mode_recv) {
+        handler()->porter_ptr()->on_recv = [this](auto&& T) {
+            on_recv(std::forward<decltype(T)>(T));
+        };
+    }
+
+    if (on_mode_online) {
+        handler()->porter_ptr()->on_online = [this](auto&& T) {
+            on_online(std::forward<decltype(T)>(T));
+        };
+    }
+
+    if (on_mode_offline) {
+        handler()->porter_ptr()->on_offline = [this](auto&& T) {
+            on_offline(std::forward<decltype(T)>(T));
+        };
+    }
+}
+
+spdmq_code_t mode_reply::send(spdmq_msg_t& msg) {
+    // The reply goes back to the session of the request and carries its correlation id
+    if (!msg.correlation_id) {
+        return SPDMQ_CODE_NO_REQUEST;
+    }
+    if (!companied()) {
+        return SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET;
+    }
+
+    comm_msg_t comm_msg;
+    spdmq_msg_to_comm_msg(msg, comm_msg, runtime().monotonic_stamp);
+    comm_msg.msg_type = MESSAGE_TYPE::REPLY;
+    return handler()->porter_ptr()->send_msg(msg.session_id, std::move(comm_msg));
+}
+
+spdmq_code_t mode_reply::recv(spdmq_msg_t& msg, time_msec_t time_out) {
+    comm_msg_t comm_msg;
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, time_out);
+    if (ret == SPDMQ_CODE_OK) {
+        comm_msg_to_spdmq_msg(comm_msg, msg);
+    }
+    return ret;
+}
+
+bool mode_reply::wait_recv(spdmq_waiter_t& waiter) {
+    return handler()->porter_ptr()->wait_recv(waiter);
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,36 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include "spdmq_mode.h"
+
+namespace speed::mq {
+
+class mode_reply : public spdmq_mode {
+public:
+    mode_reply(spdmq_ctx& ctx);
+
+    void registered() override;
+
+    spdmq_code_t send(spdmq_msg_t& msg) override;
+
+    spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out) override;
+
+    bool wait_recv(spdmq_waiter_t& waiter) override;
+};
+
+} /* namespace speed::mq */
@@ -0,0 +1,219 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#include "mode_request.h"
+#include "spdmq_spinlock.hpp"
+#include <algorithm>
+
+namespace speed::mq {
+
+mode_request::mode_request(spdmq_ctx& ctx) : spdmq_mode(ctx) {
+}
+
+void mode_request::registered() {
+
+    handler()->registered_company(ctx());
+
+    handler()->porter_ptr()->on_arrive = [this](comm_msg_t& msg) {
+        return on_reply(msg);
+    };
+
+    if (on_mode_recv) {
+        handler()->porter_ptr()->on_recv = [this](auto&& T) {
+            on_recv(std::forward<decltype(T)>(T));
+        };
+    }
+
+    handler()->porter_ptr()->on_online = [this](auto&& T) {
+        on_online(std::forward<decltype(T)>(T));
+    };
+
+    handler()->porter_ptr()->on_offline = [this](auto&& T) {
+        on_offline(std::forward<decltype(T)>(T));
+    };
+
+    // Timeouts are called back on the event thread like every other callback
+    handler()->porter_ptr()->on_timer = [this] {
+        on_timeout();
+    };
+}
+
+spdmq_code_t mode_request::send(spdmq_msg_t& msg) {
+    // Fire and forget, the reply is delivered through recv or on_recv
+    return request(msg, nullptr, 0);
+}
+
+spdmq_code_t mode_request::recv(spdmq_msg_t& msg, time_msec_t time_out) {
+    comm_msg_t comm_msg;
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, time_out);
+    if (ret == SPDMQ_CODE_OK) {
+        comm_msg_to_spdmq_msg(comm_msg, msg);
+    }
+    return ret;
+}
+
+bool mode_request::wait_recv(spdmq_waiter_t& waiter) {
+    return handler()->porter_ptr()->wait_recv(waiter);
+}
+
+spdmq_code_t mode_request::request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out) {
+    int32_t session_id;
+    if (!next_session(session_id)) {
+        return SPDMQ_CODE_SEND_FAILED_NOT_CONNECTED_TARGET;
+    }
+
+    msg.session_id = session_id;
+    msg.correlation_id = ++correlation_id_;
+    comm_msg_t comm_msg;
+    spdmq_msg_to_comm_msg(msg, comm_msg, runtime().monotonic_stamp);
+    comm_msg.msg_type = MESSAGE_TYPE::REQUEST;
+
+    // Registered before sending, the reply may arrive before send_msg returns
+    if (on_reply) {
+        auto deadline = time_out > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(time_out) : time_point_t::max();
+        std::lock_guard<std::mutex> lk(pending_lock_);
+        pending_map_[comm_msg.correlation_id] = {session_id, deadline, std::move(on_reply)};
+        if (time_out > 0) {
+            auto it = deadline_map_.emplace(deadline, comm_msg.correlation_id);
+            if (it == deadline_map_.begin()) {
+                handler()->porter_ptr()->wake_at(deadline);
+            }
+        }
+    }
+
+    auto ret = handler()->porter_ptr()->send_msg(session_id, std::move(comm_msg));
+    if (ret != SPDMQ_CODE_OK) {
+        // The callback is not called for a request that was never sent
+        pending_request_t pending;
+        pending_take(msg.correlation_id, pending);
+    }
+    return ret;
+}
+
+void mode_request::on_online(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(session_lock_);
+        sessions_.push_back(msg.session_id);
+    }
+    spdmq_mode::on_online(std::move(msg));
+}
+
+void mode_request::on_offline(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(session_lock_);
+        sessions_.erase(std::remove(sessions_.begin(), sessions_.end(), msg.session_id), sessions_.end());
+    }
+
+    // Requests in flight on the broken session will never be answered
+    std::vector<std::pair<uint64_t, reply_cb_t>> broken;
+    {
+        std::lock_guard<std::mutex> lk(pending_lock_);
+        for (auto it = pending_map_.begin(); it != pending_map_.end();) {
+            if (it->second.session_id != msg.session_id) {
+                ++it;
+                continue;
+            }
+            deadline_remove(it->first, it->second.deadline);
+            broken.emplace_back(it->first, std::move(it->second.on_reply));
+            it = pending_map_.erase(it);
+        }
+    }
+    for (auto& [correlation_id, on_reply] : broken) {
+        spdmq_msg_t spdmq_msg(msg.session_id);
+        spdmq_msg.correlation_id = correlation_id;
+        on_reply(SPDMQ_CODE_CONNECT_TO_BROKEN, spdmq_msg);
+    }
+
+    spdmq_mode::on_offline(std::move(msg));
+}
+
+bool mode_request::on_reply(comm_msg_t& msg) {
+    if (MESSAGE_TYPE::REPLY != msg.msg_type) {
+        return true;
+    }
+
+    // Replies of send, and late replies of timed out requests, go to the receive queue
+    pending_request_t pending;
+    if (!pending_take(msg.correlation_id, pending)) {
+        return false;
+    }
+
+    spdmq_msg_t spdmq_msg;
+    comm_msg_to_spdmq_msg(msg, spdmq_msg);
+    pending.on_reply(SPDMQ_CODE_OK, spdmq_msg);
+    return true;
+}
+
+void mode_request::on_timeout() {
+    std::vector<std::pair<uint64_t, pending_request_t>> expired;
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lk(pending_lock_);
+        while (!deadline_map_.empty() && deadline_map_.begin()->first <= now) {
+            auto correlation_id = deadline_map_.begin()->second;
+            deadline_map_.erase(deadline_map_.begin());
+            auto it = pending_map_.find(correlation_id);
+            if (it != pending_map_.end()) {
+                expired.emplace_back(correlation_id, std::move(it->second));
+                pending_map_.erase(it);
+            }
+        }
+        if (!deadline_map_.empty()) {
+            handler()->porter_ptr()->wake_at(deadline_map_.begin()->first);
+        }
+    }
+    for (auto& [correlation_id, pending] : expired) {
+        spdmq_msg_t spdmq_msg(pending.session_id);
+        spdmq_msg.correlation_id = correlation_id;
+        pending.on_reply(SPDMQ_CODE_RECV_TIMEOUT, spdmq_msg);
+    }
+}
+
+bool mode_request::next_session(int32_t& session_id) {
+    spdmq_spinlock<std::atomic_flag> lk(session_lock_);
+    if (sessions_.empty()) {
+        return false;
+    }
+    session_id = sessions_[next_session_++ % sessions_.size()];
+    return true;
+}
+
+bool mode_request::pending_take(uint64_t correlation_id, pending_request_t& pending) {
+    std::lock_guard<std::mutex> lk(pending_lock_);
+    auto it = pending_map_.find(correlation_id);
+    if (it == pending_map_.end()) {
+        return false;
+    }
+    deadline_remove(correlation_id, it->second.deadline);
+    pending = std::move(it->second);
+    pending_map_.erase(it);
+    return true;
+}
+
+void mode_request::deadline_remove(uint64_t correlation_id, time_point_t deadline) {
+    if (deadline == time_point_t::max()) {
+        return;
+    }
+    auto range = deadline_map_.equal_range(deadline);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == correlation_id) {
+            deadline_map_.erase(it);
+            return;
+        }
+    }
+}
+
+} /* namespace speed::mq */
@@ -0,0 +1,72 @@
+/*
+*   Copyright 2024 billy_yan billyany@163.com
+*
+*   Licensed under the Apache License, Version 2.0 (the "License");
+*   you may not use this file except in compliance with the License.
+*   You may obtain a copy of the License at
+*
+*       http://www.apache.org/licenses/LICENSE-2.0
+*
+*   Unless required by applicable law or agreed to in writing, software
+*   distributed under the License is distributed on an "AS IS" BASIS,
+*   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*   See the License for the specific language governing permissions and
+*   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include "spdmq_mode.h"
+
+namespace speed::mq {
+
+class mode_request : public spdmq_mode {
+private:
+    using reply_cb_t = std::function<void(spdmq_code_t, spdmq_msg_t&)>;
+    using time_point_t = std::chrono::steady_clock::time_point;
+
+    typedef struct pending_request {
+        int32_t session_id;                // session the request was sent to
+        time_point_t deadline;             // time_point_t::max() - never timeout
+        reply_cb_t on_reply;               // completion callback
+    } pending_request_t;
+
+    std::atomic<uint64_t> correlation_id_ = {0};        // last assigned request id
+    std::vector<int32_t> sessions_;                     // online peers, requests are spread round robin
+    std::size_t next_session_ = 0;
+    std::atomic_flag session_lock_ = ATOMIC_FLAG_INIT;
+    std::mutex pending_lock_;
+    std::map<uint64_t, pending_request_t> pending_map_; // correlation id -> request waiting for its reply
+    std::multimap<time_point_t, uint64_t> deadline_map_; // deadline -> correlation id, only requests with a timeout, the reactor timer is armed for the first
+
+public:
+    mode_request(spdmq_ctx& ctx);
+
+    void registered() override;
+
+    spdmq_code_t send(spdmq_msg_t& msg) override;
+
+    spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out) override;
+
+    bool wait_recv(spdmq_waiter_t& waiter) override;
+
+    spdmq_code_t request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out) override;
+
+    void on_online(comm_msg_t&& msg) override;
+
+    void on_offline(comm_msg_t&& msg) override;
+
+private:
+    bool on_reply(comm_msg_t& msg);
+    void on_timeout();
+    bool next_session(int32_t& session_id);
+    bool pending_take(uint64_t correlation_id, pending_request_t& pending);
+    void deadline_remove(uint64_t correlation_id, time_point_t deadline); // pending_lock_ held
+};
+
+} /* namespace speed::mq */
@@ -15,6 +15,7 @@
 */
 
 #include "mode_subscribe.h"
+#include "spdmq_spinlock.hpp"
 
 namespace speed::mq {
 
@@ -25,6 +26,11 @@ void mode_subscribe::registered() {
 
     handler()->registered_company(ctx());
 
+    handler()->porter_ptr()->on_arrive = [this](comm_msg_t& msg) {
+        sequence_check(msg);
+        return false;
+    };
+
     if (on_mode_recv) {
         handler()->porter_ptr()->on_recv = [this](auto&& T) {
             on_recv(std::forward<decltype(T)>(T));
@@ -35,32 +41,173 @@ void mode_subscribe::registered() {
         on_online(std::forward<decltype(T)>(T));
     };
 
-    if (on_mode_offline) {
-        handler()->porter_ptr()->on_offline = [this](auto&& T) {
-            on_offline(std::forward<decltype(T)>(T));
+    handler()->porter_ptr()->on_offline = [this](auto&& T) {
+        on_offline(std::forward<decltype(T)>(T));
+    };
+
+    // A message dropped by the receive queue gives its credit back like a received one
+    // and so does one handed to a waiting coroutine
+    if (credit_enabled()) {
+        handler()->porter_ptr()->on_drop = [this](comm_msg_t& msg, std::size_t bytes) {
+            consumed(msg.session_id, bytes);
+        };
+        handler()->porter_ptr()->on_handoff = [this](comm_msg_t& msg) {
+            consumed(msg.session_id, msg.payload.size());
         };
     }
 }
 
+void mode_subscribe::on_recv(comm_msg_t&& msg) {
+    consumed(msg.session_id, msg.payload.size());
+    spdmq_mode::on_recv(std::move(msg));
+}
+
 void mode_subscribe::on_online(comm_msg_t&& msg) {
-    // printf("mode_subscribe::on_online\n");
-    for (auto& topic : ctx().topics()) {
-        // printf("mode_subscribe::on_online topic:%s, msg.session_id:%d\n", topic.c_str(), msg.session_id);
+    // The window is granted before the topics, so no data is sent to this session without credit
+    if (credit_enabled()) {
+        grant(msg.session_id, runtime().credit_window.messages, runtime().credit_window.bytes);
+    }
+
+    // A publisher connected to is known by its address, so the sequences survive a reconnect,
+    // one that connected to us is a stranger each time
+    auto porter_ptr = handler()->porter_ptr();
+    auto endpoint = porter_ptr->outgoing(msg.session_id) ? porter_ptr->endpoint(msg.session_id) : "#" + std::to_string(msg.session_id);
+    sequence_table_t sequences;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(sequence_lock_);
+        auto it = sequence_map_.emplace(endpoint, sequence_table_t()).first;
+        session_sequence_map_[msg.session_id] = it;
+        sequences = it->second;
+    }
+
+    auto& conflate_topics = runtime().conflate_topics;
+    for (auto& topic : runtime().topics) {
         msg.topic = topic;
         msg.msg_type = MESSAGE_TYPE::TOPIC;
+        msg.payload.assign(1, 0);
+        if (conflate_topics.count(topic)) {
+            msg.payload[0] |= static_cast<uint8_t>(TOPIC_FLAG::CONFLATE);
+        }
+
+        // Ask for what was published while we were away, or from where the context says for a publisher met the first time
+        auto sequence = sequences.find(topic);
+        uint64_t after = 0;
+        if (sequence != sequences.end() || ctx().replay_from()) {
+            after = sequence != sequences.end() ? sequence->second : ctx().replay_from() - 1;
+            msg.payload[0] |= static_cast<uint8_t>(TOPIC_FLAG::REPLAY);
+            msg.payload.insert(msg.payload.end(), reinterpret_cast<const uint8_t*>(&after),
+                               reinterpret_cast<const uint8_t*>(&after) + sizeof(after));
+        }
+        else if (ctx().replay_since()) {
+            auto since = ctx().replay_since();
+            msg.payload[0] |= static_cast<uint8_t>(TOPIC_FLAG::REPLAY_SINCE);
+            msg.payload.insert(msg.payload.end(), reinterpret_cast<const uint8_t*>(&since),
+                               reinterpret_cast<const uint8_t*>(&since) + sizeof(since));
+        }
         handler()->porter_ptr()->send_msg(msg.session_id, msg);
-        // auto ret = handler()->porter_ptr()->send_msg(msg.session_id, msg);
-        // printf("ret:%d\n", ret);
     }
 }
 
+void mode_subscribe::on_offline(comm_msg_t&& msg) {
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        consumed_map_.erase(msg.session_id);
+    }
+    {
+        spdmq_spinlock<std::atomic_flag> lk(sequence_lock_);
+        auto it = session_sequence_map_.find(msg.session_id);
+        if (it != session_sequence_map_.end()) {
+            if (it->second->first[0] == '#') {
+                sequence_map_.erase(it->second);
+            }
+            session_sequence_map_.erase(it);
+        }
+    }
+    spdmq_mode::on_offline(std::move(msg));
+}
+
 spdmq_code_t mode_subscribe::recv(spdmq_msg_t& msg, time_msec_t time_out) {
     comm_msg_t comm_msg;
-    auto ret = handler()->porter_ptr()->recv_msg(handler()->spdmq_socket_ptr()->socket_fd(), comm_msg, time_out);
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, time_out);
+    if (ret == SPDMQ_CODE_OK) {
+        consumed(comm_msg.session_id, comm_msg.payload.size());
+        comm_msg_to_spdmq_msg(comm_msg, msg);
+    }
+    return ret;
+}
+
+spdmq_code_t mode_subscribe::recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) {
+    comm_msg_t comm_msg;
+    auto ret = handler()->porter_ptr()->recv_msg(comm_msg, topic, time_out);
     if (ret == SPDMQ_CODE_OK) {
+        consumed(comm_msg.session_id, comm_msg.payload.size());
         comm_msg_to_spdmq_msg(comm_msg, msg);
     }
     return ret;
 }
 
+bool mode_subscribe::wait_recv(spdmq_waiter_t& waiter) {
+    return handler()->porter_ptr()->wait_recv(waiter);
+}
+
+void mode_subscribe::sequence_check(const comm_msg_t& msg) {
+    if (!msg.sequence) {
+        return;
+    }
+
+    uint64_t missed = 0;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(sequence_lock_);
+        auto it = session_sequence_map_.find(msg.session_id);
+        if (it == session_sequence_map_.end()) {
+            return;
+        }
+        auto& last = it->second->second[msg.topic];
+        if (last && msg.sequence > last + 1) {
+            missed = msg.sequence - last - 1;
+        }
+        // A sequence going back means the publisher has restarted, counting starts over
+        last = msg.sequence;
+    }
+    if (missed) {
+        handler()->porter_ptr()->missed(msg.topic, missed);
+    }
+}
+
+bool mode_subscribe::credit_enabled() {
+    return runtime().credit_enabled;
+}
+
+void mode_subscribe::consumed(int32_t session_id, std::size_t bytes) {
+    if (!credit_enabled()) {
+        return;
+    }
+
+    // Credit goes back in batches of half the window, so the control traffic stays small
+    auto& window = runtime().credit_window;
+    consumed_credit_t credit;
+    {
+        spdmq_spinlock<std::atomic_flag> lk(lock_);
+        auto& consumed = consumed_map_[session_id];
+        consumed.messages += 1;
+        consumed.bytes += bytes;
+        if ((!window.messages || consumed.messages < std::max<uint32_t>(window.messages / 2, 1)) &&
+            (!window.bytes || consumed.bytes < std::max<uint32_t>(window.bytes / 2, 1))) {
+            return;
+        }
+        credit = consumed;
+        consumed = {};
+    }
+    grant(session_id, credit.messages, credit.bytes);
+}
+
+void mode_subscribe::grant(int32_t session_id, uint32_t messages, uint32_t bytes) {
+    comm_msg_t credit(session_id);
+    credit.msg_type = MESSAGE_TYPE::CREDIT;
+    credit.payload.resize(sizeof(messages) + sizeof(bytes));
+    memcpy(credit.payload.data(), &messages, sizeof(messages));
+    memcpy(credit.payload.data() + sizeof(messages), &bytes, sizeof(bytes));
+    handler()->porter_ptr()->send_msg(session_id, credit);
+}
+
 } /* namespace speed::mq */
\ No newline at end of file
@@ -16,16 +16,41 @@
 
 #pragma once
 
+#include <map>
 #include "spdmq_mode.h"
 
 namespace speed::mq {
 
 class mode_subscribe : public spdmq_mode {
+private:
+    typedef struct consumed_credit {
+        uint32_t messages = 0;
+        uint32_t bytes = 0;
+    } consumed_credit_t;
+    std::map<int32_t, consumed_credit_t> consumed_map_; // session id -> consumption not yet granted back to the publisher
+    std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+
+    typedef std::map<std::string, uint64_t> sequence_table_t; // topic -> sequence of the last message received
+    std::map<std::string, sequence_table_t> sequence_map_;   // publisher endpoint -> its sequences, kept across reconnects
+    std::map<int32_t, std::map<std::string, sequence_table_t>::iterator> session_sequence_map_; // session id -> its publisher, guarded by sequence_lock_
+    std::atomic_flag sequence_lock_ = ATOMIC_FLAG_INIT;
+
 public:
     mode_subscribe(spdmq_ctx& ctx);
     void registered() override;
+    void on_recv(comm_msg_t&& msg) override;
     void on_online(comm_msg_t&& msg) override;
+    void on_offline(comm_msg_t&& msg) override;
     spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out) override;
+    spdmq_code_t recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) override;
+
+    bool wait_recv(spdmq_waiter_t& waiter) override;
+
+private:
+    void sequence_check(const comm_msg_t& msg);
+    bool credit_enabled();
+    void consumed(int32_t session_id, std::size_t bytes);
+    void grant(int32_t session_id, uint32_t messages, uint32_t bytes);
 };
 
 } /* speed::mq */
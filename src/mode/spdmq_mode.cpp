@@ -29,12 +29,39 @@ spdmq_code_t spdmq_mode::send(spdmq_msg_t& msg) {
     return SPDMQ_CODE_MODE_NOT_MATCH;
 }
 
+spdmq_code_t spdmq_mode::send(spdmq_msg_t& msg, const spdmq_payload_t& payload) {
+    msg.payload.resize(payload.size);
+    if (payload.size) {
+        payload.write(payload.value, msg.payload.data());
+    }
+    return send(msg);
+}
+
 spdmq_code_t spdmq_mode::recv(spdmq_msg_t& msg, time_msec_t time_out) {
     SPDMQ_UNUSED(msg);
     SPDMQ_UNUSED(time_out);
     return SPDMQ_CODE_MODE_NOT_MATCH;
 }
 
+spdmq_code_t spdmq_mode::recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) {
+    SPDMQ_UNUSED(msg);
+    SPDMQ_UNUSED(topic);
+    SPDMQ_UNUSED(time_out);
+    return SPDMQ_CODE_MODE_NOT_MATCH;
+}
+
+spdmq_code_t spdmq_mode::request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out) {
+    SPDMQ_UNUSED(msg);
+    SPDMQ_UNUSED(on_reply);
+    SPDMQ_UNUSED(time_out);
+    return SPDMQ_CODE_MODE_NOT_MATCH;
+}
+
+bool spdmq_mode::wait_recv(spdmq_waiter_t& waiter) {
+    waiter.code = SPDMQ_CODE_MODE_NOT_MATCH;
+    return false;
+}
+
 void spdmq_mode::on_recv(comm_msg_t&& msg) {
     if (on_mode_recv) {
         spdmq_msg_t spdmq_msg;
@@ -44,7 +71,6 @@ void spdmq_mode::on_recv(comm_msg_t&& msg) {
 }
 
 void spdmq_mode::on_online(comm_msg_t&& msg) {
-    // printf("session id:%d\n", msg.session_id);
     if (on_mode_online) {
         spdmq_msg_t spdmq_msg;
         comm_msg_to_spdmq_msg(msg, spdmq_msg);
@@ -60,20 +86,49 @@ void spdmq_mode::on_offline(comm_msg_t&& msg) {
     }
 }
 
-void spdmq_mode::bind() {
-    registered();
-    dispatcher_ptr_->bind_company(ctx());
+void spdmq_mode::bind(const spdmq_url_parse_t& url_parse) {
+    // All endpoints share one reactor, subscription table and receive queue
+    register_once();
+    dispatcher_ptr_->bind_company(ctx(), url_parse);
+}
+
+void spdmq_mode::connect(const spdmq_url_parse_t& url_parse) {
+    register_once();
+    dispatcher_ptr_->connect_company(ctx(), url_parse);
 }
 
-void spdmq_mode::connect() {
-    registered();
-    dispatcher_ptr_->connect_company(ctx());
+bool spdmq_mode::wait_writable(spdmq_waiter_t& waiter) {
+    register_once();
+    return handler()->porter_ptr()->wait_writable(waiter);
+}
+
+bool spdmq_mode::wait_connect(spdmq_waiter_t& waiter, const spdmq_url_parse_t& url_parse) {
+    register_once();
+    return dispatcher_ptr_->connect_company(ctx(), url_parse, &waiter);
 }
 
 void spdmq_mode::spin(bool background) {
     dispatcher_ptr_->operating_company(background);
 }
 
+int32_t spdmq_mode::process(uint32_t max_events, uint32_t budget) {
+    register_once();
+    return dispatcher_ptr_->process_company(max_events, budget);
+}
+
+int32_t spdmq_mode::native_handle() {
+    // The handle is there before the first bind or connect, to be added to the loop of the application
+    register_once();
+    return dispatcher_ptr_->native_handle();
+}
+
+void spdmq_mode::register_once() {
+    std::call_once(registered_flag_, [this] {
+        registered();
+        companied_.store(true, std::memory_order_release);
+    });
+}
+
 void spdmq_mode::registered() {
     dispatcher_ptr_->registered_company(ctx());
 
@@ -96,4 +151,25 @@ void spdmq_mode::registered() {
     }
 }
 
-} /* namespace speed::mq */
+std::map<std::string, spdmq_topic_stat_t> spdmq_mode::topic_stats() {
+    if (!companied()) {
+        return {};
+    }
+    return handler()->porter_ptr()->topic_stats();
+}
+
+spdmq_checksum_stat_t spdmq_mode::checksum_stats() {
+    if (!companied()) {
+        return {};
+    }
+    return handler()->porter_ptr()->checksum_stats();
+}
+
+std::vector<spdmq_dispatch_stat_t> spdmq_mode::dispatch_stats() {
+    if (!companied()) {
+        return {};
+    }
+    return handler()->porter_ptr()->dispatch_stats();
+}
+
+} /* namespace speed::mq */
\ No newline at end of file
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <mutex>
+#include <atomic>
 #include "spdmq_def.h"
 #include "dispatcher.h"
 
@@ -25,6 +27,8 @@ class spdmq_mode {
 private:
     spdmq_ctx_t& ctx_;
     std::shared_ptr<dispatcher> dispatcher_ptr_;
+    std::once_flag registered_flag_;
+    std::atomic_bool companied_ = false; // set once registered has made the porter, the first bind or connect
 
 public:
     std::function<void(spdmq_msg_t&)> on_mode_recv;
@@ -36,16 +40,30 @@ public:
 
     virtual ~spdmq_mode() {}
     virtual spdmq_code_t send(spdmq_msg_t& msg);
+    virtual spdmq_code_t send(spdmq_msg_t& msg, const spdmq_payload_t& payload);
     virtual spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out);
+    virtual spdmq_code_t recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out);
+    virtual spdmq_code_t request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out);
+    virtual bool wait_recv(spdmq_waiter_t& waiter);
     virtual void on_recv(comm_msg_t&& msg);
     virtual void on_online(comm_msg_t&& msg);
     virtual void on_offline(comm_msg_t&& msg);
     virtual void registered();
 
 public:
-    void bind();
-    void connect();
+    void bind(const spdmq_url_parse_t& url_parse);
+    void connect(const spdmq_url_parse_t& url_parse);
+    bool wait_writable(spdmq_waiter_t& waiter);
+    bool wait_connect(spdmq_waiter_t& waiter, const spdmq_url_parse_t& url_parse);
     void spin(bool background);
+    int32_t process(uint32_t max_events, uint32_t budget);
+    int32_t native_handle();
+    std::map<std::string, spdmq_topic_stat_t> topic_stats();
+    spdmq_checksum_stat_t checksum_stats();
+    std::vector<spdmq_dispatch_stat_t> dispatch_stats();
+
+private:
+    void register_once();
 
 public:
     spdmq_ctx_t& ctx() {
@@ -55,6 +73,16 @@ public:
     std::shared_ptr<dispatcher>& handler() {
         return dispatcher_ptr_;
     }    
+
+    // false before the first bind or connect, there is no porter, no runtime and no peer yet
+    bool companied() const {
+        return companied_.load(std::memory_order_acquire);
+    }
+
+    // The context frozen by the first bind or connect, for the paths taken per message, only once companied
+    const spdmq_runtime& runtime() {
+        return dispatcher_ptr_->porter_ptr()->runtime();
+    }
 };
 
 } /* namespace speed::mq */
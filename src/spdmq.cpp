@@ -34,14 +34,62 @@ spdmq_code_t spdmq::send(spdmq_msg_t& msg) {
     return reinterpret_cast<spdmq_impl*>(this)->send(msg);
 }
 
+spdmq_code_t spdmq::send(spdmq_msg_t& msg, const spdmq_payload_t& payload) {
+    return reinterpret_cast<spdmq_impl*>(this)->send(msg, payload);
+}
+
 spdmq_code_t spdmq::recv(spdmq_msg_t& msg, time_msec_t time_out) {
     return reinterpret_cast<spdmq_impl*>(this)->recv(msg, time_out);
 }
 
+spdmq_code_t spdmq::recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) {
+    return reinterpret_cast<spdmq_impl*>(this)->recv(msg, topic, time_out);
+}
+
+std::map<std::string, spdmq_topic_stat_t> spdmq::topic_stats() {
+    return reinterpret_cast<spdmq_impl*>(this)->topic_stats();
+}
+
+spdmq_checksum_stat_t spdmq::checksum_stats() {
+    return reinterpret_cast<spdmq_impl*>(this)->checksum_stats();
+}
+
+std::vector<spdmq_dispatch_stat_t> spdmq::dispatch_stats() {
+    return reinterpret_cast<spdmq_impl*>(this)->dispatch_stats();
+}
+
+spdmq_code_t spdmq::request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out) {
+    return reinterpret_cast<spdmq_impl*>(this)->request(msg, std::move(on_reply), time_out);
+}
+
+spdmq_code_t spdmq::request(spdmq_msg_t& msg, spdmq_msg_t& reply, time_msec_t time_out) {
+    return reinterpret_cast<spdmq_impl*>(this)->request(msg, reply, time_out);
+}
+
+bool spdmq::wait_recv(spdmq_waiter_t& waiter) {
+    return reinterpret_cast<spdmq_impl*>(this)->wait_recv(waiter);
+}
+
+bool spdmq::wait_writable(spdmq_waiter_t& waiter) {
+    return reinterpret_cast<spdmq_impl*>(this)->wait_writable(waiter);
+}
+
+bool spdmq::wait_connect(spdmq_waiter_t& waiter, const std::string& url) {
+    return reinterpret_cast<spdmq_impl*>(this)->wait_connect(waiter, url);
+}
+
 void spdmq::spin(bool background) {
     reinterpret_cast<spdmq_impl*>(this)->spin(background);
 }
 
+int32_t spdmq::process(uint32_t max_events, uint32_t budget) {
+    return reinterpret_cast<spdmq_impl*>(this)->process(max_events, budget);
+}
+
+int32_t spdmq::native_handle() {
+    return reinterpret_cast<spdmq_impl*>(this)->native_handle();
+}
+
 spdmq::spdmq() {}
 
 spdmq::~spdmq() {}
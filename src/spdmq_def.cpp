@@ -67,11 +67,145 @@ spdmq_ctx& spdmq_ctx::queue_size(uint32_t queue_size) {
     return *this;
 }
 
+spdmq_ctx& spdmq_ctx::dual_stack(bool dual_stack) {
+    _dual_stack = dual_stack;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::socket_profile(socket_profile_t socket_profile) {
+    _socket_profile = socket_profile;
+    _socket_opt = {};
+    switch (socket_profile) {
+        case SOCKET_PROFILE::LOW_LATENCY:
+            _socket_opt.tcp_nodelay = true;
+            _socket_opt.tcp_quickack = true;
+            break;
+        case SOCKET_PROFILE::THROUGHPUT:
+            _socket_opt.send_buffer = 4 * 1024 * 1024;
+            _socket_opt.recv_buffer = 4 * 1024 * 1024;
+            break;
+        default:
+            break;
+    }
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::socket_opt(const spdmq_socket_opt_t& socket_opt) {
+    _socket_profile = SOCKET_PROFILE::CUSTOM;
+    _socket_opt = socket_opt;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::send_hwm(uint32_t send_hwm) {
+    _send_hwm = send_hwm;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::push_strategy(push_strategy_t push_strategy) {
+    _push_strategy = push_strategy;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::weight(uint32_t weight) {
+    _weight = weight;
+    return *this;
+}
+
 spdmq_ctx& spdmq_ctx::topics(std::set<std::string> topics) {
     _topics = topics;
     return *this;
 }
 
+spdmq_ctx& spdmq_ctx::conflate_topics(std::set<std::string> conflate_topics) {
+    _conflate_topics = conflate_topics;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::last_value_cache(bool last_value_cache) {
+    _last_value_cache = last_value_cache;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::topic_queue(const std::string& topic, const spdmq_topic_queue_t& topic_queue) {
+    _topic_queues[topic] = topic_queue;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::credit_window(const spdmq_credit_window_t& credit_window) {
+    _credit_window = credit_window;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::replay_depth(uint32_t replay_depth) {
+    _replay_depth = replay_depth;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::topic_ttl(const std::string& topic, int64_t ttl) {
+    _topic_ttls[topic] = ttl;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::journal(const spdmq_journal_opt_t& journal) {
+    _journal = journal;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::replay_from(uint64_t replay_from) {
+    _replay_from = replay_from;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::replay_since(int64_t replay_since) {
+    _replay_since = replay_since;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::monotonic_stamp(bool monotonic_stamp) {
+    _monotonic_stamp = monotonic_stamp;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::latency_histogram(bool latency_histogram) {
+    _latency_histogram = latency_histogram;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::frame_version(uint8_t frame_version) {
+    _frame_version = frame_version;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::compression(const std::string& topic, const spdmq_compression_opt_t& compression) {
+    _compressions[topic] = compression;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::checksum(bool checksum) {
+    _checksum = checksum;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::executor(spdmq_executor_t executor) {
+    _executor = std::move(executor);
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::dispatch_threads(uint32_t dispatch_threads) {
+    _dispatch_threads = dispatch_threads;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::dispatch_key(dispatch_key_t dispatch_key) {
+    _dispatch_key = dispatch_key;
+    return *this;
+}
+
+spdmq_ctx& spdmq_ctx::external_loop(bool external_loop) {
+    _external_loop = external_loop;
+    return *this;
+}
+
 /* variable get */
 comm_mode_t spdmq_ctx::mode() {
     return _mode;
@@ -112,8 +246,122 @@ uint32_t spdmq_ctx::queue_size() {
     return _queue_size;
 }
 
-std::set<std::string> spdmq_ctx::topics() {
+bool spdmq_ctx::dual_stack() {
+    return _dual_stack;
+}
+
+socket_profile_t spdmq_ctx::socket_profile() {
+    return _socket_profile;
+}
+
+const spdmq_socket_opt_t& spdmq_ctx::socket_opt() {
+    return _socket_opt;
+}
+
+uint32_t spdmq_ctx::send_hwm() {
+    return _send_hwm;
+}
+
+push_strategy_t spdmq_ctx::push_strategy() {
+    return _push_strategy;
+}
+
+uint32_t spdmq_ctx::weight() {
+    return _weight;
+}
+
+const std::set<std::string>& spdmq_ctx::topics() {
     return _topics;
 }
 
+const std::set<std::string>& spdmq_ctx::conflate_topics() {
+    return _conflate_topics;
+}
+
+bool spdmq_ctx::last_value_cache() {
+    return _last_value_cache;
+}
+
+spdmq_topic_queue_t spdmq_ctx::topic_queue(const std::string& topic) {
+    auto it = _topic_queues.find(topic);
+    if (it != _topic_queues.end()) {
+        return it->second;
+    }
+    spdmq_topic_queue_t topic_queue;
+    topic_queue.capacity = _queue_size;
+    return topic_queue;
+}
+
+const spdmq_credit_window_t& spdmq_ctx::credit_window() {
+    return _credit_window;
+}
+
+uint32_t spdmq_ctx::replay_depth() {
+    return _replay_depth;
+}
+
+int64_t spdmq_ctx::topic_ttl(const std::string& topic) {
+    if (_topic_ttls.empty()) {
+        return 0;
+    }
+    auto it = _topic_ttls.find(topic);
+    return it == _topic_ttls.end() ? 0 : it->second;
+}
+
+const spdmq_journal_opt_t& spdmq_ctx::journal() {
+    return _journal;
+}
+
+uint64_t spdmq_ctx::replay_from() {
+    return _replay_from;
+}
+
+int64_t spdmq_ctx::replay_since() {
+    return _replay_since;
+}
+
+bool spdmq_ctx::monotonic_stamp() {
+    return _monotonic_stamp;
+}
+
+bool spdmq_ctx::latency_histogram() {
+    return _latency_histogram;
+}
+
+uint8_t spdmq_ctx::frame_version() {
+    return _frame_version;
+}
+
+const spdmq_compression_opt_t& spdmq_ctx::compression(std::string_view topic) {
+    static const spdmq_compression_opt_t none;
+    if (_compressions.empty()) {
+        return none;
+    }
+    auto it = _compressions.find(topic);
+    if (it == _compressions.end()) {
+        it = _compressions.find(std::string_view());
+    }
+    return it == _compressions.end() ? none : it->second;
+}
+
+bool spdmq_ctx::checksum() {
+    return _checksum;
+}
+
+const spdmq_executor_t& spdmq_ctx::executor() {
+    return _executor;
+}
+
+uint32_t spdmq_ctx::dispatch_threads() {
+    return _dispatch_threads;
+}
+
+dispatch_key_t spdmq_ctx::dispatch_key() {
+    return _dispatch_key;
+}
+
+bool spdmq_ctx::external_loop() {
+    return _external_loop;
+}
+
 } /* namespace speed::mq */
\ No newline at end of file
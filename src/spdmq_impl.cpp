@@ -18,10 +18,16 @@
 #include "mode_factory.h"
 #include "spdmq_func.hpp"
 #include <cstdint>
+#include <future>
+#include <sys/un.h>
+#include <net/if.h>
+#include <arpa/inet.h>
 
 namespace speed::mq {
 
 spdmq_impl::spdmq_impl(spdmq_ctx& ctx) : ctx_(ctx) {
+    // The clock calibrates itself on first use, better here than on the first message
+    spdmq_clock::instance();
     spdmq_mode_ptr_ = mode_factory::instance()->create_mode(ctx);
 }
 
@@ -30,7 +36,8 @@ spdmq_code_t spdmq_impl::bind(const std::string& url) {
     if (!url_parse.parse_result) {
         return SPDMQ_CODE_ADDRESS_ERROR;
     }
-    spdmq_mode_ptr_->bind();
+    take_callbacks();
+    spdmq_mode_ptr_->bind(url_parse);
     return SPDMQ_CODE_OK;
 }
 
@@ -39,7 +46,8 @@ spdmq_code_t spdmq_impl::connect(const std::string& url) {
     if (!url_parse.parse_result) {
         return SPDMQ_CODE_ADDRESS_ERROR;
     }
-    spdmq_mode_ptr_->connect();
+    take_callbacks();
+    spdmq_mode_ptr_->connect(url_parse);
     return SPDMQ_CODE_OK;
 }
 
@@ -47,43 +55,188 @@ spdmq_code_t spdmq_impl::send(spdmq_msg_t& msg) {
     return spdmq_mode_ptr_->send(msg);
 }
 
+spdmq_code_t spdmq_impl::send(spdmq_msg_t& msg, const spdmq_payload_t& payload) {
+    return spdmq_mode_ptr_->send(msg, payload);
+}
+
 spdmq_code_t spdmq_impl::recv(spdmq_msg_t& msg, time_msec_t time_out) {
     return spdmq_mode_ptr_->recv(msg, time_out);
 }
 
+spdmq_code_t spdmq_impl::recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out) {
+    return spdmq_mode_ptr_->recv(msg, topic, time_out);
+}
+
+std::map<std::string, spdmq_topic_stat_t> spdmq_impl::topic_stats() {
+    return spdmq_mode_ptr_->topic_stats();
+}
+
+spdmq_checksum_stat_t spdmq_impl::checksum_stats() {
+    return spdmq_mode_ptr_->checksum_stats();
+}
+
+std::vector<spdmq_dispatch_stat_t> spdmq_impl::dispatch_stats() {
+    return spdmq_mode_ptr_->dispatch_stats();
+}
+
+spdmq_code_t spdmq_impl::request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out) {
+    return spdmq_mode_ptr_->request(msg, std::move(on_reply), time_out);
+}
+
+spdmq_code_t spdmq_impl::request(spdmq_msg_t& msg, spdmq_msg_t& reply, time_msec_t time_out) {
+    // The callback is called exactly once for a sent request: reply, timeout or broken connection
+    auto result = std::make_shared<std::promise<spdmq_code_t>>();
+    auto future = result->get_future();
+    auto ret = spdmq_mode_ptr_->request(msg, [result, &reply](spdmq_code_t code, spdmq_msg_t& msg) {
+        reply = std::move(msg);
+        result->set_value(code);
+    }, time_out);
+    if (ret != SPDMQ_CODE_OK) {
+        return ret;
+    }
+    return future.get();
+}
+
+bool spdmq_impl::wait_recv(spdmq_waiter_t& waiter) {
+    return spdmq_mode_ptr_->wait_recv(waiter);
+}
+
+bool spdmq_impl::wait_writable(spdmq_waiter_t& waiter) {
+    take_callbacks();
+    return spdmq_mode_ptr_->wait_writable(waiter);
+}
+
+bool spdmq_impl::wait_connect(spdmq_waiter_t& waiter, const std::string& url) {
+    auto url_parse = url_format_check_and_parse(url);
+    if (!url_parse.parse_result) {
+        waiter.code = SPDMQ_CODE_ADDRESS_ERROR;
+        return false;
+    }
+    take_callbacks();
+    return spdmq_mode_ptr_->wait_connect(waiter, url_parse);
+}
+
+void spdmq_impl::take_callbacks() {
+    // The mode hooks them up when it registers with its first bind or connect, those set later are not called
+    std::call_once(callbacks_flag_, [this] {
+        if (on_recv) {
+            spdmq_mode_ptr_->on_mode_recv = [this](spdmq_msg_t& msg) { on_recv(msg); };
+        }
+        if (on_online) {
+            spdmq_mode_ptr_->on_mode_online = [this](spdmq_msg_t& msg) { on_online(msg); };
+        }
+        if (on_offline) {
+            spdmq_mode_ptr_->on_mode_offline = [this](spdmq_msg_t& msg) { on_offline(msg); };
+        }
+    });
+}
+
 void spdmq_impl::spin(bool background) {
     return spdmq_mode_ptr_->spin(background);
 }
 
+int32_t spdmq_impl::process(uint32_t max_events, uint32_t budget) {
+    take_callbacks();
+    return spdmq_mode_ptr_->process(max_events, budget);
+}
+
+int32_t spdmq_impl::native_handle() {
+    take_callbacks();
+    return spdmq_mode_ptr_->native_handle();
+}
+
 spdmq_url_parse_t spdmq_impl::url_format_check_and_parse(const std::string& url) {
     spdmq_url_parse_t url_parse = {};
     url_parse.parse_result = true;
-    if (url.substr(0, 6) == "ipc://" && regex_match(url.substr(6), R"([a-zA-Z0-9@\._]+)")) {
-        url_parse.address = "/tmp/" + url.substr(6);
-        ctx_.domain(COMM_DOMAIN::IPC);
-        ctx_.config<socket_mode_t>("socket_mode", SOCKET_MODE::UDS);
-        // auto socket_mode = ctx_.config<socket_mode_t>("socket_mode");
-        // printf("socket_mode:%d\n", static_cast<int32_t>(socket_mode));
+    auto scheme_end = url.find("://");
+    auto scheme = url.substr(0, scheme_end);
+    auto address = scheme_end == std::string::npos ? std::string() : url.substr(scheme_end + 3);
+
+    if ((scheme == "ipc" || scheme == "ipc+seq") && ipc_address_parse(address, url_parse)) {
+        url_parse.domain = COMM_DOMAIN::IPC;
+        url_parse.socket_mode = SOCKET_MODE::UDS;
+        url_parse.protocol_type = COMM_PROTOCOL_TYPE::TCP;
+        if (scheme == "ipc+seq" || ctx_.protocol_type() == COMM_PROTOCOL_TYPE::SEQPACKET) {
+            url_parse.protocol_type = COMM_PROTOCOL_TYPE::SEQPACKET;
+        }
     }
-    else if ((url.substr(0, 6) == "tcp://" || url.substr(0, 6) == "udp://") && regex_match(url.substr(6), R"(((2(5[0-5]|[0-4]\d))|[0-1]?\d{1,2})(\.((2(5[0-5]|[0-4]\d))|[0-1]?\d{1,2})){3}:[0-9]{1,5})")) {
-        url_parse.address = url.substr(6);
-        url_parse.ip = url_parse.address.substr(0, url_parse.address.find(":"));
-        url_parse.port = std::atoi(url_parse.address.substr(url_parse.address.find(":") + 1).c_str());
-        ctx_.domain(COMM_DOMAIN::IPV4);
-        if (url.substr(0, 3) == "tcp") {
-            ctx_.protocol_type(COMM_PROTOCOL_TYPE::TCP);
-            ctx_.config<socket_mode_t>("socket_mode", SOCKET_MODE::TCP);
+    else if ((scheme == "tcp" || scheme == "udp") && ip_address_parse(address, url_parse)) {
+        url_parse.address = address;
+        url_parse.domain = url_parse.ip.find(':') == std::string::npos ? COMM_DOMAIN::IPV4 : COMM_DOMAIN::IPV6;
+        if (scheme == "tcp") {
+            url_parse.protocol_type = COMM_PROTOCOL_TYPE::TCP;
+            url_parse.socket_mode = SOCKET_MODE::TCP;
         }
-        if (url.substr(0, 3) == "udp") {
-            ctx_.protocol_type(COMM_PROTOCOL_TYPE::UDP);
-            ctx_.config<socket_mode_t>("socket_mode", SOCKET_MODE::UDP);
+        if (scheme == "udp") {
+            url_parse.protocol_type = COMM_PROTOCOL_TYPE::UDP;
+            url_parse.socket_mode = SOCKET_MODE::UDP;
         }
     }
+    else if (scheme == "inproc" && !address.empty() && address.find('\0') == std::string::npos) {
+        url_parse.address = address;
+        url_parse.domain = COMM_DOMAIN::INPROC;
+        url_parse.socket_mode = SOCKET_MODE::INPROC;
+        url_parse.protocol_type = COMM_PROTOCOL_TYPE::UNKNOW;
+    }
     else {
         url_parse.parse_result = false;
     }
-    ctx_.config<spdmq_url_parse_t>("url_parse", url_parse);
     return url_parse;
 }
 
+bool spdmq_impl::ipc_address_parse(const std::string& address, spdmq_url_parse_t& url_parse) {
+    // The last byte of sun_path is reserved for '\0' (file path) or the leading '\0' (abstract namespace)
+    constexpr std::size_t max_path_len = sizeof(sockaddr_un::sun_path) - 1;
+
+    // ipc://@name, linux abstract namespace, no filesystem inode, lock file or unlink required
+    if (address.size() > 1 && address[0] == '@') {
+        url_parse.abstract = true;
+        url_parse.address = address.substr(1);
+        return url_parse.address.size() <= max_path_len && url_parse.address.find('\0') == std::string::npos;
+    }
+
+    // ipc:///absolute/path
+    if (address.size() > 1 && address[0] == '/') {
+        url_parse.address = address;
+        return address.size() <= max_path_len && address.back() != '/' && address.find('\0') == std::string::npos;
+    }
+
+    // ipc://name, the socket file is placed under /tmp/
+    url_parse.address = "/tmp/" + address;
+    return is_ipc_name(address) && url_parse.address.size() <= max_path_len;
+}
+
+bool spdmq_impl::ip_address_parse(const std::string& address, spdmq_url_parse_t& url_parse) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+
+    uint32_t port = 0;
+    if (!parse_decimal(address.substr(colon + 1), UINT16_MAX, port)) {
+        return false;
+    }
+    url_parse.port = static_cast<uint16_t>(port);
+
+    // [ipv6]:port, the ipv6 address may carry a scope, such as [fe80::1%eth0]
+    if (address[0] == '[') {
+        if (colon < 2 || address[colon - 1] != ']') {
+            return false;
+        }
+        url_parse.ip = address.substr(1, colon - 2);
+        auto percent = url_parse.ip.find('%');
+        if (percent != std::string::npos) {
+            url_parse.scope = url_parse.ip.substr(percent + 1);
+            url_parse.ip.resize(percent);
+        }
+        in6_addr addr;
+        return inet_pton(AF_INET6, url_parse.ip.c_str(), &addr) == 1 &&
+               (url_parse.scope.empty() || if_nametoindex(url_parse.scope.c_str()) != 0);
+    }
+
+    // ipv4:port
+    url_parse.ip = address.substr(0, colon);
+    return is_ipv4_address(url_parse.ip);
+}
+
 } /* namespace speed::mq */
\ No newline at end of file
@@ -27,6 +27,7 @@ class spdmq_impl : public spdmq {
 private:
     spdmq_ctx& ctx_;
     std::shared_ptr<spdmq_mode> spdmq_mode_ptr_;
+    std::once_flag callbacks_flag_;
 
 public:
     spdmq_impl(spdmq_ctx& ctx);
@@ -36,13 +37,39 @@ public:
     spdmq_code_t connect(const std::string& url);
 
     spdmq_code_t send(spdmq_msg_t& msg);
+    spdmq_code_t send(spdmq_msg_t& msg, const spdmq_payload_t& payload);
 
     spdmq_code_t recv(spdmq_msg_t& msg, time_msec_t time_out);
 
+    spdmq_code_t recv(spdmq_msg_t& msg, const std::string& topic, time_msec_t time_out);
+
+    std::map<std::string, spdmq_topic_stat_t> topic_stats();
+
+    spdmq_checksum_stat_t checksum_stats();
+
+    std::vector<spdmq_dispatch_stat_t> dispatch_stats();
+
+    spdmq_code_t request(spdmq_msg_t& msg, std::function<void(spdmq_code_t, spdmq_msg_t&)> on_reply, time_msec_t time_out);
+
+    spdmq_code_t request(spdmq_msg_t& msg, spdmq_msg_t& reply, time_msec_t time_out);
+
+    bool wait_recv(spdmq_waiter_t& waiter);
+
+    bool wait_writable(spdmq_waiter_t& waiter);
+
+    bool wait_connect(spdmq_waiter_t& waiter, const std::string& url);
+
     void spin(bool background);
 
+    int32_t process(uint32_t max_events, uint32_t budget);
+
+    int32_t native_handle();
+
 private:
+    void take_callbacks();
     spdmq_url_parse_t url_format_check_and_parse(const std::string& url);
+    bool ipc_address_parse(const std::string& address, spdmq_url_parse_t& url_parse);
+    bool ip_address_parse(const std::string& address, spdmq_url_parse_t& url_parse);
 };
 
 } /* namespace speed::mq */
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include "spdmq/spdmq.h"
+using namespace speed::mq;
+
+// 转发代理: 作为订阅者连接上游发布者, 作为发布者服务下游订阅者, 数据帧原样转发
+// 用法: ./spdmq_proxyd -u 上游地址 [-u 上游地址 ...] -d 下游地址 [-d 下游地址 ...]
+// 例如: ./spdmq_proxyd -u tcp://10.0.0.1:5555 -u tcp://10.0.0.2:5555 -d tcp://0.0.0.0:6666 -d ipc://spdmq_proxy
+
+static void usage(const char* name) {
+    std::cout << "usage: " << name << " -u upstream_url [-u upstream_url ...] -d downstream_url [-d downstream_url ...]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> upstream_urls;
+    std::vector<std::string> downstream_urls;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "-u") {
+            upstream_urls.emplace_back(argv[i + 1]);
+        }
+        else if (opt == "-d") {
+            downstream_urls.emplace_back(argv[i + 1]);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0 || upstream_urls.empty() || downstream_urls.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    spdmq_ctx_t ctx;
+    ctx.mode(COMM_MODE::SPDMQ_PROXY).socket_profile(SOCKET_PROFILE::LOW_LATENCY); // 设置代理模式, 转发路径低延迟
+    auto mq_ptr = NEW_SPDMQ(ctx);
+
+    // 先绑定下游地址, 订阅关系建立后再向上游转发
+    for (auto& url : downstream_urls) {
+        if (mq_ptr->bind(url) != SPDMQ_CODE_OK) {
+            std::cout << "bind failed: " << url << std::endl;
+            return 1;
+        }
+    }
+    for (auto& url : upstream_urls) {
+        if (mq_ptr->connect(url) != SPDMQ_CODE_OK) {
+            std::cout << "connect failed: " << url << std::endl;
+            return 1;
+        }
+    }
+
+    // 前台运行
+    mq_ptr->spin(false);
+    return 0;
+}